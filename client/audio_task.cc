@@ -32,26 +32,81 @@ std::string clean_string(std::string str) {
   return str;
 }
 
+bool ParseBenchmarkMode(const std::string &name, BenchmarkMode *mode) {
+  if (name == "e2e") {
+    *mode = BenchmarkMode::E2E;
+  } else if (name == "asr") {
+    *mode = BenchmarkMode::ASR;
+  } else if (name == "nlp") {
+    *mode = BenchmarkMode::NLP;
+  } else if (name == "tts") {
+    *mode = BenchmarkMode::TTS;
+  } else {
+    return false;
+  }
+  return true;
+}
+
 AudioTask::AudioTask(
     const std::shared_ptr<AudioData> &audio_data, const uint32_t corr_id,
-    const Stream::PrepareFn &infer_prepare_fn, const std::string &language_code,
+    const BenchmarkMode mode, const TaskPrepareFns &prepare_fns,
+    const std::string &language_code, const std::string &asr_model_name,
     const int32_t chunk_duration_ms, const bool print_results,
+    const bool text_question, const std::string &stream_class,
     std::shared_ptr<speech_squad::SquadEvalDataset> &squad_eval_dataset,
     std::shared_ptr<OutputFilestreams> &output_filestream,
     std::shared_ptr<nvrpc::client::Executor> &executor,
-    const TimePoint &start_time)
-    : audio_data_(audio_data), offset_(0), corr_id_(corr_id),
-      language_code_(language_code), chunk_duration_ms_(chunk_duration_ms),
-      print_results_(print_results), squad_eval_dataset_(squad_eval_dataset),
+    const TimePoint &start_time,
+    const std::shared_ptr<CapturedStream> &captured)
+    : audio_data_(audio_data), captured_(captured), captured_index_(0),
+      captured_start_(start_time), offset_(0), corr_id_(corr_id), mode_(mode),
+      language_code_(language_code), asr_model_name_(asr_model_name),
+      chunk_duration_ms_(chunk_duration_ms), print_results_(print_results),
+      text_question_(text_question), stream_class_(stream_class),
+      squad_eval_dataset_(squad_eval_dataset),
       output_filestreams_(output_filestream), next_time_point_(start_time),
-      audio_processed_(0.), state_(START) {
-  // Prepare the server stream to be used with the transaction
-  stream_ = std::make_unique<Stream>(
-      infer_prepare_fn, executor,
-      [this](SpeechSquadInferResponse &&response) {
-        ReceiveResponse(std::move(response));
-      },
-      [this](const ::grpc::Status &status) { FinalizeTask(status); });
+      audio_processed_(0.), audio_received_(0), state_(START),
+      complete_(false) {
+  auto on_stage_complete = [this](const ::grpc::Status &status,
+                                  const TrailingMetadata &metadata) {
+    FinalizeStageTask(status, metadata);
+  };
+
+  // Prepare the stream to be used with the transaction
+  switch (mode_) {
+  case BenchmarkMode::E2E:
+    stream_ = std::make_unique<Stream>(
+        prepare_fns.squad, executor,
+        [this](SpeechSquadInferResponse &&response) {
+          ReceiveResponse(std::move(response));
+        },
+        [this](const ::grpc::Status &status) { FinalizeTask(status); });
+    break;
+  case BenchmarkMode::ASR:
+    asr_stream_ = std::make_unique<ASRStream>(
+        prepare_fns.asr, executor,
+        [this](asr_response_t &&response) {
+          ReceiveASRResponse(std::move(response));
+        },
+        on_stage_complete);
+    break;
+  case BenchmarkMode::NLP:
+    nlp_call_ = std::make_unique<NLPCall>(
+        prepare_fns.nlp, executor,
+        [this](nlp_response_t &&response) {
+          ReceiveNLPResponse(std::move(response));
+        },
+        on_stage_complete);
+    break;
+  case BenchmarkMode::TTS:
+    tts_call_ = std::make_unique<TTSCall>(
+        prepare_fns.tts, executor,
+        [this](tts_response_t &&response) {
+          ReceiveTTSResponse(std::move(response));
+        },
+        on_stage_complete);
+    break;
+  }
 
   result_ = std::make_shared<Results>();
   if (print_results_) {
@@ -76,50 +131,33 @@ Status AudioTask::Step() {
   // std::cerr << "step delay " << std::chrono::duration<double,
   //  std::milli>(send_time_ - next_time_point_).count() << "ms" << std::endl;
 
+  if (captured_) {
+    return SendCaptured();
+  }
+
+  // The text stages are a single request, there is no audio to pace
+  if ((mode_ == BenchmarkMode::NLP) || (mode_ == BenchmarkMode::TTS)) {
+    return SendText();
+  }
+
   // TODO: Can colllect the delay in scheduling to report the quality
   if (state_ == START) {
     // Send the configuration if at the first step
-    auto speech_squad_config = request_.mutable_speech_squad_config();
-
-    // Input Audio Configuration
-    speech_squad_config->mutable_input_audio_config()->set_encoding(
-        audio_data_->encoding);
-    speech_squad_config->mutable_input_audio_config()->set_sample_rate_hertz(
-        audio_data_->sample_rate);
-    speech_squad_config->mutable_input_audio_config()->set_language_code(
-        language_code_);
-    speech_squad_config->mutable_input_audio_config()->set_audio_channel_count(
-        audio_data_->channels);
-
-    // Ouput Audio Configuration
-    speech_squad_config->mutable_output_audio_config()->set_encoding(
-        LINEAR_PCM);
-    speech_squad_config->mutable_output_audio_config()->set_sample_rate_hertz(
-        22050);
-    speech_squad_config->mutable_output_audio_config()->set_language_code(
-        "en-US");
-    speech_squad_config->mutable_output_audio_config()->set_audio_channel_count(
-        1);
-
-    auto status = squad_eval_dataset_->GetQuestionContext(
-        audio_data_->question_id, speech_squad_config->mutable_squad_context());
-    if (!status.IsOk()) {
+    auto status = SendConfig();
+    if (!status.IsOk() || (state_ == SENDING_COMPLETE)) {
       return status;
     }
-
-    stream_->Write(std::move(request_));
     state_ = SENDING;
   } else {
     // Send the audio content if not the first step
-    request_.set_audio_content(&audio_data_->data[offset_], bytes_to_send_);
-    offset_ += bytes_to_send_;
-    if (!stream_->Write(std::move(request_))) {
-      if (!stream_->CloseWrites()) {
+    if (!WriteAudio(&audio_data_->data[offset_], bytes_to_send_)) {
+      if (!CloseWrites()) {
         VLOG(2) << "Failed to CloseWrites for task: " << corr_id_;
       }
       state_ = SENDING_COMPLETE;
       DVLOG(2) << "Write failed for task: " << corr_id_;
     }
+    offset_ += bytes_to_send_;
   }
 
   // Set and schedule the next chunk
@@ -131,7 +169,7 @@ Status AudioTask::Step() {
 
   // Transition to the sending completion if no more bytes to send
   if (bytes_to_send_ == 0) {
-    if (!stream_->CloseWrites()) {
+    if (!CloseWrites()) {
       VLOG(2) << "Failed to CloseWrites for task: " << corr_id_;
     }
     state_ = SENDING_COMPLETE;
@@ -148,8 +186,173 @@ Status AudioTask::Step() {
   return Status::Success;
 }
 
+Status AudioTask::SendCaptured() {
+  auto &requests = captured_->requests;
+  if (captured_index_ == requests.size()) {
+    if (!CloseWrites()) {
+      VLOG(2) << "Failed to CloseWrites for task: " << corr_id_;
+    }
+    state_ = SENDING_COMPLETE;
+    DVLOG(2) << "Sending complete for captured task: " << corr_id_;
+    return Status::Success;
+  }
+
+  // Copied, the capture is replayed on every iteration
+  SpeechSquadInferRequest request = requests[captured_index_++].request;
+  if (request.audio_content().size() && audio_data_->sample_rate) {
+    audio_processed_ += (double)request.audio_content().size() /
+                        (sizeof(int16_t) * audio_data_->sample_rate *
+                         std::max(audio_data_->channels, 1));
+  }
+  if (!stream_->Write(std::move(request))) {
+    if (!CloseWrites()) {
+      VLOG(2) << "Failed to CloseWrites for task: " << corr_id_;
+    }
+    state_ = SENDING_COMPLETE;
+    DVLOG(2) << "Write failed for task: " << corr_id_;
+    return Status::Success;
+  }
+  state_ = SENDING;
+
+  // The next request, or the close, at its captured offset
+  auto offset_us = (captured_index_ < requests.size())
+                       ? requests[captured_index_].offset_us
+                       : captured_->close_us;
+  next_time_point_ = captured_start_ + std::chrono::microseconds(offset_us);
+  return Status::Success;
+}
+
+Status AudioTask::SendConfig() {
+  if (mode_ == BenchmarkMode::ASR) {
+    asr_request_t request;
+    auto config = request.mutable_streaming_config()->mutable_config();
+    request.mutable_streaming_config()->set_interim_results(false);
+    config->set_encoding(nvidia::riva::AudioEncoding::LINEAR_PCM);
+    config->set_sample_rate_hertz(audio_data_->sample_rate);
+    config->set_language_code(language_code_);
+    config->set_audio_channel_count(audio_data_->channels);
+    config->set_max_alternatives(1);
+    config->set_model(asr_model_name_);
+    asr_stream_->Write(std::move(request));
+    return Status::Success;
+  }
+
+  auto speech_squad_config = request_.mutable_speech_squad_config();
+
+  // Input Audio Configuration
+  speech_squad_config->mutable_input_audio_config()->set_encoding(
+      audio_data_->encoding);
+  speech_squad_config->mutable_input_audio_config()->set_sample_rate_hertz(
+      audio_data_->sample_rate);
+  speech_squad_config->mutable_input_audio_config()->set_language_code(
+      language_code_);
+  speech_squad_config->mutable_input_audio_config()->set_audio_channel_count(
+      audio_data_->channels);
+
+  // Ouput Audio Configuration
+  speech_squad_config->mutable_output_audio_config()->set_encoding(LINEAR_PCM);
+  speech_squad_config->mutable_output_audio_config()->set_sample_rate_hertz(
+      22050);
+  speech_squad_config->mutable_output_audio_config()->set_language_code(
+      "en-US");
+  speech_squad_config->mutable_output_audio_config()->set_audio_channel_count(
+      1);
+
+  speech_squad_config->set_stream_class(stream_class_);
+
+  auto status = squad_eval_dataset_->GetQuestionContext(
+      audio_data_->question_id, speech_squad_config->mutable_squad_context());
+  if (!status.IsOk()) {
+    return status;
+  }
+
+  if (text_question_) {
+    // The question text replaces the audio, so the config is the only
+    // request of the stream
+    status = squad_eval_dataset_->GetQuestion(
+        audio_data_->question_id, speech_squad_config->mutable_squad_question());
+    if (!status.IsOk()) {
+      return status;
+    }
+    stream_->Write(std::move(request_));
+    if (!stream_->CloseWrites()) {
+      VLOG(2) << "Failed to CloseWrites for task: " << corr_id_;
+    }
+    state_ = SENDING_COMPLETE;
+    DVLOG(2) << "Sending complete for text task: " << corr_id_;
+    return Status::Success;
+  }
+
+  stream_->Write(std::move(request_));
+  return Status::Success;
+}
+
+Status AudioTask::SendText() {
+  std::string question;
+  auto status =
+      squad_eval_dataset_->GetQuestion(audio_data_->question_id, &question);
+  if (!status.IsOk()) {
+    return status;
+  }
+
+  if (mode_ == BenchmarkMode::NLP) {
+    nlp_request_t request;
+    request.set_query(question);
+    status = squad_eval_dataset_->GetQuestionContext(
+        audio_data_->question_id, request.mutable_context());
+    if (!status.IsOk()) {
+      return status;
+    }
+    {
+      std::lock_guard<std::mutex> lock(result_->mtx);
+      result_->squad_question = question;
+    }
+    nlp_call_->Write(std::move(request));
+  } else {
+    // Synthesize the reference answer, as the server would after NLP
+    std::string answer;
+    status = squad_eval_dataset_->GetAnswer(audio_data_->question_id, &answer);
+    if (!status.IsOk()) {
+      return status;
+    }
+    {
+      std::lock_guard<std::mutex> lock(result_->mtx);
+      result_->squad_question = question;
+      result_->squad_answer = answer;
+    }
+    tts_request_t request;
+    request.set_text(answer.size() ? answer : "No answer");
+    request.set_encoding(nvidia::riva::AudioEncoding::LINEAR_PCM);
+    request.set_sample_rate_hz(22050);
+    request.set_language_code(language_code_);
+    request.set_voice_name("ljspeech");
+    tts_call_->Write(std::move(request));
+  }
+
+  state_ = SENDING_COMPLETE;
+  DVLOG(2) << "Sending complete for task: " << corr_id_;
+  return Status::Success;
+}
+
+bool AudioTask::WriteAudio(const char *data, size_t size) {
+  if (mode_ == BenchmarkMode::ASR) {
+    asr_request_t request;
+    request.set_audio_content(data, size);
+    return asr_stream_->Write(std::move(request));
+  }
+  request_.set_audio_content(data, size);
+  return stream_->Write(std::move(request_));
+}
+
+bool AudioTask::CloseWrites() {
+  if (mode_ == BenchmarkMode::ASR) {
+    return asr_stream_->CloseWrites();
+  }
+  return stream_->CloseWrites();
+}
+
 Status AudioTask::WaitForCompletion() {
-  while (!stream_->IsComplete()) {
+  while (!complete_) {
     std::this_thread::sleep_for(std::chrono::milliseconds(100));
   }
   DVLOG(2) << "Completed task: " << corr_id_
@@ -167,39 +370,121 @@ void AudioTask::ReceiveResponse(SpeechSquadInferResponse &&response) {
   std::lock_guard<std::mutex> lock(result_->mtx);
 
   if (response.has_metadata()) {
-    if (response.metadata().component_timing().empty()) {
-      result_->squad_question = response.metadata().squad_question();
-      result_->squad_answer = response.metadata().squad_answer();
-    } else {
-      std::vector<std::string> components;
-      GetComponents(&components);
-      for (const auto &component : components) {
-        auto itr = response.metadata().component_timing().find(component);
-        if (itr != response.metadata().component_timing().end()) {
-          result_->component_timings[component] = itr->second;
-        } 
+    const auto &metadata = response.metadata();
+    // The transcript is sent as soon as asr finalizes, ahead of the answer
+    if (!metadata.asr_transcription().empty()) {
+      result_->asr_transcription = metadata.asr_transcription();
+      result_->component_timings["Client Transcript Latency"] =
+          std::chrono::duration<double, std::milli>(now - send_time_).count();
+    }
+    if (!metadata.squad_question().empty() ||
+        !metadata.squad_answer().empty()) {
+      result_->squad_question = metadata.squad_question();
+      result_->squad_answer = metadata.squad_answer();
+    }
+    if (metadata.output_sample_rate_hz() > 0) {
+      result_->output_sample_rate_hz = metadata.output_sample_rate_hz();
+    }
+    if (!metadata.degradation().empty()) {
+      result_->degradation = metadata.degradation();
+    }
+    std::vector<std::string> components;
+    GetComponents(&components);
+    for (const auto &component : components) {
+      auto itr = metadata.component_timing().find(component);
+      if (itr != metadata.component_timing().end()) {
+        result_->component_timings[component] = itr->second;
       }
     }
-  } else {
-    if (print_results_) {
-      memcpy(result_->audio_content + result_->audio_offset,
-             (float *)response.audio_content().data(),
-             response.audio_content().length());
-      result_->audio_offset += response.audio_content().length();
+    // latencies of text stages inserted by the server's stage graph, and the
+    // completion of every stage streamed as it happens
+    for (const auto &timing : metadata.component_timing()) {
+      if (timing.first.compare(0, 21, "tracing.speech_squad.") == 0) {
+        result_->component_timings[timing.first] = timing.second;
+      }
     }
+  } else {
+    RecordAudio(response.audio_content(), now);
+  }
+}
 
-    if (result_->first_response) {
-      result_->response_latency =
-          std::chrono::duration<double, std::milli>(now - send_time_).count();
-      result_->first_response = false;
-    } else {
-      result_->response_intervals.push_back(
-          std::chrono::duration<double, std::milli>(
-              now - result_->last_response_timestamp)
-              .count());
+void AudioTask::ReceiveASRResponse(asr_response_t &&response) {
+  DVLOG(2) << "Received asr response for task: " << corr_id_;
+  auto now = std::chrono::high_resolution_clock::now();
+  if ((response.results_size() == 0) || !response.results(0).is_final() ||
+      (response.results(0).alternatives_size() == 0)) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> lock(result_->mtx);
+  // The final transcript is the asr equivalent of the first tts packet
+  result_->squad_question += response.results(0).alternatives(0).transcript();
+  RecordLatency(now);
+}
+
+void AudioTask::ReceiveNLPResponse(nlp_response_t &&response) {
+  DVLOG(2) << "Received nlp response for task: " << corr_id_;
+  auto now = std::chrono::high_resolution_clock::now();
+  std::lock_guard<std::mutex> lock(result_->mtx);
+  if (response.results_size() > 0) {
+    result_->squad_answer = response.results(0).answer();
+  }
+  RecordLatency(now);
+}
+
+void AudioTask::ReceiveTTSResponse(tts_response_t &&response) {
+  DVLOG(2) << "Received tts response for task: " << corr_id_;
+  auto now = std::chrono::high_resolution_clock::now();
+  std::lock_guard<std::mutex> lock(result_->mtx);
+  RecordAudio(response.audio(), now);
+}
+
+void AudioTask::RecordAudio(const std::string &audio, const TimePoint &now) {
+  if (print_results_) {
+    memcpy(result_->audio_content + result_->audio_offset,
+           (float *)audio.data(), audio.length());
+    result_->audio_offset += audio.length();
+  }
+  audio_received_ += audio.length();
+  RecordLatency(now);
+}
+
+void AudioTask::RecordLatency(const TimePoint &now) {
+  if (result_->first_response) {
+    result_->response_latency =
+        std::chrono::duration<double, std::milli>(now - send_time_).count();
+    result_->first_response = false;
+  } else {
+    result_->response_intervals.push_back(
+        std::chrono::duration<double, std::milli>(
+            now - result_->last_response_timestamp)
+            .count());
+  }
+  result_->last_response_timestamp = now;
+}
+
+void AudioTask::FinalizeStageTask(const ::grpc::Status &status,
+                                  const TrailingMetadata &metadata) {
+  {
+    // Riva reports its own latencies in the trailing metadata
+    std::lock_guard<std::mutex> lock(result_->mtx);
+    std::vector<std::string> components;
+    GetComponents(&components);
+    for (const auto &component : components) {
+      auto itr = metadata.find(component);
+      if (itr != metadata.end()) {
+        std::string value(itr->second.cbegin(), itr->second.cend());
+        result_->component_timings[component] = std::atof(value.c_str());
+      }
     }
-    result_->last_response_timestamp = now;
   }
+
+  // The throughput of the tts stage is measured in synthesized audio
+  if (mode_ == BenchmarkMode::TTS) {
+    audio_processed_ = (double)audio_received_ / (sizeof(float) * 22050);
+  }
+
+  FinalizeTask(status);
 }
 
 void AudioTask::FinalizeTask(const ::grpc::Status &status) {
@@ -209,68 +494,88 @@ void AudioTask::FinalizeTask(const ::grpc::Status &status) {
   if (!status.ok()) {
     grpc_status_ = status;
     std::cout << "." << std::flush;
+  } else if (print_results_) {
+    PrintResults();
+  } else {
+    std::cout << "." << std::flush;
+  }
+  complete_ = true;
+}
+
+void AudioTask::PrintResults() {
+  std::lock_guard<std::mutex> lock(output_filestreams_->mtx_);
+  std::cout << "-----------------------------------------------------------"
+            << std::endl;
+
+  std::string filename = audio_data_->filename;
+  std::cout << "File: " << filename << std::endl;
+  if (result_->squad_question.size() == 0) {
+    output_filestreams_->question_file_ << "{\"audio_filepath\": \""
+                                        << filename << "\",";
+    output_filestreams_->question_file_ << "\"question\": \"\"}" << std::endl;
     return;
   }
-  if (print_results_) {
-    std::lock_guard<std::mutex> lock(output_filestreams_->mtx_);
-    std::cout << "-----------------------------------------------------------"
-              << std::endl;
-
-    std::string filename = audio_data_->filename;
-    std::cout << "File: " << filename << std::endl;
-    if (result_->squad_question.size() == 0) {
-      output_filestreams_->question_file_ << "{\"audio_filepath\": \""
-                                          << filename << "\",";
-      output_filestreams_->question_file_ << "\"question\": \"\"}" << std::endl;
-    } else {
-      output_filestreams_->answer_file_
-          << "\"" << audio_data_->question_id << "\": \""
-          << clean_string(result_->squad_answer) << "\",";
-
-      output_filestreams_->question_file_ << "{\"audio_filepath\": \""
-                                          << filename << "\",";
-      output_filestreams_->question_file_
-          << "\"text\": \"" << result_->squad_question << "\"}" << std::endl;
-
-      if (result_->audio_offset == 0) {
-        task_status_ =
-            Status(Status::Code::INTERNAL, "No audio received in the response");
-      }
 
-      std::string output_filename = GetFullpath(
-          output_filestreams_->root_directory_,
-          std::string(std::to_string(output_filestreams_->wav_index_++) +
-                      ".wav"));
-      // WaveFileWriter::write(output_filename, 22050,
-      // (float*)&result_->audio_content[0], 4100 * 256);
-      WaveFileWriter::write(output_filename, 22050,
-                            (float *)&result_->audio_content[0],
-                            result_->audio_offset / sizeof(float));
-
-      output_filestreams_->wave_file_
-          << "{\"qid\":\"" << audio_data_->question_id << "\",\"text\":\""
-          << clean_string(result_->squad_answer)
-          << "\",\"synthesized_audio_path\":\"" << output_filename
-          << "\",\"latencies\":[";
-
-      bool first_latency = true;
-      for (const auto lat : result_->response_intervals) {
-        if (!first_latency) {
-          output_filestreams_->wave_file_ << ",";
-        }
-        output_filestreams_->wave_file_ << "\"" << std::to_string(lat) << "\"";
-        first_latency = false;
-      }
+  output_filestreams_->question_file_ << "{\"audio_filepath\": \"" << filename
+                                      << "\",";
+  output_filestreams_->question_file_
+      << "\"text\": \"" << result_->squad_question << "\"}" << std::endl;
+  std::cout << "SQUAD question: " << result_->squad_question << std::endl;
+  if (!result_->asr_transcription.empty()) {
+    std::cout << "ASR transcript: " << result_->asr_transcription << std::endl;
+  }
+
+  // The asr stage only produces the question
+  if (mode_ == BenchmarkMode::ASR) {
+    return;
+  }
+
+  output_filestreams_->answer_file_
+      << "\"" << audio_data_->question_id << "\": \""
+      << clean_string(result_->squad_answer) << "\",";
+  std::cout << "SQUAD answer: " << result_->squad_answer << std::endl;
+  if (!result_->degradation.empty()) {
+    std::cout << "Degraded: " << result_->degradation << std::endl;
+  }
 
-      output_filestreams_->wave_file_ << "]}" << std::endl;
+  // The nlp stage does not produce audio, nor does an overloaded server
+  // answering in text only
+  if (mode_ == BenchmarkMode::NLP || result_->degradation == "text_only") {
+    return;
+  }
+
+  if (result_->audio_offset == 0) {
+    task_status_ =
+        Status(Status::Code::INTERNAL, "No audio received in the response");
+  }
 
-      std::cout << "SQUAD question: " << result_->squad_question << std::endl;
-      std::cout << "SQUAD answer: " << result_->squad_answer << std::endl;
-      std::cout << "Output File: " << output_filename << std::endl;
+  std::string output_filename = GetFullpath(
+      output_filestreams_->root_directory_,
+      std::string(std::to_string(output_filestreams_->wav_index_++) + ".wav"));
+  // WaveFileWriter::write(output_filename, 22050,
+  // (float*)&result_->audio_content[0], 4100 * 256);
+  WaveFileWriter::write(output_filename, result_->output_sample_rate_hz,
+                        (float *)&result_->audio_content[0],
+                        result_->audio_offset / sizeof(float));
+
+  output_filestreams_->wave_file_
+      << "{\"qid\":\"" << audio_data_->question_id << "\",\"text\":\""
+      << clean_string(result_->squad_answer)
+      << "\",\"synthesized_audio_path\":\"" << output_filename
+      << "\",\"latencies\":[";
+
+  bool first_latency = true;
+  for (const auto lat : result_->response_intervals) {
+    if (!first_latency) {
+      output_filestreams_->wave_file_ << ",";
     }
-  } else {
-    std::cout << "." << std::flush;
+    output_filestreams_->wave_file_ << "\"" << std::to_string(lat) << "\"";
+    first_latency = false;
   }
+
+  output_filestreams_->wave_file_ << "]}" << std::endl;
+
+  std::cout << "Output File: " << output_filename << std::endl;
 }
 
 std::string AudioTask::StateAsString() {
@@ -16,8 +16,10 @@
 
 #pragma once
 
+#include "riva_streams.h"
 #include "status.h"
 #include "stream.h"
+#include "traffic_capture.h"
 #include "utils.h"
 
 namespace speech_squad {
@@ -28,8 +30,8 @@ inline std::string GetFullpath(const std::string &directory,
 }
 struct Results {
   Results()
-      : audio_content(nullptr), audio_offset(0), response_latency(0.),
-        first_response(true) {}
+      : output_sample_rate_hz(22050), audio_content(nullptr), audio_offset(0),
+        response_latency(0.), first_response(true) {}
 
   ~Results() {
     if (audio_content != nullptr) {
@@ -49,6 +51,10 @@ struct Results {
   *** SpeechSquadResponseMeta : End ***/
   std::string squad_question;
   std::string squad_answer;
+  std::string asr_transcription;
+  // Set by the server when it served the stream degraded
+  std::string degradation;
+  int output_sample_rate_hz;
 
   char *audio_content;
   size_t audio_offset;
@@ -82,6 +88,21 @@ public:
   std::mutex mtx_;
 };
 
+// The service exercised by an AudioTask. E2E streams to speech squad, the
+// others isolate a single Riva stage by calling its endpoint directly.
+enum class BenchmarkMode { E2E, ASR, NLP, TTS };
+
+bool ParseBenchmarkMode(const std::string &name, BenchmarkMode *mode);
+
+// Prepare functions for each of the calls an AudioTask can issue. Only the
+// one matching the task's BenchmarkMode is used.
+struct TaskPrepareFns {
+  Stream::PrepareFn squad;
+  ASRStream::PrepareFn asr;
+  NLPCall::PrepareFn nlp;
+  TTSCall::PrepareFn tts;
+};
+
 class AudioTask {
 public:
   // The step of processing that the AudioTask is in.
@@ -96,13 +117,17 @@ public:
   using TimePoint = std::chrono::time_point<std::chrono::high_resolution_clock>;
 
   AudioTask(const std::shared_ptr<AudioData> &audio_data,
-            const uint32_t _corr_id, const Stream::PrepareFn &infer_prepare_fn,
-            const std::string &language_code, const int32_t chunk_duration_ms,
-            const bool print_results,
+            const uint32_t _corr_id, const BenchmarkMode mode,
+            const TaskPrepareFns &prepare_fns,
+            const std::string &language_code,
+            const std::string &asr_model_name,
+            const int32_t chunk_duration_ms, const bool print_results,
+            const bool text_question, const std::string &stream_class,
             std::shared_ptr<SquadEvalDataset> &squad_eval_dataset,
             std::shared_ptr<OutputFilestreams> &output_filestream,
             std::shared_ptr<nvrpc::client::Executor> &executor,
-            const TimePoint &start_time);
+            const TimePoint &start_time,
+            const std::shared_ptr<CapturedStream> &captured = nullptr);
 
   TimePoint &NextTimePoint() { return next_time_point_; }
   State GetState() { return state_; }
@@ -115,24 +140,54 @@ public:
   Status WaitForCompletion();
 
 private:
+  Status SendCaptured();
+  Status SendConfig();
+  Status SendText();
+  bool WriteAudio(const char *data, size_t size);
+  bool CloseWrites();
+
   void ReceiveResponse(SpeechSquadInferResponse &&response);
+  void ReceiveASRResponse(asr_response_t &&response);
+  void ReceiveNLPResponse(nlp_response_t &&response);
+  void ReceiveTTSResponse(tts_response_t &&response);
+  // Must be called with result_->mtx held
+  void RecordAudio(const std::string &audio, const TimePoint &now);
+  void RecordLatency(const TimePoint &now);
+
   void FinalizeTask(const ::grpc::Status &status);
+  void FinalizeStageTask(const ::grpc::Status &status,
+                         const TrailingMetadata &metadata);
+  void PrintResults();
 
   std::string StateAsString();
 
   SpeechSquadInferRequest request_;
 
   std::shared_ptr<AudioData> audio_data_;
+  // Replays the requests of a captured stream instead of audio_data_
+  std::shared_ptr<CapturedStream> captured_;
+  size_t captured_index_;
+  TimePoint captured_start_;
   size_t offset_;
   uint32_t corr_id_;
+  BenchmarkMode mode_;
   std::string language_code_;
+  std::string asr_model_name_;
   int32_t chunk_duration_ms_;
   bool print_results_;
+  // Sends the question text in the config instead of streaming audio
+  bool text_question_;
+  // Scheduling class of the stream on the server
+  std::string stream_class_;
   std::shared_ptr<SquadEvalDataset> squad_eval_dataset_;
 
   std::shared_ptr<OutputFilestreams> output_filestreams_;
 
+  // Only the client matching mode_ is created
   std::unique_ptr<Stream> stream_;
+  std::unique_ptr<ASRStream> asr_stream_;
+  std::unique_ptr<NLPCall> nlp_call_;
+  std::unique_ptr<TTSCall> tts_call_;
   std::shared_ptr<nvrpc::client::Executor> executor_;
 
   Status task_status_;
@@ -146,11 +201,15 @@ private:
   double bytes_to_send_;
   // The total audio processed by this task in seconds
   double audio_processed_;
+  // The bytes of synthesized audio received
+  size_t audio_received_;
 
   // Holds the results of the transaction
   std::shared_ptr<Results> result_;
   // Current state of the task
   std::atomic<State> state_;
+  // Set once the completion callback has finished with the task
+  std::atomic<bool> complete_;
 };
 
 } // namespace speech_squad
@@ -30,7 +30,13 @@ DEFINE_string(squad_questions_json, "questions.json",
 DEFINE_string(squad_dataset_json, "dev-v2.0.json",
               "Json file with Squad dataset");
 DEFINE_string(speech_squad_uri, "localhost:50051",
-              "URI to access speech-squad-server");
+              "URI to access speech-squad-server, or the Riva endpoint of "
+              "the stage selected by --benchmark_mode");
+DEFINE_string(benchmark_mode, "e2e",
+              "Service to benchmark: e2e for the full speech squad pipeline, "
+              "or asr, nlp, tts to call that Riva stage directly");
+DEFINE_string(asr_model_name, "quartznet-asr-trt-ensemble-vad-streaming",
+              "Riva ASR model used by --benchmark_mode=asr");
 DEFINE_int32(num_iterations, 1, "Number of times to loop over audio files");
 DEFINE_int32(channel_num, -1, "Number of grpc channels to create");
 DEFINE_int32(
@@ -38,6 +44,17 @@ DEFINE_int32(
     "The minimum time offset in microseconds between the launch of successive "
     "sequences");
 DEFINE_bool(true_concurrency, true, "Enables the true concurrency mode ");
+DEFINE_bool(text_questions, false,
+            "Send the Squad question text instead of the audio, skipping ASR "
+            "on the server");
+DEFINE_string(stream_class, "",
+              "Scheduling class sent in the config of every stream, one of "
+              "the server's --stream_classes; empty uses the server default");
+DEFINE_string(
+    ingress_capture, "",
+    "Replay the streams captured by the server's --ingress_capture=<path> "
+    "with their recorded chunks and timing instead of the Squad questions; "
+    "e2e mode only");
 DEFINE_int32(num_parallel_requests, 1,
              "Number of parallel requests to keep in flight");
 DEFINE_int32(chunk_duration_ms, 800, "Chunk duration in milliseconds");
@@ -73,6 +90,8 @@ int main(int argc, char **argv) {
   str_usage << "           --squad_dataset_json=<location_of_squad_json> "
             << std::endl;
   str_usage << "           --speech_squad_uri=<server_name:port> " << std::endl;
+  str_usage << "           --benchmark_mode=<e2e|asr|nlp|tts> " << std::endl;
+  str_usage << "           --asr_model_name=<string> " << std::endl;
   str_usage << "           --chunk_duration_ms=<integer> " << std::endl;
   str_usage << "           --executor_count=<integer> " << std::endl;
   str_usage << "           --num_iterations=<integer> " << std::endl;
@@ -80,6 +99,9 @@ int main(int argc, char **argv) {
   str_usage << "           --num_parallel_requests=<integer> " << std::endl;
   str_usage << "           --channel_num=<integer> " << std::endl;
   str_usage << "           --true_concurrency=<true|false> " << std::endl;
+  str_usage << "           --text_questions=<true|false> " << std::endl;
+  str_usage << "           --stream_class=<string> " << std::endl;
+  str_usage << "           --ingress_capture=<capture path> " << std::endl;
   str_usage << "           --print_results=<true|false> " << std::endl;
   str_usage << "           --output_root_folder=<string>" << std::endl;
   str_usage << "           --answer_output_filename=<string>" << std::endl;
@@ -100,6 +122,21 @@ int main(int argc, char **argv) {
     return 1;
   }
 
+  speech_squad::BenchmarkMode benchmark_mode;
+  if (!speech_squad::ParseBenchmarkMode(FLAGS_benchmark_mode,
+                                        &benchmark_mode)) {
+    std::cerr << "Unknown --benchmark_mode " << FLAGS_benchmark_mode
+              << std::endl;
+    return 1;
+  }
+
+  if (!FLAGS_ingress_capture.empty() &&
+      (benchmark_mode != speech_squad::BenchmarkMode::E2E)) {
+    std::cerr << "--ingress_capture can only be replayed in e2e mode"
+              << std::endl;
+    return 1;
+  }
+
   int proc_index = 0;
   int proc_count = 0;
   MPI_CHECK(MPI_Init(&argc, &argv));
@@ -172,7 +209,9 @@ int main(int argc, char **argv) {
       FLAGS_print_results, FLAGS_chunk_duration_ms, FLAGS_executor_count,
       output_files, squad_eval_dataset, FLAGS_squad_questions_json,
       FLAGS_num_iterations, FLAGS_offset_duration, proc_index, proc_count,
-      FLAGS_true_concurrency);
+      FLAGS_true_concurrency, FLAGS_text_questions, FLAGS_stream_class,
+      benchmark_mode,
+      FLAGS_asr_model_name, FLAGS_ingress_capture);
 
   int ret = speech_squad_client.Run();
 
@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <map>
+
+#include <glog/logging.h>
+#include <nvrpc/client/client_single_up_multiple_down.h>
+#include <nvrpc/client/client_streaming_v3.h>
+#include <nvrpc/client/client_unary_v2.h>
+
+#include "riva_asr.grpc.pb.h"
+#include "riva_asr.pb.h"
+#include "riva_nlp.grpc.pb.h"
+#include "riva_nlp.pb.h"
+#include "riva_tts.grpc.pb.h"
+#include "riva_tts.pb.h"
+
+// Clients used by the stage isolation modes of the perf client. They call the
+// Riva ASR, NLP and TTS endpoints directly and mirror the shape of Stream: the
+// AudioTask owning the client supplies the receive and completion callbacks.
+
+namespace speech_squad {
+
+using asr_request_t = nvidia::riva::asr::StreamingRecognizeRequest;
+using asr_response_t = nvidia::riva::asr::StreamingRecognizeResponse;
+
+using nlp_request_t = nvidia::riva::nlp::NaturalQueryRequest;
+using nlp_response_t = nvidia::riva::nlp::NaturalQueryResponse;
+
+using tts_request_t = nvidia::riva::tts::SynthesizeSpeechRequest;
+using tts_response_t = nvidia::riva::tts::SynthesizeSpeechResponse;
+
+using TrailingMetadata = std::multimap<::grpc::string_ref, ::grpc::string_ref>;
+using StageCompleteFn = std::function<void(const ::grpc::Status &status,
+                                           const TrailingMetadata &metadata)>;
+
+class ASRStream
+    : public nvrpc::client::v3::ClientStreaming<asr_request_t, asr_response_t> {
+  using Client =
+      nvrpc::client::v3::ClientStreaming<asr_request_t, asr_response_t>;
+
+public:
+  using PrepareFn = typename Client::PrepareFn;
+  using ReceiveResponseFn = std::function<void(asr_response_t &&response)>;
+
+  ASRStream(PrepareFn prepare_fn,
+            std::shared_ptr<nvrpc::client::Executor> executor,
+            ReceiveResponseFn OnReceive, StageCompleteFn OnComplete)
+      : Client(prepare_fn, executor), OnReceive_(OnReceive),
+        OnComplete_(OnComplete) {}
+  ~ASRStream() override {}
+
+  void CallbackOnResponseReceived(asr_response_t &&response) override {
+    OnReceive_(std::move(response));
+  }
+
+  void CallbackOnComplete(const ::grpc::Status &status) override {
+    OnComplete_(status, GetClientContext().GetServerTrailingMetadata());
+  }
+
+private:
+  ReceiveResponseFn OnReceive_;
+  StageCompleteFn OnComplete_;
+};
+
+class NLPCall
+    : public nvrpc::client::v2::ClientUnary<nlp_request_t, nlp_response_t> {
+  using Client = nvrpc::client::v2::ClientUnary<nlp_request_t, nlp_response_t>;
+
+public:
+  using PrepareFn = typename Client::PrepareFn;
+  using ReceiveResponseFn = std::function<void(nlp_response_t &&response)>;
+
+  NLPCall(PrepareFn prepare_fn,
+          std::shared_ptr<nvrpc::client::Executor> executor,
+          ReceiveResponseFn OnReceive, StageCompleteFn OnComplete)
+      : Client(prepare_fn, executor), OnReceive_(OnReceive),
+        OnComplete_(OnComplete) {}
+  ~NLPCall() override {}
+
+  void CallbackOnResponseReceived(nlp_response_t &&response) override {
+    OnReceive_(std::move(response));
+  }
+
+  void CallbackOnComplete(const ::grpc::Status &status) override {
+    OnComplete_(status, GetClientContext().GetServerTrailingMetadata());
+  }
+
+private:
+  ReceiveResponseFn OnReceive_;
+  StageCompleteFn OnComplete_;
+};
+
+class TTSCall
+    : public nvrpc::client::ClientSingleUpMultipleDown<tts_request_t,
+                                                       tts_response_t> {
+  using Client =
+      nvrpc::client::ClientSingleUpMultipleDown<tts_request_t, tts_response_t>;
+
+public:
+  using PrepareFn = typename Client::PrepareFn;
+  using ReceiveResponseFn = std::function<void(tts_response_t &&response)>;
+
+  TTSCall(PrepareFn prepare_fn,
+          std::shared_ptr<nvrpc::client::Executor> executor,
+          ReceiveResponseFn OnReceive, StageCompleteFn OnComplete)
+      : Client(prepare_fn, executor), OnReceive_(OnReceive),
+        OnComplete_(OnComplete) {}
+  ~TTSCall() override {}
+
+  void CallbackOnResponseReceived(tts_response_t &&response) override {
+    OnReceive_(std::move(response));
+  }
+
+  void CallbackOnComplete(const ::grpc::Status &status) override {
+    OnComplete_(status, GetClientContext().GetServerTrailingMetadata());
+  }
+
+private:
+  ReceiveResponseFn OnReceive_;
+  StageCompleteFn OnComplete_;
+};
+
+} // namespace speech_squad
@@ -43,7 +43,9 @@ SpeechSquadClient::SpeechSquadClient(
     std::shared_ptr<speech_squad::SquadEvalDataset> &squad_eval_dataset,
     std::string &squad_questions_json, int32_t num_iteration,
     uint64_t offset_duration, int proc_index, int proc_count,
-    bool true_concurrency)
+    bool true_concurrency, bool text_questions,
+    const std::string &stream_class, BenchmarkMode mode,
+    const std::string &asr_model_name, const std::string &capture_path)
     : num_parallel_requests_(num_parallel_requests),
       print_results_(print_results), chunk_duration_ms_(chunk_duration_ms),
       squad_eval_dataset_(squad_eval_dataset),
@@ -51,10 +53,28 @@ SpeechSquadClient::SpeechSquadClient(
       num_iterations_(num_iterations), language_code_(language_code),
       offset_duration_(offset_duration), failed_tasks_count_(0),
       proc_index_(proc_index), proc_count_(proc_count), proc_error_(0),
-      true_concurrency_(true_concurrency) {
+      true_concurrency_(true_concurrency), text_questions_(text_questions),
+      stream_class_(stream_class), mode_(mode), asr_model_name_(asr_model_name),
+      capture_path_(capture_path) {
   stubs_.reserve(channels.size());
   for (const auto &channel : channels) {
-    stubs_.push_back(SpeechSquadService::NewStub(channel));
+    switch (mode_) {
+    case BenchmarkMode::E2E:
+      stubs_.push_back(SpeechSquadService::NewStub(channel));
+      break;
+    case BenchmarkMode::ASR:
+      asr_stubs_.push_back(
+          nvidia::riva::asr::RivaSpeechRecognition::NewStub(channel));
+      break;
+    case BenchmarkMode::NLP:
+      nlp_stubs_.push_back(
+          nvidia::riva::nlp::RivaLanguageUnderstanding::NewStub(channel));
+      break;
+    case BenchmarkMode::TTS:
+      tts_stubs_.push_back(
+          nvidia::riva::tts::RivaSpeechSynthesis::NewStub(channel));
+      break;
+    }
   }
 
   const auto processor_count = std::thread::hardware_concurrency();
@@ -102,9 +122,35 @@ SpeechSquadClient::~SpeechSquadClient() {
 int SpeechSquadClient::Run() {
   sending_complete_ = false;
   failed_tasks_count_ = 0;
+  completed_tasks_count_ = 0;
 
   std::vector<std::shared_ptr<AudioData>> all_wav;
-  LoadAudioData(all_wav, squad_questions_json_, "id", proc_index_, proc_count_);
+  std::vector<std::shared_ptr<CapturedStream>> all_captured;
+  if (capture_path_.empty()) {
+    LoadAudioData(all_wav, squad_questions_json_, "id", proc_index_,
+                  proc_count_);
+  } else {
+    std::vector<std::shared_ptr<CapturedStream>> captured;
+    auto status = LoadCapture(capture_path_, &captured);
+    if (!status.IsOk()) {
+      std::cerr << status.AsString() << std::endl;
+    }
+    // Captured streams are dealt round robin to the processes
+    for (size_t i = 0; i < captured.size(); i++) {
+      if ((int)(i % std::max(proc_count_, 1)) != proc_index_) {
+        continue;
+      }
+      const auto &config = captured[i]->requests[0].request.speech_squad_config();
+      auto audio_data = std::make_shared<AudioData>();
+      audio_data->filename = "capture:" + std::to_string(captured[i]->id);
+      audio_data->question_id = "capture-" + std::to_string(captured[i]->id);
+      audio_data->sample_rate = config.input_audio_config().sample_rate_hertz();
+      audio_data->channels = config.input_audio_config().audio_channel_count();
+      audio_data->encoding = config.input_audio_config().encoding();
+      all_wav.push_back(std::move(audio_data));
+      all_captured.push_back(captured[i]);
+    }
+  }
 
   if (all_wav.size() == 0) {
     if (proc_count_ > 0) {
@@ -151,9 +197,30 @@ int SpeechSquadClient::Run() {
 
   std::vector<std::shared_ptr<AudioData>> all_wav_repeated;
   all_wav_repeated.reserve(all_wav_max);
-  for (uint32_t file_id = 0; file_id < all_wav.size(); file_id++) {
+  // Captured streams keep their recorded start offsets; each iteration plays
+  // the whole capture again once the last stream of the previous one has
+  // closed its upload
+  std::vector<std::shared_ptr<CapturedStream>> all_captured_repeated;
+  std::vector<uint64_t> captured_start_us;
+  if (all_captured.empty()) {
+    for (uint32_t file_id = 0; file_id < all_wav.size(); file_id++) {
+      for (int iter = 0; iter < num_iterations_; iter++) {
+        all_wav_repeated.push_back(all_wav[file_id]);
+      }
+    }
+  } else {
+    uint64_t capture_duration_us = 0;
+    for (const auto &stream : all_captured) {
+      capture_duration_us = std::max(capture_duration_us,
+                                     stream->start_us + stream->close_us + 1);
+    }
     for (int iter = 0; iter < num_iterations_; iter++) {
-      all_wav_repeated.push_back(all_wav[file_id]);
+      for (uint32_t i = 0; i < all_captured.size(); i++) {
+        all_wav_repeated.push_back(all_wav[i]);
+        all_captured_repeated.push_back(all_captured[i]);
+        captured_start_us.push_back(iter * capture_duration_us +
+                                    all_captured[i]->start_us);
+      }
     }
   }
 
@@ -164,6 +231,30 @@ int SpeechSquadClient::Run() {
 
   MPI_CHECK(MPI_Barrier(MPI_COMM_WORLD));
 
+  TaskPrepareFns prepare_fns;
+  prepare_fns.squad = [this](::grpc::ClientContext * context,
+                             ::grpc::CompletionQueue * cq) -> auto {
+    auto stub = GetStub(stubs_);
+    return std::move(stub->PrepareAsyncSpeechSquadInfer(context, cq));
+  };
+  prepare_fns.asr = [this](::grpc::ClientContext * context,
+                           ::grpc::CompletionQueue * cq) -> auto {
+    auto stub = GetStub(asr_stubs_);
+    return std::move(stub->PrepareAsyncStreamingRecognize(context, cq));
+  };
+  prepare_fns.nlp = [this](::grpc::ClientContext * context,
+                           const nlp_request_t &request,
+                           ::grpc::CompletionQueue *cq) -> auto {
+    auto stub = GetStub(nlp_stubs_);
+    return std::move(stub->PrepareAsyncNaturalQuery(context, request, cq));
+  };
+  prepare_fns.tts = [this](::grpc::ClientContext * context,
+                           const tts_request_t &request,
+                           ::grpc::CompletionQueue *cq) -> auto {
+    auto stub = GetStub(tts_stubs_);
+    return std::move(stub->PrepareAsyncSynthesizeOnline(context, request, cq));
+  };
+
   uint32_t all_wav_i = 0;
   auto start_time = std::chrono::high_resolution_clock::now();
   while (true) {
@@ -174,15 +265,17 @@ int SpeechSquadClient::Run() {
       DVLOG(2) << "Adding a new task with id: " << all_wav_i;
       auto scheduled_time =
           now + std::chrono::microseconds((offset_index++) * offset_duration_);
-      auto prepare_fn = [this](::grpc::ClientContext * context,
-                               ::grpc::CompletionQueue * cq) -> auto {
-        auto stub = GetStub();
-        return std::move(stub->PrepareAsyncSpeechSquadInfer(context, cq));
-      };
+      std::shared_ptr<CapturedStream> captured;
+      if (!all_captured_repeated.empty()) {
+        captured = all_captured_repeated[all_wav_i];
+        scheduled_time =
+            start_time + std::chrono::microseconds(captured_start_us[all_wav_i]);
+      }
       std::unique_ptr<AudioTask> ptr(new AudioTask(
-          all_wav_repeated[all_wav_i], all_wav_i, prepare_fn, language_code_,
-          chunk_duration_ms_, print_results_, squad_eval_dataset_,
-          output_filestreams_, executor_, scheduled_time));
+          all_wav_repeated[all_wav_i], all_wav_i, mode_, prepare_fns,
+          language_code_, asr_model_name_, chunk_duration_ms_, print_results_,
+          text_questions_, stream_class_, squad_eval_dataset_,
+          output_filestreams_, executor_, scheduled_time, captured));
       curr_tasks.emplace_back(std::move(ptr));
       ++all_wav_i;
     }
@@ -280,6 +373,14 @@ int SpeechSquadClient::Run() {
                            MPI_INT, MPI_SUM, 0, MPI_COMM_WORLD));
     }
 
+    if (proc_index_ == 0) {
+      MPI_CHECK(MPI_Reduce(MPI_IN_PLACE, &completed_tasks_count_, 1,
+                           MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD));
+    } else {
+      MPI_CHECK(MPI_Reduce(&completed_tasks_count_, &completed_tasks_count_, 1,
+                           MPI_UNSIGNED_LONG, MPI_SUM, 0, MPI_COMM_WORLD));
+    }
+
     success_proc_count = (average_latency_ms_["Client Latency"] == 0) ? 0 : 1;
     if (proc_index_ == 0) {
       MPI_CHECK(MPI_Reduce(MPI_IN_PLACE, &success_proc_count, 1, MPI_INT,
@@ -304,6 +405,8 @@ int SpeechSquadClient::Run() {
               << std::endl;
     std::cout << "Throughput: " << total_audio_processed_ * 1000. / diff_time
               << " RTFX" << std::endl;
+    std::cout << "Request rate: " << completed_tasks_count_ * 1000. / diff_time
+              << " requests/sec" << std::endl;
     std::cout << "Number of failed audio clips: " << failed_tasks_count_
               << std::endl;
     std::cout << "Average Latencies ====> " << std::endl;
@@ -348,6 +451,7 @@ void SpeechSquadClient::ReaperFunction(
                << ", Status: " << task_status.AsString();
 
       if (!failed) {
+        completed_tasks_count_++;
         auto this_result = awaited_task->GetResult();
         // WAR to capture the results only for the audio tasks that
         // received audio content
@@ -363,7 +467,9 @@ void SpeechSquadClient::ReaperFunction(
   }
 }
 
-std::shared_ptr<SpeechSquadService::Stub> SpeechSquadClient::GetStub() {
+template <typename T>
+std::shared_ptr<T>
+SpeechSquadClient::GetStub(const std::vector<std::shared_ptr<T>> &stubs) {
   /*
   description of the load-balancer implementaion from enovy - N = 2
 
@@ -380,18 +486,18 @@ std::shared_ptr<SpeechSquadService::Stub> SpeechSquadClient::GetStub() {
   use_count as a proxy for number of active streams on a given channel
   */
 
-  if (stubs_.size() == 1) {
-    return stubs_[0];
+  if (stubs.size() == 1) {
+    return stubs[0];
   }
 
-  auto n = stubs_.size();
+  auto n = stubs.size();
   auto r1 = random_range(n);
   auto r2 = random_range(n);
 
-  if (stubs_[r1].use_count() < stubs_[r2].use_count()) {
-    return stubs_[r1];
+  if (stubs[r1].use_count() < stubs[r2].use_count()) {
+    return stubs[r1];
   }
-  return stubs_[r2];
+  return stubs[r2];
 }
 
 void SpeechSquadClient::PrintStats() {
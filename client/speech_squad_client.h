@@ -51,7 +51,9 @@ public:
       std::shared_ptr<speech_squad::SquadEvalDataset> &squad_eval_dataset,
       std::string &squad_questions_json, int32_t num_iteration,
       uint64_t offset_duration, int proc_index, int proc_count,
-      bool true_concurrency);
+      bool true_concurrency, bool text_questions,
+      const std::string &stream_class, BenchmarkMode mode,
+      const std::string &asr_model_name, const std::string &capture_path);
 
   ~SpeechSquadClient();
 
@@ -65,9 +67,17 @@ private:
   void PrintStats();
   void PrintLatencies(const std::vector<double> &raw_latencies,
                       const std::string &name);
-  std::shared_ptr<SpeechSquadService::Stub> GetStub();
+  template <typename T>
+  std::shared_ptr<T> GetStub(const std::vector<std::shared_ptr<T>> &stubs);
 
   std::vector<std::shared_ptr<SpeechSquadService::Stub>> stubs_;
+  // Riva stubs used by the stage isolation modes
+  std::vector<std::shared_ptr<nvidia::riva::asr::RivaSpeechRecognition::Stub>>
+      asr_stubs_;
+  std::vector<std::shared_ptr<nvidia::riva::nlp::RivaLanguageUnderstanding::Stub>>
+      nlp_stubs_;
+  std::vector<std::shared_ptr<nvidia::riva::tts::RivaSpeechSynthesis::Stub>>
+      tts_stubs_;
   int num_parallel_requests_;
   bool print_results_;
   double chunk_duration_ms_;
@@ -81,6 +91,12 @@ private:
   int proc_count_;
   int proc_error_;
   bool true_concurrency_;
+  bool text_questions_;
+  std::string stream_class_;
+  BenchmarkMode mode_;
+  std::string asr_model_name_;
+  // Replay the streams of a server ingress capture instead of the questions
+  std::string capture_path_;
 
   // std::vector<Stream::PrepareFn> infer_prepare_fns_;
   std::shared_ptr<nvrpc::client::Executor> executor_;
@@ -94,6 +110,7 @@ private:
 
   std::thread reaper_thread_;
   size_t failed_tasks_count_;
+  size_t completed_tasks_count_;
 };
 
 } // namespace speech_squad
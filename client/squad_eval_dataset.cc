@@ -74,10 +74,14 @@ Status SquadEvalDataset::LoadFromJson(const std::string &json_filepath) {
 
         const auto &answers_array = qa["answers"];
         assert(answers_array.IsArray()); // attributes is an array
+        answers_[question_id] = "";
         for (auto itr4 = answers_array.Begin(); itr4 != answers_array.End();
              ++itr4) {
           auto &answer = *itr4;
           assert(answer.IsObject()); // each attribute is an object
+          if (answers_[question_id].empty() && answer.HasMember("text")) {
+            answers_[question_id] = answer["text"].GetString();
+          }
         }
 
         // myfile << "{\"audio_filepath\":
@@ -121,4 +125,14 @@ Status SquadEvalDataset::GetQuestionContext(const std::string &id,
     return Status::Success;
   }
 }
+
+Status SquadEvalDataset::GetAnswer(const std::string &id,
+                                   std::string *answer) {
+  if (answers_.find(id) == answers_.end()) {
+    return Status(Status::Code::UNKNOWN, "Question id " + id + " not found");
+  } else {
+    *answer = answers_[id];
+    return Status::Success;
+  }
+}
 } // namespace speech_squad
@@ -32,9 +32,12 @@ public:
   Status LoadFromJson(const std::string &json_filepath);
   Status GetQuestion(const std::string &id, std::string *question);
   Status GetQuestionContext(const std::string &id, std::string *context);
+  // Returns the first reference answer; empty for unanswerable questions
+  Status GetAnswer(const std::string &id, std::string *answer);
 
 private:
   std::map<std::string, std::string> questions_;
+  std::map<std::string, std::string> answers_;
   std::vector<std::shared_ptr<std::string>> contexts_;
   std::map<std::string, std::shared_ptr<std::string>> question_contexts_;
 };
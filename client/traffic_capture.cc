@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "traffic_capture.h"
+
+#include <dirent.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+
+#include <glog/logging.h>
+
+namespace speech_squad {
+
+namespace {
+
+// Must match server/ingress_capture.h
+const char kCaptureMagic[8] = {'S', 'Q', 'C', 'A', 'P', '0', '0', '1'};
+enum RecordKind : uint8_t { REQUEST = 0, WRITES_DONE = 1, STREAM_DROPPED = 2 };
+
+template <typename T> T ReadInt(const char *data) {
+  uint64_t value = 0;
+  for (size_t i = 0; i < sizeof(T); i++) {
+    value |= (uint64_t)(unsigned char)data[i] << (8 * i);
+  }
+  return (T)value;
+}
+
+// The rotated files of the capture, oldest first
+std::vector<std::string> CaptureFiles(const std::string &path) {
+  auto slash = path.find_last_of('/');
+  std::string directory =
+      (slash == std::string::npos) ? "." : path.substr(0, slash);
+  std::string prefix =
+      ((slash == std::string::npos) ? path : path.substr(slash + 1)) + ".";
+
+  std::map<uint64_t, std::string> files;
+  DIR *dir = opendir(directory.c_str());
+  if (dir == nullptr) {
+    return {};
+  }
+  while (struct dirent *entry = readdir(dir)) {
+    std::string name(entry->d_name);
+    if ((name.size() <= prefix.size()) ||
+        (name.compare(0, prefix.size(), prefix) != 0)) {
+      continue;
+    }
+    auto index = name.substr(prefix.size());
+    if (std::all_of(index.begin(), index.end(), ::isdigit)) {
+      files[std::stoull(index)] = directory + "/" + name;
+    }
+  }
+  closedir(dir);
+
+  std::vector<std::string> ordered;
+  for (const auto &file : files) {
+    ordered.push_back(file.second);
+  }
+  return ordered;
+}
+
+struct PendingStream {
+  uint64_t start_ns;
+  uint64_t close_ns;
+  bool closed;
+  bool dropped;
+  std::vector<std::pair<uint64_t, SpeechSquadInferRequest>> requests;
+};
+
+} // namespace
+
+Status LoadCapture(const std::string &path,
+                   std::vector<std::shared_ptr<CapturedStream>> *streams) {
+  auto files = CaptureFiles(path);
+  if (files.empty()) {
+    return Status(Status::Code::NOT_FOUND,
+                  "No capture files found for " + path + ".<n>");
+  }
+
+  std::map<uint64_t, PendingStream> pending;
+  std::set<uint64_t> skipped;
+  for (const auto &file : files) {
+    std::ifstream in(file, std::ios::binary);
+    char magic[sizeof(kCaptureMagic)];
+    if (!in.read(magic, sizeof(magic)) ||
+        std::memcmp(magic, kCaptureMagic, sizeof(magic)) != 0) {
+      return Status(Status::Code::INVALID_ARG,
+                    file + " is not a speech squad capture file");
+    }
+
+    std::string record;
+    char length_bytes[4];
+    while (in.read(length_bytes, sizeof(length_bytes))) {
+      auto length = ReadInt<uint32_t>(length_bytes);
+      record.resize(length);
+      if ((length < 17) || !in.read(&record[0], length)) {
+        LOG(WARNING) << file << ": dropping truncated record";
+        break;
+      }
+      auto id = ReadInt<uint64_t>(&record[0]);
+      auto timestamp_ns = ReadInt<uint64_t>(&record[8]);
+      auto kind = (uint8_t)record[16];
+
+      if (skipped.count(id)) {
+        continue;
+      }
+      auto stream = pending.find(id);
+      if (kind == REQUEST) {
+        SpeechSquadInferRequest request;
+        if (!request.ParseFromArray(&record[17], length - 17)) {
+          return Status(Status::Code::INVALID_ARG,
+                        file + ": malformed request record");
+        }
+        if (stream == pending.end()) {
+          // The head of the stream is in a file that was rotated out
+          if (!request.has_speech_squad_config()) {
+            skipped.insert(id);
+            continue;
+          }
+          stream = pending.emplace(id, PendingStream{timestamp_ns, 0, false,
+                                                     false, {}})
+                       .first;
+        }
+        stream->second.requests.emplace_back(timestamp_ns, std::move(request));
+      } else if (stream == pending.end()) {
+        skipped.insert(id);
+      } else if (kind == WRITES_DONE) {
+        stream->second.closed = true;
+        stream->second.close_ns = timestamp_ns;
+      } else if (kind == STREAM_DROPPED) {
+        stream->second.dropped = true;
+      }
+    }
+  }
+
+  uint64_t first_ns = UINT64_MAX;
+  for (const auto &stream : pending) {
+    if (!stream.second.dropped) {
+      first_ns = std::min(first_ns, stream.second.start_ns);
+    }
+  }
+
+  size_t dropped = 0;
+  for (auto &entry : pending) {
+    auto &stream = entry.second;
+    if (stream.dropped) {
+      dropped++;
+      continue;
+    }
+    auto captured = std::make_shared<CapturedStream>();
+    captured->id = entry.first;
+    captured->start_us = (stream.start_ns - first_ns) / 1000;
+    for (auto &request : stream.requests) {
+      captured->requests.push_back(CapturedStream::Request{
+          (request.first - stream.start_ns) / 1000, std::move(request.second)});
+    }
+    captured->close_us = stream.closed
+                             ? (stream.close_ns - stream.start_ns) / 1000
+                             : captured->requests.back().offset_us;
+    streams->push_back(std::move(captured));
+  }
+
+  std::sort(streams->begin(), streams->end(),
+            [](const std::shared_ptr<CapturedStream> &a,
+               const std::shared_ptr<CapturedStream> &b) {
+              return a->start_us < b->start_us;
+            });
+
+  LOG(INFO) << "Loaded " << streams->size() << " captured streams from "
+            << files.size() << " files; skipped " << skipped.size()
+            << " partial and " << dropped << " dropped streams";
+  return Status::Success;
+}
+
+} // namespace speech_squad
@@ -0,0 +1,51 @@
+/*
+ * Copyright (c) 2020, NVIDIA CORPORATION.  All rights reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "speech_squad.pb.h"
+#include "status.h"
+
+namespace speech_squad {
+
+// A squad stream recorded by the server's --ingress_capture tap. Offsets are
+// in microseconds; start_us is relative to the first stream of the capture,
+// request offsets and close_us are relative to the stream start.
+struct CapturedStream {
+  struct Request {
+    uint64_t offset_us;
+    SpeechSquadInferRequest request;
+  };
+
+  uint64_t id;
+  uint64_t start_us;
+  std::vector<Request> requests;
+  uint64_t close_us;
+};
+
+// Loads the capture files <path>.<n> in order. Streams that started before the
+// oldest file, lost records to the server's writer, or never sent a config
+// are skipped. Streams still open when the capture ended are closed after
+// their last request.
+Status LoadCapture(const std::string &path,
+                   std::vector<std::shared_ptr<CapturedStream>> *streams);
+
+} // namespace speech_squad
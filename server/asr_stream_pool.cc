@@ -0,0 +1,149 @@
+#include "asr_stream_pool.h"
+
+#include <algorithm>
+#include <map>
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+ASRStreamPool::ASRStreamPool(Factory factory, Channels channels, std::size_t per_channel, std::chrono::milliseconds max_idle)
+: m_factory(factory), m_channels(channels), m_per_channel(per_channel), m_max_idle(max_idle), m_running(true), m_retiring(0)
+{
+    m_thread = std::thread([this] { Refill(); });
+}
+
+ASRStreamPool::~ASRStreamPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_running = false;
+    }
+    m_cv.notify_all();
+    m_thread.join();
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    auto idle = std::move(m_idle);
+    m_idle.clear();
+    lock.unlock();
+    for (auto& entry : idle)
+    {
+        entry.client->Cancel();
+        Retire(std::move(entry.client));
+    }
+
+    // cancelled calls complete as long as the client executor runs, which the resources keep
+    // alive until the pool is gone; every retired client is handed back by its completion callback
+    lock.lock();
+    while (!m_cv.wait_for(lock, std::chrono::seconds(1), [this] { return m_retiring == 0; }))
+    {
+        LOG(WARNING) << "waiting for " << m_retiring << " cancelled asr streams to complete";
+    }
+    m_released.clear();
+}
+
+std::unique_ptr<ASRClient> ASRStreamPool::Checkout(SpeechSquadContext* context)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_idle.empty())
+    {
+        auto entry = std::move(m_idle.front());
+        m_idle.pop_front();
+
+        if (entry.client->Attach(context))
+        {
+            lock.unlock();
+            m_cv.notify_one();
+            return std::move(entry.client);
+        }
+
+        // riva closed the call while it was pooled
+        lock.unlock();
+        Retire(std::move(entry.client));
+        lock.lock();
+    }
+    lock.unlock();
+    m_cv.notify_one();
+
+    VLOG(1) << "asr stream pool is empty; opening a new stream on demand";
+    return nullptr;
+}
+
+void ASRStreamPool::Refill()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running)
+    {
+        auto released = std::move(m_released);
+        m_released.clear();
+        lock.unlock();
+        released.clear();
+
+        auto channels = m_channels();
+        auto now      = clock_t::now();
+
+        // recycle stale calls and the calls of channels that left the service pool
+        std::vector<std::unique_ptr<ASRClient>> stale;
+        std::map<Stub*, std::size_t>            idle;
+        lock.lock();
+        for (auto it = m_idle.begin(); it != m_idle.end();)
+        {
+            bool current = std::find(channels.begin(), channels.end(), it->channel) != channels.end();
+            if (!current || it->client->IsComplete() || now - it->opened > m_max_idle)
+            {
+                stale.push_back(std::move(it->client));
+                it = m_idle.erase(it);
+                continue;
+            }
+            idle[it->channel.get()]++;
+            it++;
+        }
+        lock.unlock();
+
+        for (auto& client : stale)
+        {
+            client->Cancel();
+            Retire(std::move(client));
+        }
+
+        // top up every channel to per_channel pooled streams
+        for (const auto& channel : channels)
+        {
+            for (auto count = idle[channel.get()]; count < m_per_channel; count++)
+            {
+                auto client = m_factory(channel);
+                if (!client)
+                {
+                    break;
+                }
+                lock.lock();
+                m_idle.push_back(Entry{std::move(client), channel, clock_t::now()});
+                lock.unlock();
+            }
+        }
+
+        lock.lock();
+        if (m_running)
+        {
+            m_cv.wait_for(lock, std::chrono::milliseconds(100));
+        }
+    }
+}
+
+void ASRStreamPool::Retire(std::unique_ptr<ASRClient> client)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_retiring++;
+    }
+    ASRClient::ReleaseOnComplete(std::move(client), [this](std::unique_ptr<ASRClient> client) { Released(std::move(client)); });
+}
+
+// called from the completion callback as the last thing it does with the client
+void ASRStreamPool::Released(std::unique_ptr<ASRClient> client)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_released.push_back(std::move(client));
+    m_retiring--;
+    m_cv.notify_all();
+}
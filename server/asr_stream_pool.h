@@ -0,0 +1,70 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "clients.h"
+
+namespace demo
+{
+    // keeps StreamingRecognize calls open ahead of demand so the call setup is off the
+    // critical path of a new squad stream. pooled calls have no context attached and are
+    // waiting for their config message; they are recycled once they have been idle for
+    // longer than max_idle, since riva may drop streams that never send audio.
+    class ASRStreamPool
+    {
+    public:
+        using Stub = nvidia::riva::asr::RivaSpeechRecognition::Stub;
+
+        // opens a stream on the given channel; nullptr if the channel left its service pool
+        using Factory = std::function<std::unique_ptr<ASRClient>(const std::shared_ptr<Stub>&)>;
+
+        // the asr channels currently handing out streams
+        using Channels = std::function<std::vector<std::shared_ptr<Stub>>()>;
+
+        ASRStreamPool(Factory factory, Channels channels, std::size_t per_channel, std::chrono::milliseconds max_idle);
+        ~ASRStreamPool();
+
+        // returns nullptr when no pre-opened stream is available
+        std::unique_ptr<ASRClient> Checkout(SpeechSquadContext*);
+
+    private:
+        using clock_t = std::chrono::steady_clock;
+
+        struct Entry
+        {
+            std::unique_ptr<ASRClient> client;
+            std::shared_ptr<Stub>      channel;
+            clock_t::time_point        opened;
+        };
+
+        void Refill();
+
+        // hands the client to its own completion callback, which gives it back to Released
+        void Retire(std::unique_ptr<ASRClient>);
+        void Released(std::unique_ptr<ASRClient>);
+
+        Factory                   m_factory;
+        Channels                  m_channels;
+        std::size_t               m_per_channel;
+        std::chrono::milliseconds m_max_idle;
+
+        std::mutex              m_mutex;
+        std::condition_variable m_cv;
+        bool                    m_running;
+        std::deque<Entry>       m_idle;
+
+        // retired clients whose completion callback has not handed them back yet, and the clients
+        // handed back, which are destroyed by the refill thread
+        std::size_t                             m_retiring;
+        std::vector<std::unique_ptr<ASRClient>> m_released;
+
+        std::thread m_thread;
+    };
+
+} // namespace demo
@@ -0,0 +1,206 @@
+#include "autoscaling_executor.h"
+
+#include <algorithm>
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+struct AutoscalingExecutor::Queue
+{
+    std::unique_ptr<::grpc::ServerCompletionQueue> cq;
+
+    std::atomic<int> registered{0};
+    std::atomic<int> busy{0};
+    std::atomic<int> peak{0};
+
+    // owned by the progress thread of the queue once running; started holds the contexts counted in busy
+    std::unordered_map<nvrpc::IContext*, std::unique_ptr<nvrpc::IContext>> contexts;
+    std::unordered_set<nvrpc::IContext*>                                   started;
+    clock_type::time_point                                                  pressure; // idle headroom last ran low
+};
+
+thread_local AutoscalingExecutor::Queue* AutoscalingExecutor::current_queue = nullptr;
+
+AutoscalingExecutor::AutoscalingExecutor(int threads, const ContextScaling& scaling)
+: AutoscalingExecutor(std::make_unique<::trtlab::ThreadPool>(threads), scaling)
+{
+}
+
+AutoscalingExecutor::AutoscalingExecutor(std::unique_ptr<::trtlab::ThreadPool> threads, const ContextScaling& scaling)
+: m_scaling(scaling), m_per_thread(0), m_rpc(nullptr), m_running(false), m_threads(std::move(threads))
+{
+    CHECK_GT(m_scaling.step, 0);
+}
+
+AutoscalingExecutor::~AutoscalingExecutor() = default;
+
+void AutoscalingExecutor::Initialize(::grpc::ServerBuilder& builder)
+{
+    for (std::size_t i = 0; i < m_threads->Size(); i++)
+    {
+        m_queues.emplace_back(std::make_unique<Queue>());
+        m_queues.back()->cq = builder.AddCompletionQueue();
+    }
+}
+
+void AutoscalingExecutor::RegisterContexts(nvrpc::IRPC* rpc, std::shared_ptr<nvrpc::Resources> resources, int per_thread)
+{
+    CHECK(m_rpc == nullptr) << "the autoscaling executor serves a single rpc";
+    CHECK_EQ(m_queues.size(), m_threads->Size()) << "executor not initialized";
+    m_rpc        = rpc;
+    m_resources  = resources;
+    m_per_thread = per_thread;
+
+    for (auto& queue : m_queues)
+    {
+        for (int i = 0; i < per_thread; i++)
+        {
+            auto context = CreateContext(m_rpc, queue->cq.get(), m_resources);
+            auto raw     = context.get();
+            queue->contexts.emplace(raw, std::move(context));
+        }
+        queue->registered = per_thread;
+    }
+    LOG_IF(INFO, m_scaling.max_per_thread > per_thread)
+        << "contexts per queue scale from " << per_thread << " to " << m_scaling.max_per_thread << " in steps of "
+        << m_scaling.step;
+}
+
+void AutoscalingExecutor::Run()
+{
+    m_running = true;
+    for (auto& queue : m_queues)
+    {
+        queue->pressure = clock_type::now();
+        for (auto& context : queue->contexts)
+        {
+            ResetContext(context.second.get());
+        }
+    }
+    for (std::size_t i = 0; i < m_queues.size(); i++)
+    {
+        m_threads->enqueue([this, i] { ProgressEngine(i); });
+    }
+}
+
+void AutoscalingExecutor::Shutdown()
+{
+    m_running = false;
+    for (auto& queue : m_queues)
+    {
+        queue->cq->Shutdown();
+    }
+}
+
+std::vector<ContextQueueStats> AutoscalingExecutor::stats()
+{
+    std::vector<ContextQueueStats> stats;
+    for (auto& queue : m_queues)
+    {
+        int busy = queue->busy;
+        stats.push_back(ContextQueueStats{queue->registered, busy, std::max(busy, queue->peak.exchange(busy))});
+    }
+    return stats;
+}
+
+ContextLoad AutoscalingExecutor::load() const
+{
+    ContextLoad load{0, 0, 0};
+    for (const auto& queue : m_queues)
+    {
+        load.busy += queue->busy;
+        load.registered += queue->registered;
+        load.capacity += std::max(m_per_thread, m_scaling.max_per_thread);
+    }
+    return load;
+}
+
+void AutoscalingExecutor::StreamStarted(nvrpc::IContext* context)
+{
+    auto queue = current_queue;
+    if (queue == nullptr || !queue->started.insert(context).second)
+    {
+        return;
+    }
+    int busy = ++queue->busy;
+    int peak = queue->peak;
+    while (busy > peak && !queue->peak.compare_exchange_weak(peak, busy))
+    {
+    }
+}
+
+void AutoscalingExecutor::ProgressEngine(int index)
+{
+    auto& queue   = *m_queues[index];
+    current_queue = &queue;
+
+    void* tag;
+    bool  ok;
+    while (queue.cq->Next(&tag, &ok))
+    {
+        auto context = nvrpc::IContext::Detag(tag);
+        if (!RunContext(context, ok) && m_running)
+        {
+            // the lifecycle completed; the stream it served, if it started one, is over
+            if (queue.started.erase(context))
+            {
+                queue.busy--;
+            }
+            if (!Retire(queue, context))
+            {
+                ResetContext(context);
+            }
+        }
+        if (m_running)
+        {
+            Scale(queue);
+        }
+    }
+    current_queue = nullptr;
+}
+
+void AutoscalingExecutor::Scale(Queue& queue)
+{
+    auto now = clock_type::now();
+    if (queue.registered - queue.busy <= m_scaling.step)
+    {
+        queue.pressure = now;
+        if (queue.registered < m_scaling.max_per_thread)
+        {
+            Grow(queue, std::min(m_scaling.step, m_scaling.max_per_thread - queue.registered));
+        }
+    }
+}
+
+void AutoscalingExecutor::Grow(Queue& queue, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        auto context = CreateContext(m_rpc, queue.cq.get(), m_resources);
+        auto raw     = context.get();
+        queue.contexts.emplace(raw, std::move(context));
+        ResetContext(raw);
+    }
+    queue.registered += count;
+    VLOG(1) << "queue " << &queue << ": grew to " << queue.registered << " contexts; " << queue.busy << " busy";
+}
+
+bool AutoscalingExecutor::Retire(Queue& queue, nvrpc::IContext* context)
+{
+    if (queue.registered <= m_per_thread || queue.registered - queue.busy <= 2 * m_scaling.step ||
+        clock_type::now() - queue.pressure < m_scaling.cooldown)
+    {
+        return false;
+    }
+    auto it = queue.contexts.find(context);
+    if (it == queue.contexts.end())
+    {
+        return false;
+    }
+    // RunContext returned false: the lifecycle has no grpc operation outstanding and is not re-armed
+    queue.contexts.erase(it);
+    queue.registered--;
+    VLOG(1) << "queue " << &queue << ": retired a context; " << queue.registered << " registered";
+    return true;
+}
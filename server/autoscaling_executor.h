@@ -0,0 +1,88 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include <nvrpc/executor.h>
+#include <trtlab/core/thread_pool.h>
+
+namespace demo
+{
+    struct ContextScaling
+    {
+        int                       max_per_thread; // hard cap; at or below the registered count the contexts are fixed
+        int                       step;           // contexts added at a time; also the idle headroom kept per queue
+        std::chrono::milliseconds cooldown;       // time without pressure before extras retire
+    };
+
+    // utilization of one completion queue
+    struct ContextQueueStats
+    {
+        int registered; // contexts waiting for or serving a stream
+        int busy;       // streams in flight
+        int peak;       // most streams in flight since the previous stats() call
+    };
+
+    // utilization of all the completion queues of an executor
+    struct ContextLoad
+    {
+        int busy;       // streams in flight
+        int registered; // contexts waiting for or serving a stream
+        int capacity;   // contexts the queues may grow to
+    };
+
+    // an executor like nvrpc::Executor, one completion queue per thread, whose contexts grow with the load.
+    // when a stream leaves fewer than step idle contexts on a queue, step more are registered on it, up to
+    // max_per_thread. a registered context waits in a grpc request that cannot be withdrawn, so extras are
+    // retired as their stream finishes instead: once a queue saw no pressure for a cool-down, a context
+    // above the registered count whose lifecycle completed is destroyed rather than re-armed. nothing of
+    // the lifecycle is outstanding then; the context's destructor releases what OnContextReset would.
+    class AutoscalingExecutor : public nvrpc::IExecutor
+    {
+    public:
+        AutoscalingExecutor(int threads, const ContextScaling&);
+        AutoscalingExecutor(std::unique_ptr<::trtlab::ThreadPool>, const ContextScaling&);
+        ~AutoscalingExecutor() override;
+
+        void Initialize(::grpc::ServerBuilder&) final override;
+        void RegisterContexts(nvrpc::IRPC*, std::shared_ptr<nvrpc::Resources>, int per_thread) final override;
+        void Run() final override;
+        void Shutdown() final override;
+
+        // one entry per completion queue
+        std::vector<ContextQueueStats> stats();
+
+        // summed over the queues; unlike stats() the peaks are left alone
+        ContextLoad load() const;
+
+        // called by a context from StreamInitialized; the stream counts against the queue of the calling
+        // progress thread until the lifecycle of that context completes, once per stream
+        static void StreamStarted(nvrpc::IContext*);
+
+    private:
+        using clock_type = std::chrono::steady_clock;
+        struct Queue;
+
+        void ProgressEngine(int index);
+        void Scale(Queue&);
+        void Grow(Queue&, int count);
+        bool Retire(Queue&, nvrpc::IContext*);
+
+        // the queue served by the calling progress thread
+        static thread_local Queue* current_queue;
+
+        ContextScaling                      m_scaling;
+        int                                 m_per_thread;
+        nvrpc::IRPC*                        m_rpc;
+        std::shared_ptr<nvrpc::Resources>   m_resources;
+        std::atomic<bool>                   m_running;
+        std::vector<std::unique_ptr<Queue>> m_queues;
+
+        // last, so the progress threads are joined before the queues go away
+        std::unique_ptr<::trtlab::ThreadPool> m_threads;
+    };
+
+} // namespace demo
@@ -1,44 +1,153 @@
 
 #include "clients.h"
 #include "context.h"
+#include "event_trace.h"
 
 using namespace demo;
 
+void ASRClient::CallbackOnRequestSent(asr_request_t &&request)
+{
+    SpeechSquadContext *context;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        context = m_context;
+    }
+    if (context == nullptr)
+    {
+        return;
+    }
+    auto bytes = request.audio_content().size();
+    context->Dispatch([context, bytes] { context->ASRRequestSent(bytes); });
+}
+
 void ASRClient::CallbackOnResponseReceived(asr_response_t &&response)
 {
-    DCHECK_NOTNULL(m_context);
-    m_context->ASRCallbackOnResponse(std::move(response));
+    SpeechSquadContext *context;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        context = m_context;
+    }
+    if (context == nullptr)
+    {
+        // riva answered a pooled stream that no squad stream has taken yet
+        VLOG(1) << this << ": dropping a response on a pre-opened asr stream";
+        return;
+    }
+    EventTrace::Record(TraceEvent::AsrResponse, context->trace_stream());
+    context->Dispatch([context, response = std::move(response)]() mutable { context->ASRCallbackOnResponse(std::move(response)); });
 }
 
 void ASRClient::CallbackOnComplete(const ::grpc::Status &status)
 {
-    DCHECK_NOTNULL(m_context);
-    auto meta_data = GetClientContext().GetServerTrailingMetadata();
-    m_context->ASRCallbackOnFinish(status, meta_data);
+    SpeechSquadContext        *context;
+    std::unique_ptr<ASRClient> self;
+    Release                    release;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_complete = true;
+        context = m_context;
+        m_in_flight.done();
+        self    = std::move(m_self);
+        release = std::move(m_release);
+    }
+    if (context == nullptr)
+    {
+        VLOG(1) << this << ": pre-opened asr stream completed before use; " << status.error_message();
+        if (self)
+        {
+            // the client may be destroyed from here on
+            release(std::move(self));
+        }
+        return;
+    }
+    context->Dispatch([this, context, status] { context->ASRCallbackOnFinish(status, GetClientContext().GetServerTrailingMetadata()); });
+}
+
+bool ASRClient::Attach(SpeechSquadContext *context)
+{
+    CHECK_NOTNULL(context);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_complete)
+    {
+        return false;
+    }
+    m_context = context;
+    return true;
+}
+
+bool ASRClient::IsComplete()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_complete;
+}
+
+void ASRClient::ReleaseOnComplete(std::unique_ptr<ASRClient> client, Release release)
+{
+    auto                         raw = client.get();
+    std::unique_lock<std::mutex> lock(raw->m_mutex);
+    if (!raw->m_complete)
+    {
+        raw->m_self    = std::move(client);
+        raw->m_release = std::move(release);
+        return;
+    }
+    lock.unlock();
+    release(std::move(client));
 }
 
 void NLPClient::CallbackOnResponseReceived(nlp_response_t &&response)
 {
     DCHECK_NOTNULL(m_context);
-    m_context->NLPCallbackOnResponse(std::move(response));
+    auto context = m_context;
+    auto window  = m_window;
+    EventTrace::Record(TraceEvent::NlpResponse, context->trace_stream(), window);
+    context->Dispatch([context, window, response = std::move(response)] { context->NLPCallbackOnResponse(window, response); });
 }
 
 void NLPClient::CallbackOnComplete(const ::grpc::Status &status)
 {
     DCHECK_NOTNULL(m_context);
-    auto meta_data = GetClientContext().GetServerTrailingMetadata();
-    m_context->NLPCallbackOnComplete(status, meta_data);
+    m_in_flight.done();
+    auto context = m_context;
+    auto window  = m_window;
+    context->Dispatch([this, context, window, status] {
+        context->NLPCallbackOnComplete(window, status, GetClientContext().GetServerTrailingMetadata());
+    });
+}
+
+void TextClient::CallbackOnResponseReceived(text_response_t &&response)
+{
+    DCHECK_NOTNULL(m_context);
+    auto context = m_context;
+    auto stage   = m_stage;
+    EventTrace::Record(TraceEvent::TextResponse, context->trace_stream(), stage);
+    context->Dispatch([context, stage, response = std::move(response)] { context->TextCallbackOnResponse(stage, response); });
+}
+
+void TextClient::CallbackOnComplete(const ::grpc::Status &status)
+{
+    DCHECK_NOTNULL(m_context);
+    m_in_flight.done();
+    auto context = m_context;
+    auto stage   = m_stage;
+    context->Dispatch([this, context, stage, status] {
+        context->TextCallbackOnComplete(stage, status, GetClientContext().GetServerTrailingMetadata());
+    });
 }
 
 void TTSClient::CallbackOnResponseReceived(tts_response_t &&response)
 {
     DCHECK_NOTNULL(m_context);
-    m_context->TTSCallbackOnResponse(std::move(response));
+    auto context = m_context;
+    EventTrace::Record(TraceEvent::TtsResponse, context->trace_stream(), response.audio().size());
+    context->TTSResponseQueued(response.audio().size());
+    context->Dispatch([context, response = std::move(response)]() mutable { context->TTSCallbackOnResponse(std::move(response)); });
 }
 
 void TTSClient::CallbackOnComplete(const ::grpc::Status &status)
 {
     DCHECK_NOTNULL(m_context);
-    auto meta_data = GetClientContext().GetServerTrailingMetadata();
-    m_context->TTSCallbackOnComplete(status, meta_data);
+    m_in_flight.done();
+    auto context = m_context;
+    context->Dispatch([this, context, status] { context->TTSCallbackOnComplete(status, GetClientContext().GetServerTrailingMetadata()); });
 }
\ No newline at end of file
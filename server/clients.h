@@ -1,6 +1,9 @@
 
 
 #pragma once
+#include <functional>
+#include <memory>
+#include <mutex>
 
 #include <glog/logging.h>
 
@@ -10,6 +13,7 @@
 #include <nvrpc/client/client_single_up_multiple_down.h>
 
 #include "settings.h"
+#include "stub_pool.h"
 
 namespace demo
 {
@@ -22,17 +26,35 @@ namespace demo
     public:
         using PrepareFn = typename Client::PrepareFn;
 
-        ASRClient(SpeechSquadContext* context, PrepareFn prepare_fn, std::shared_ptr<nvrpc::client::Executor> executor)
-        : Client(prepare_fn, executor), m_context(context)
+        // context may be null for a pre-opened stream; it must be attached before the config is written.
+        // in_flight is the count of the call on its channel, released when the call completes
+        ASRClient(SpeechSquadContext* context, InFlightCall in_flight, PrepareFn prepare_fn, std::shared_ptr<nvrpc::client::Executor> executor)
+        : Client(prepare_fn, executor), m_context(context), m_complete(false), m_in_flight(std::move(in_flight))
         {
-            CHECK_NOTNULL(m_context);
         }
 
+        // returns false if the stream completed while it was waiting to be attached
+        bool Attach(SpeechSquadContext* context);
+        bool IsComplete();
+
+        // for unattached streams: the client owns itself until its call completes, then the completion
+        // callback passes it to release as the last thing it does; release runs inline if the call
+        // has already completed
+        using Release = std::function<void(std::unique_ptr<ASRClient>)>;
+        static void ReleaseOnComplete(std::unique_ptr<ASRClient> client, Release release);
+
+        void CallbackOnRequestSent(asr_request_t&& request) final override;
         void CallbackOnResponseReceived(asr_response_t&& response) final override;
         void CallbackOnComplete(const ::grpc::Status& status) final override;
 
     private:
+        std::mutex          m_mutex;
         SpeechSquadContext* m_context;
+        bool                m_complete;
+        InFlightCall        m_in_flight;
+
+        std::unique_ptr<ASRClient> m_self;
+        Release                    m_release;
     };
 
     class NLPClient final : public nvrpc::client::v2::ClientUnary<nlp_request_t, nlp_response_t>
@@ -42,8 +64,10 @@ namespace demo
     public:
         using PrepareFn = typename Client::PrepareFn;
 
-        NLPClient(SpeechSquadContext* context, PrepareFn prepare_fn, std::shared_ptr<nvrpc::client::Executor> executor)
-        : Client(prepare_fn, executor), m_context(context)
+        // window is the index of the squad context window the query is issued against
+        NLPClient(SpeechSquadContext* context, int window, InFlightCall in_flight, PrepareFn prepare_fn,
+                  std::shared_ptr<nvrpc::client::Executor> executor)
+        : Client(prepare_fn, executor), m_context(context), m_window(window), m_in_flight(std::move(in_flight))
         {
             CHECK_NOTNULL(m_context);
         }
@@ -53,6 +77,32 @@ namespace demo
     
     private:
         SpeechSquadContext* m_context;
+        int                 m_window;
+        InFlightCall        m_in_flight;
+    };
+
+    // PunctuateText / TransformText call of one stage of the stage graph
+    class TextClient final : public nvrpc::client::v2::ClientUnary<text_request_t, text_response_t>
+    {
+        using Client = nvrpc::client::v2::ClientUnary<text_request_t, text_response_t>;
+
+    public:
+        using PrepareFn = typename Client::PrepareFn;
+
+        TextClient(SpeechSquadContext* context, int stage, InFlightCall in_flight, PrepareFn prepare_fn,
+                   std::shared_ptr<nvrpc::client::Executor> executor)
+        : Client(prepare_fn, executor), m_context(context), m_stage(stage), m_in_flight(std::move(in_flight))
+        {
+            CHECK_NOTNULL(m_context);
+        }
+
+        void CallbackOnResponseReceived(text_response_t&&) final override;
+        void CallbackOnComplete(const ::grpc::Status&) final override;
+
+    private:
+        SpeechSquadContext* m_context;
+        int                 m_stage;
+        InFlightCall        m_in_flight;
     };
 
     class TTSClient final : public nvrpc::client::ClientSingleUpMultipleDown<tts_request_t, tts_response_t>
@@ -62,8 +112,8 @@ namespace demo
     public:
         using PrepareFn = typename Client::PrepareFn;
 
-        TTSClient(SpeechSquadContext* context, PrepareFn prepare_fn, std::shared_ptr<nvrpc::client::Executor> executor)
-        : Client(prepare_fn, executor), m_context(context)
+        TTSClient(SpeechSquadContext* context, InFlightCall in_flight, PrepareFn prepare_fn, std::shared_ptr<nvrpc::client::Executor> executor)
+        : Client(prepare_fn, executor), m_context(context), m_in_flight(std::move(in_flight))
         {
             CHECK_NOTNULL(m_context);
         }
@@ -73,6 +123,7 @@ namespace demo
 
     private:
         SpeechSquadContext* m_context;
+        InFlightCall        m_in_flight;
     };
 
 } // namespace demo
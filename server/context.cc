@@ -1,5 +1,10 @@
 
 #include "context.h"
+#include "autoscaling_executor.h"
+#include "event_trace.h"
+
+#include <algorithm>
+#include <sstream>
 
 #include <glog/logging.h>
 
@@ -8,6 +13,83 @@ using Output = SpeechSquadInferResponse;
 
 using namespace demo;
 
+// creates a riva client unless the stream is being torn down; created clients are pending until
+// their completion callback reports back through CallCompleted
+template <typename Client, typename Create>
+bool SpeechSquadContext::StartCall(std::unique_ptr<Client> &client, Create create)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_should_cancel)
+        {
+            client = create();
+            m_pending++;
+            return true;
+        }
+    }
+    CompleteIfIdle();
+    return false;
+}
+
+// issues a riva nlp, text stage or tts call once the dispatch scheduler admits it. the wait for a
+// slot counts as a pending call so the stream is not torn down under it, and is withdrawn when the
+// stream is cancelled; issue returns false when it did not start the call, which returns the slot
+// at once
+void SpeechSquadContext::ScheduleCall(const std::string& stage, std::function<bool()> issue)
+{
+    auto& scheduler = GetResources()->dispatch_scheduler();
+    auto  call      = scheduler.NewCall();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_should_cancel)
+        {
+            return;
+        }
+        m_pending++;
+        m_waiting.emplace(call, stage);
+    }
+    auto queued = std::chrono::high_resolution_clock::now();
+    GetResources()->stage_calls().Queued(stage);
+    scheduler.Acquire(m_class, call, [this, call, stage, issue, queued] {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_waiting.erase(call);
+        }
+        GetResources()->stage_calls().Dequeued(stage);
+        Dispatch([this, stage, issue, queued] {
+            auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - queued).count();
+            GetResources()->dispatch_scheduler().RecordWait(m_class, (float)us / 1000.);
+            GetResources()->stage_calls().Started(stage);
+            if (!issue())
+            {
+                ReleaseCall(stage);
+            }
+            CallCompleted(false);
+        });
+    });
+
+    // a cancellation between the check above and Acquire() found nothing to withdraw
+    int withdrawn = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_should_cancel)
+        {
+            withdrawn = WithdrawCalls();
+        }
+    }
+    if (withdrawn > 0)
+    {
+        CompleteIfIdle();
+    }
+}
+
+// returns the dispatch slot of a call issued by ScheduleCall once it completes
+void SpeechSquadContext::ReleaseCall(const std::string& stage)
+{
+    GetResources()->stage_calls().Finished(stage);
+    GetResources()->dispatch_scheduler().Release();
+}
+
 void SpeechSquadContext::StreamInitialized(std::shared_ptr<ServerStream> stream)
 {
     DCHECK(m_state == State::Uninitialized);
@@ -17,57 +99,178 @@ void SpeechSquadContext::StreamInitialized(std::shared_ptr<ServerStream> stream)
     // we must block stream from completing
     BlockFinish();
 
-    // asr client
-    m_asr_client = GetResources()->create_asr_client(this);
-
     // set stream
     m_stream = stream;
 
-    // set initial state
-    m_first_tts_response = true;
+    // counts the stream against the completion queue for context autoscaling
+    AutoscalingExecutor::StreamStarted(this);
+    m_trace_stream = EventTrace::NewStream();
+    EventTrace::Record(TraceEvent::StreamStart, m_trace_stream);
+
+    // requests are captured as they arrive, before they are queued for the stage logic
+    auto capture = GetResources()->ingress_capture();
+    m_capturing  = capture != nullptr;
+    m_capture_id = capture ? capture->NewStream() : 0;
+
+    // events for this stream are handed to the fiber workers from here on
+    m_strand.open(GetResources()->fiber_workers());
+
+    m_memory.Open(&GetResources()->memory_budget(), GetResources()->stream_memory_limit());
+    m_asr_outstanding = 0;
+    m_asr_close_held  = false;
 
+    m_class        = GetResources()->dispatch_scheduler().find("");
+    m_degradation  = Degradation::None;
+    m_stream_start      = std::chrono::high_resolution_clock::now();
+    m_stream_start_wall = std::chrono::system_clock::now();
+    m_trace             = TraceContext();
+
+    // set initial state
+    m_text_clients.resize(GetResources()->stage_graph().stages().size());
+    m_pending       = 0;
+    m_tts_complete  = false;
+    m_finished      = false;
     m_should_cancel = false;
+    m_rejected.clear();
 }
 
 void SpeechSquadContext::OnContextReset()
 {
     VLOG(1) << this << ": reseting context";
+    m_strand.close();
     m_state = State::Uninitialized;
-    m_asr_client.reset();
-    m_nlp_client.reset();
-    m_tts_client.reset();
-    m_timings.clear();
+    m_asr_held.clear();
+    m_memory.Close();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_asr_client.reset();
+        m_nlp_clients.clear();
+        m_tts_client.reset();
+        m_text_clients.clear();
+        m_timings.clear();
+        m_stage_start.clear();
+        m_stage_latency.clear();
+    }
     m_stream = nullptr;
-    m_first_tts_response = true;
     m_should_cancel = false;
     m_debug_tts = false;
 }
 
 void SpeechSquadContext::RequestReceived(Input &&input, std::shared_ptr<ServerStream> stream)
+{
+    if (m_capturing)
+    {
+        m_capturing = GetResources()->ingress_capture()->Capture(m_capture_id, input);
+    }
+    Dispatch([this, input = std::move(input), stream]() mutable { ProcessRequest(std::move(input), stream); });
+}
+
+void SpeechSquadContext::RequestsFinished(std::shared_ptr<ServerStream> stream)
+{
+    if (m_capturing)
+    {
+        m_capturing = GetResources()->ingress_capture()->CaptureWritesDone(m_capture_id);
+    }
+    Dispatch([this] { ProcessRequestsFinished(); });
+}
+
+void SpeechSquadContext::ProcessRequest(Input &&input, std::shared_ptr<ServerStream> stream)
 {
     DCHECK_NOTNULL(stream);
 
+    if (m_should_cancel)
+    {
+        // the stream is being torn down; drop anything still arriving
+        return;
+    }
+
     if (input.has_speech_squad_config())
     {
         if (m_state != State::Initialized)
         {
             LOG(ERROR) << "squad stream received a request with an unexpected message - expected a config";
-            m_should_cancel = true;
-            m_asr_client->Cancel();
+            ProtocolError();
             return;
         }
-        m_state = State::ReceivingAudio;
 
         // save the server stream to the context so the tts callback handler can
         // forwards tts frames back the client
         DCHECK_NOTNULL(stream);
         m_stream = stream;
 
-        VLOG(1) << "speech squad stream initialized";
+        // continue the caller's trace, or start one; every riva call of the stream carries it
+        m_trace = TraceContext::Continue(input.speech_squad_config().trace_id());
+
+        VLOG(1) << "speech squad stream initialized; trace " << m_trace.trace_id;
+        EventTrace::Record(TraceEvent::Config, m_trace_stream);
+
+        // under the server memory cap no new stream is taken on
+        if (GetResources()->memory_budget().Exhausted())
+        {
+            LOG(WARNING) << this << ": server memory cap of " << GetResources()->memory_budget().cap() << " bytes reached; rejecting squad stream";
+            Reject(rejected_memory);
+            return;
+        }
+
+        // under overload the stream is served degraded, or not at all
+        if (auto degradation = GetResources()->degradation())
+        {
+            m_degradation = degradation->tier();
+            if (m_degradation >= Degradation::Reject)
+            {
+                LOG(WARNING) << this << ": server overloaded; rejecting squad stream";
+                Reject(rejected_overloaded);
+                return;
+            }
+        }
+
+        // interactive streams get ahead of batch streams for the riva calls once they are saturated
+        m_class = GetResources()->dispatch_scheduler().find(input.speech_squad_config().stream_class());
 
         // extract the context from the initial request
         m_context = input.speech_squad_config().squad_context();
 
+        // or the candidates the context is retrieved from once the question is known
+        m_document_id = input.speech_squad_config().squad_document_id();
+        m_paragraphs.assign(input.speech_squad_config().squad_paragraphs().begin(), input.speech_squad_config().squad_paragraphs().end());
+        auto context_bytes = m_context.size();
+        for (const auto &paragraph : m_paragraphs)
+        {
+            context_bytes += paragraph.size();
+        }
+        if (!m_memory.Add(StreamMemory::Context, context_bytes))
+        {
+            MemoryExceeded("squad context");
+            return;
+        }
+        if (!m_document_id.empty() && m_paragraphs.empty() && !GetResources()->has_document(m_document_id))
+        {
+            LOG(ERROR) << "squad stream requested unknown document " << m_document_id;
+            ProtocolError();
+            return;
+        }
+
+        // save tts config for when we issue the tts request
+        m_tts_config = input.speech_squad_config().output_audio_config();
+
+        // text questions bypass asr and go straight to the text stages
+        if (!input.speech_squad_config().squad_question().empty())
+        {
+            m_state = State::TextQuestion;
+            VLOG(1) << this << ": text question received; skipping riva asr";
+            SetText("transcript", input.speech_squad_config().squad_question());
+            return;
+        }
+        m_state = State::ReceivingAudio;
+
+        // asr client
+        if (!StartCall(m_asr_client, [this] { return GetResources()->create_asr_client(this); }))
+        {
+            // the client went away before the stream was configured
+            return;
+        }
+        GetResources()->stage_calls().Started("asr");
+
         // initialize the riva async asr stream with the input audio config
         DCHECK(input.speech_squad_config().input_audio_config().encoding() == AudioEncoding::LINEAR_PCM);
 
@@ -90,9 +293,6 @@ void SpeechSquadContext::RequestReceived(Input &&input, std::shared_ptr<ServerSt
         DVLOG(2) << "channels   : " << input.speech_squad_config().input_audio_config().audio_channel_count();
         DVLOG(2) << "language   : " << input.speech_squad_config().input_audio_config().language_code();
 
-        // save tts config for when we issue the tts request
-        m_tts_config = input.speech_squad_config().output_audio_config();
-
         // write/send the initial request to riva asr
         VLOG(1) << this << ": initiating riva asr";
         m_asr_client->Write(std::move(request));
@@ -103,38 +303,120 @@ void SpeechSquadContext::RequestReceived(Input &&input, std::shared_ptr<ServerSt
         if (m_state != State::ReceivingAudio)
         {
             LOG(ERROR) << "squad stream received an unexpected request without a configuration message";
-            m_should_cancel = true;
-            m_asr_client->Cancel();
+            ProtocolError();
             return;
         }
 
         VLOG(2) << this << ": forwaring audio to riva asr; bytes=" << input.audio_content().size();
+        EventTrace::Record(TraceEvent::AudioIn, m_trace_stream, input.audio_content().size());
         asr_request_t request;
         request.set_audio_content(input.audio_content());
-        m_asr_client->Write(std::move(request));
+        WriteAudio(std::move(request));
     }
 }
 
-void SpeechSquadContext::RequestsFinished(std::shared_ptr<ServerStream> stream)
+// writes audio to riva asr while less than the asr queue limit is outstanding on the stream and holds
+// it back otherwise, so a slow riva asr bounds what the grpc write queue buffers
+void SpeechSquadContext::WriteAudio(asr_request_t &&request)
+{
+    auto bytes = request.audio_content().size();
+    if (!m_memory.Add(StreamMemory::Audio, bytes))
+    {
+        MemoryExceeded("asr audio");
+        return;
+    }
+    auto limit = GetResources()->asr_queue_limit();
+    if (limit && m_asr_outstanding > 0 && (!m_asr_held.empty() || m_asr_outstanding + bytes > limit))
+    {
+        VLOG(2) << this << ": riva asr has " << m_asr_outstanding << " bytes outstanding; holding back " << bytes;
+        EventTrace::Record(TraceEvent::AsrHeld, m_trace_stream, bytes);
+        m_asr_held.push_back(std::move(request));
+        return;
+    }
+    m_asr_outstanding += bytes;
+    m_asr_client->Write(std::move(request));
+}
+
+void SpeechSquadContext::ASRRequestSent(std::size_t bytes)
+{
+    EventTrace::Record(TraceEvent::AsrSent, m_trace_stream, bytes);
+    m_memory.Remove(StreamMemory::Audio, bytes);
+    m_asr_outstanding -= bytes;
+    if (m_should_cancel)
+    {
+        return;
+    }
+
+    auto limit = GetResources()->asr_queue_limit();
+    while (!m_asr_held.empty() && (m_asr_outstanding == 0 || m_asr_outstanding + m_asr_held.front().audio_content().size() <= limit))
+    {
+        m_asr_outstanding += m_asr_held.front().audio_content().size();
+        m_asr_client->Write(std::move(m_asr_held.front()));
+        m_asr_held.pop_front();
+    }
+    if (m_asr_held.empty() && m_asr_close_held)
+    {
+        m_asr_close_held = false;
+        m_asr_client->CloseWrites();
+    }
+}
+
+void SpeechSquadContext::TTSResponseQueued(std::size_t bytes)
 {
+    if (!m_memory.Add(StreamMemory::Responses, bytes))
+    {
+        Dispatch([this] { MemoryExceeded("tts audio"); });
+    }
+}
+
+void SpeechSquadContext::MemoryExceeded(const char *what)
+{
+    LOG(WARNING) << this << ": " << what << " exceeded the memory limit; context " << m_memory.bytes(StreamMemory::Context)
+                 << ", audio " << m_memory.bytes(StreamMemory::Audio) << ", responses " << m_memory.bytes(StreamMemory::Responses)
+                 << " bytes; server " << GetResources()->memory_budget().used() << " bytes. rejecting squad stream";
+    Reject(rejected_memory);
+}
+
+void SpeechSquadContext::ProcessRequestsFinished()
+{
+    if (m_should_cancel)
+    {
+        return;
+    }
+    if (m_state == State::TextQuestion)
+    {
+        // nothing to close; the text stages were issued when the config arrived
+        VLOG(1) << this << ": speech squad client closed text question upload";
+        return;
+    }
     if (m_state != State::ReceivingAudio)
     {
         LOG(ERROR) << "received WritesDone from client before put into State::ReceivingAudio";
-        m_should_cancel = true;
-        m_asr_client->Cancel();
+        ProtocolError();
         return;
     }
     m_state = State::AudioUploadComplete;
+    EventTrace::Record(TraceEvent::WritesDone, m_trace_stream);
 
     VLOG(1) << this << ": speech squad client closed asr upload stream; closing riva asr upload";
 
-    // close upload to riva asr stream
-    m_asr_writes_done = std::chrono::high_resolution_clock::now();
+    // close upload to riva asr stream, after any audio still held back
+    StageStarted("asr");
+    if (!m_asr_held.empty())
+    {
+        m_asr_close_held = true;
+        return;
+    }
     m_asr_client->CloseWrites();
 }
 
 void SpeechSquadContext::ASRCallbackOnResponse(asr_response_t &&response)
 {
+    if (m_should_cancel)
+    {
+        return;
+    }
+
     if (response.results_size() == 0)
     {
         DVLOG(2) << "no results received";
@@ -148,20 +430,25 @@ void SpeechSquadContext::ASRCallbackOnResponse(asr_response_t &&response)
         return;
     }
 
-    m_asr_on_complete = std::chrono::high_resolution_clock::now();
-
     if (result.alternatives_size() == 0)
     {
+        StageFinished("asr");
         LOG(ERROR) << "resutls final, but no transcript";
         m_asr_client->Cancel();
         return;
     }
     const auto &top_candidate = result.alternatives(0);
 
-    m_question = top_candidate.transcript() + "?";
+    m_transcript = top_candidate.transcript() + "?";
+
+    // the squad client gets the transcript now rather than with the answer
+    SpeechSquadInferResponse transcript_event;
+    transcript_event.mutable_metadata()->set_asr_transcription(top_candidate.transcript());
+    transcript_event.mutable_metadata()->set_asr_confidence(std::to_string(top_candidate.confidence()));
+    StageFinished("asr", std::move(transcript_event));
 
     VLOG(1) << this << ": riva asr result " << std::endl
-            << "q: " << m_question << "; confidence=" << top_candidate.confidence();
+            << "q: " << m_transcript << "; confidence=" << top_candidate.confidence();
 }
 
 void SpeechSquadContext::ASRCallbackOnFinish(const ::grpc::Status &status, const meta_data_t &meta_data)
@@ -170,65 +457,285 @@ void SpeechSquadContext::ASRCallbackOnFinish(const ::grpc::Status &status, const
     if (!status.ok())
     {
         LOG(ERROR) << "asr error detected - issuing cancellation on squad stream";
-        DCHECK_NOTNULL(m_stream);
-        // there are no client cq events registers
-        // we can now unblock and cancel the server stream
-        if (!m_stream->IsConnected())
+    }
+    else if (!m_should_cancel)
+    {
+        VLOG(1) << this << ": transcript = " << m_transcript;
+        ExtractTimings(meta_data);
+        SetText("transcript", m_transcript);
+    }
+    GetResources()->stage_calls().Finished("asr");
+    CallCompleted(!status.ok());
+}
+
+void SpeechSquadContext::SetText(const std::string &name, const std::string &text)
+{
+    const auto &graph = GetResources()->stage_graph();
+    VLOG(2) << this << ": " << name << " = " << text;
+
+    for (auto stage : graph.consumers(name))
+    {
+        IssueTextRequest(stage, text);
+    }
+    if (name == graph.question_source())
+    {
+        m_question = text;
+        IssueNLPRequest();
+    }
+    if (name == graph.speech_source())
+    {
+        IssueTTSRequest(text);
+    }
+}
+
+void SpeechSquadContext::IssueTextRequest(int stage, const std::string &text)
+{
+    const auto &config = GetResources()->stage_graph().stages()[stage];
+
+    text_request_t request;
+    request.add_text(text);
+    request.set_top_n(1);
+    if (!config.model.empty())
+    {
+        request.mutable_model()->set_model_name(config.model);
+    }
+
+    ScheduleCall(config.name, [this, stage, name = config.name, request]() mutable {
+        VLOG(1) << this << ": issuing " << name << " request";
+        if (!StartCall(m_text_clients[stage], [this, stage] { return GetResources()->create_text_client(this, stage); }))
         {
-            LOG(ERROR) << "SHOWSTOPPER: stream callback are disconnected from the server context";
+            return false;
         }
-        m_stream->UnblockFinish();
-        m_stream->CancelStream();
-        return;
-    }
 
-    VLOG(1) << this << ": question = " << m_question;
+        StageStarted(name);
+        m_text_clients[stage]->Write(std::move(request));
+        return true;
+    });
+}
 
-    ExtractTimings(meta_data);
+void SpeechSquadContext::TextCallbackOnResponse(int stage, const text_response_t &response)
+{
+    if (m_should_cancel)
+    {
+        return;
+    }
 
-    nlp_request_t request;
-    request.set_context(m_context);
-    request.set_query(m_question);
+    const auto &config = GetResources()->stage_graph().stages()[stage];
+    StageFinished(config.name);
 
-    VLOG(1) << this << ": issuing nlp request";
-    VLOG(3) << this << ": context = " << m_context;
+    if (response.text_size() == 0)
+    {
+        LOG(ERROR) << config.name << " did not return any text";
+        CancelDownstream();
+        return;
+    }
 
-    // nlp client
-    m_nlp_client = GetResources()->create_nlp_client(this);
+    VLOG(1) << this << ": " << config.name << " complete";
+    SetText(config.output, response.text(0));
+}
 
-    m_nlp_start = std::chrono::high_resolution_clock::now();
-    m_nlp_client->Write(std::move(request));
+void SpeechSquadContext::TextCallbackOnComplete(int stage, const ::grpc::Status &status, const meta_data_t &meta_data)
+{
+    VLOG(1) << this << ": " << GetResources()->stage_graph().stages()[stage].name << " completed with status "
+            << (status.ok() ? "OK" : "CANCELLED");
+    if (!status.ok())
+    {
+        LOG(ERROR) << "text stage error detected - issuing cancellation on squad stream";
+    }
+    else
+    {
+        ExtractTimings(meta_data);
+    }
+    ReleaseCall(GetResources()->stage_graph().stages()[stage].name);
+    CallCompleted(!status.ok());
 }
 
-void SpeechSquadContext::NLPCallbackOnResponse(const nlp_response_t &response)
+void SpeechSquadContext::IssueNLPRequest()
 {
-    if (response.results_size() == 0)
+    if (m_document_id.empty() && m_paragraphs.empty())
     {
-        LOG(ERROR) << "nlp did not return any results";
-        if (!m_stream->IsConnected())
+        IssueNLPWindows({m_context});
+        return;
+    }
+
+    // retrieve the best matching paragraphs when the client did not send the context. bm25 runs off
+    // the strand and counts as a pending call, so the stream is not torn down under it
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_should_cancel)
         {
-            LOG(ERROR) << "SHOWSTOPPER: stream callback are disconnected from the server context";
+            return;
         }
-        m_stream->UnblockFinish();
-        m_stream->CancelStream();
+        m_pending++;
+    }
+    StageStarted("retrieval");
+    GetResources()->retrieve_contexts_async(m_question, m_document_id, m_paragraphs, [this](std::vector<std::string> contexts) {
+        Dispatch([this, contexts = std::move(contexts)] {
+            if (!m_should_cancel)
+            {
+                StageFinished("retrieval");
+                VLOG(1) << this << ": retrieved " << contexts.size() << " candidate paragraph(s)";
+                IssueNLPWindows(contexts);
+            }
+            CallCompleted(false);
+        });
+    });
+}
+
+void SpeechSquadContext::IssueNLPWindows(const std::vector<std::string> &contexts)
+{
+    // long contexts are queried as overlapping windows, all in flight at once
+    std::vector<std::string> windows;
+    for (const auto &context : contexts)
+    {
+        auto split = GetResources()->nlp_windows(context);
+        windows.insert(windows.end(), split.begin(), split.end());
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_nlp_clients.resize(windows.size());
+        m_nlp_window_done.assign(windows.size(), false);
+        m_nlp_remaining  = windows.size();
+        m_nlp_has_result = false;
+        m_nlp_decided    = windows.empty(); // no paragraph shares a term with the question
+        m_answer         = "";
+        m_nlp_score      = 0;
+    }
+
+    VLOG(1) << this << ": issuing nlp request over " << windows.size() << " context window(s)";
+    VLOG(3) << this << ": context = " << m_context;
+
+    StageStarted("nlp");
+    if (windows.empty())
+    {
+        VLOG(1) << this << ": no context matched the question";
+        AnswerSelected();
         return;
     }
+    for (int i = 0; i < (int)windows.size(); i++)
+    {
+        nlp_request_t request;
+        request.set_context(windows[i]);
+        request.set_query(m_question);
+
+        ScheduleCall("nlp", [this, i, request]() mutable {
+            {
+                // an earlier window may have answered while this one waited for a slot
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (m_nlp_decided)
+                {
+                    return false;
+                }
+            }
+
+            // nlp client
+            if (!StartCall(m_nlp_clients[i], [this, i, &request] { return GetResources()->create_nlp_client(this, i, request.context()); }))
+            {
+                VLOG(1) << this << ": squad stream cancelled before nlp was issued";
+                return false;
+            }
+            m_nlp_clients[i]->Write(std::move(request));
+            return true;
+        });
+    }
+}
 
-    m_nlp_finish = std::chrono::high_resolution_clock::now();
+void SpeechSquadContext::NLPCallbackOnResponse(int window, const nlp_response_t &response)
+{
+    if (m_should_cancel)
+    {
+        // the stream is being torn down; cancelled on completion
+        return;
+    }
 
     VLOG(3) << response.DebugString();
+    NLPWindowFinished(window, &response);
+}
 
-    const auto &top_result = response.results(0);
-    if (top_result.answer().size())
+void SpeechSquadContext::NLPCallbackOnComplete(int window, const ::grpc::Status &status, const meta_data_t &meta_data)
+{
+    VLOG(1) << this << ": nlp stream completed with status " << (status.ok() ? "OK" : "CANCELLED");
+    if (status.ok())
     {
-        m_answer = top_result.answer();
-        m_nlp_score = top_result.score();
+        ExtractTimings(meta_data);
     }
-    else
+    else if (!m_should_cancel)
     {
-        m_answer = "";
-        m_nlp_score = 0;
+        // a failed window has no answer; the stream fails only if no window answers
+        NLPWindowFinished(window, nullptr);
     }
+    ReleaseCall("nlp");
+    CallCompleted(false);
+}
+
+// keeps the best answer over the context windows; the answer is selected once every window has
+// finished or a window scores at least the accept score, in which case the stragglers are cancelled
+void SpeechSquadContext::NLPWindowFinished(int window, const nlp_response_t *response)
+{
+    bool selected = false, answered = false;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_nlp_decided || m_nlp_window_done[window])
+        {
+            return;
+        }
+        m_nlp_window_done[window] = true;
+        m_nlp_remaining--;
+
+        if (response && response->results_size())
+        {
+            m_nlp_has_result = true;
+
+            const auto &top_result = response->results(0);
+            if (top_result.answer().size() && (m_answer.empty() || top_result.score() > m_nlp_score))
+            {
+                m_answer    = top_result.answer();
+                m_nlp_score = top_result.score();
+            }
+
+            auto accept_score = GetResources()->nlp_accept_score();
+            if (accept_score > 0 && top_result.answer().size() && top_result.score() >= accept_score)
+            {
+                VLOG(1) << this << ": window " << window << " answered with score " << top_result.score()
+                        << "; cancelling " << m_nlp_remaining << " remaining window(s)";
+                for (int i = 0; i < (int)m_nlp_clients.size(); i++)
+                {
+                    if (!m_nlp_window_done[i] && m_nlp_clients[i])
+                    {
+                        m_nlp_clients[i]->GetClientContext().TryCancel();
+                    }
+                }
+                selected = true;
+            }
+        }
+
+        if (m_nlp_remaining == 0)
+        {
+            selected = true;
+        }
+        if (selected)
+        {
+            m_nlp_decided = true;
+            answered      = m_nlp_has_result;
+        }
+    }
+
+    if (!selected)
+    {
+        return;
+    }
+    if (!answered)
+    {
+        LOG(ERROR) << "nlp did not return any results";
+        CancelDownstream();
+        return;
+    }
+    AnswerSelected();
+}
+
+void SpeechSquadContext::AnswerSelected()
+{
+    StageFinished("nlp");
 
     VLOG(1) << this << ": nlp complete." << std::endl
             << "q: " << m_question << std::endl
@@ -239,50 +746,77 @@ void SpeechSquadContext::NLPCallbackOnResponse(const nlp_response_t &response)
     auto infer_metadata = squad_response.mutable_metadata();
     infer_metadata->set_squad_question(m_question);
     infer_metadata->set_squad_answer(m_answer);
+    infer_metadata->set_squad_confidence(m_nlp_score);
+    infer_metadata->set_trace_id(m_trace.trace_id);
+    infer_metadata->set_output_sample_rate_hz(TTSSampleRate());
+    if (m_degradation != Degradation::None)
+    {
+        infer_metadata->set_degradation(Degradation::name(m_degradation));
+    }
     m_stream->WriteResponse(std::move(squad_response));
 
-    // tts client
-    m_tts_client = GetResources()->create_tts_client(this);
-
-    // setup the tts request
-    tts_request_t request;
-    request.set_text((m_answer.size() ? m_answer : "No answer"));
-    request.set_encoding(nvidia::riva::AudioEncoding::LINEAR_PCM);
-    request.set_sample_rate_hz(22050);
-    request.set_language_code(m_tts_config.language_code());
-    request.set_voice_name("ljspeech");
-    VLOG(1) << this << ": sending tts request";
+    SetText("answer", m_answer);
+}
 
-    m_first_tts_response = true;
-    m_tts_start = std::chrono::high_resolution_clock::now();
-    m_tts_client->Write(std::move(request));
+int SpeechSquadContext::TTSSampleRate()
+{
+    return m_degradation >= Degradation::LowTtsRate ? GetResources()->degradation()->tts_sample_rate() : tts_sample_rate_hz;
 }
 
-void SpeechSquadContext::NLPCallbackOnComplete(const ::grpc::Status &status, const meta_data_t &meta_data)
+void SpeechSquadContext::IssueTTSRequest(const std::string &text)
 {
-    VLOG(1) << this << ": nlp stream completed with status " << (status.ok() ? "OK" : "CANCELLED");
-    if (!status.ok())
+    if (m_degradation >= Degradation::TextOnly)
     {
-        LOG(ERROR) << "nlp error detected - issuing cancellation on squad stream";
-        DCHECK_NOTNULL(m_stream);
-        if (!m_stream->IsConnected())
+        // the answer went out with the metadata; the stream finishes without audio
+        VLOG(1) << this << ": degraded to text only; skipping riva tts";
         {
-            LOG(ERROR) << "SHOWSTOPPER: stream callback are disconnected from the server context";
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_tts_complete = true;
         }
-        m_stream->UnblockFinish();
-        m_stream->CancelStream();
+        CompleteIfIdle();
         return;
     }
-    ExtractTimings(meta_data);
+
+    // shorter answers synthesize faster; cut at the last word that fits
+    auto answer = text.size() ? text : "No answer";
+    if (m_degradation >= Degradation::CappedTtsText && (int)answer.size() > GetResources()->degradation()->tts_max_chars())
+    {
+        auto cut = answer.find_last_of(' ', GetResources()->degradation()->tts_max_chars());
+        answer.resize(cut == std::string::npos ? GetResources()->degradation()->tts_max_chars() : cut);
+    }
+
+    // setup the tts request
+    tts_request_t request;
+    request.set_text(answer);
+    request.set_encoding(nvidia::riva::AudioEncoding::LINEAR_PCM);
+    request.set_sample_rate_hz(TTSSampleRate());
+    request.set_language_code(m_tts_config.language_code());
+    request.set_voice_name(tts_voice_name);
+
+    ScheduleCall("tts", [this, request]() mutable {
+        // tts client
+        if (!StartCall(m_tts_client, [this] { return GetResources()->create_tts_client(this); }))
+        {
+            return false;
+        }
+
+        VLOG(1) << this << ": sending tts request";
+        StageStarted("tts");
+        m_tts_client->Write(std::move(request));
+        return true;
+    });
 }
 
 void SpeechSquadContext::TTSCallbackOnResponse(tts_response_t &&tts_response)
 {
-    if (m_first_tts_response)
+    m_memory.Remove(StreamMemory::Responses, tts_response.audio().size());
+    if (m_should_cancel)
+    {
+        return;
+    }
+    if (StageFinished("tts"))
     {
         VLOG(1) << this << ": relaying first tts response";
-        m_tts_first_packet = std::chrono::high_resolution_clock::now();
-        m_first_tts_response = false;
     }
     if (!tts_response.audio().size())
     {
@@ -305,51 +839,380 @@ void SpeechSquadContext::TTSCallbackOnComplete(const ::grpc::Status &status, con
         LOG(WARNING) << this << ": tts stream completed with status " << (status.ok() ? "OK" : "CANCELLED");
     }
 
+    if (!status.ok())
+    {
+        LOG(ERROR) << "tts error detected - issuing cancellation on squad stream";
+    }
+    else
+    {
+        // get tts meta data
+        ExtractTimings(meta_data);
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tts_complete = true;
+    }
+    ReleaseCall("tts");
+    CallCompleted(!status.ok());
+}
+
+void SpeechSquadContext::FinishSquadStream()
+{
+    // send component timings
+    SpeechSquadInferResponse response;
+
+    response.mutable_metadata()->set_trace_id(m_trace.trace_id);
+    if (m_degradation != Degradation::None)
+    {
+        response.mutable_metadata()->set_degradation(Degradation::name(m_degradation));
+    }
+
+    // riva latencies extracted from trailing meta data
+    auto        timings = response.mutable_metadata()->mutable_component_timing();
+    std::string breach;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_timings.cbegin(); it != m_timings.cend(); it++)
+        {
+            (*timings)[it->first] = it->second;
+        }
+
+        // speech squad measured latencies of every stage that ran
+        for (const auto &stage : m_stage_latency)
+        {
+            (*timings)["tracing.speech_squad." + stage.first + "_latency"] = stage.second;
+        }
+
+        // recent latencies for the load reports
+        auto e2e_ms = ResponseLatency();
+        auto recent = m_stage_latency;
+        recent.emplace("e2e", e2e_ms);
+        GetResources()->stage_latencies().Record(recent);
+
+        // how far the stream and its stages ran over their latency budgets
+        breach = CheckLatencyBudgets(e2e_ms, timings);
+    }
+    LOG_IF(WARNING, !breach.empty()) << this << ": " << breach;
+
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - m_stream_start).count();
+    GetResources()->dispatch_scheduler().RecordStream(m_class, (float)us / 1000.);
+    ExportSpans(false);
+
     // if we got here, all async clients have finished
     if (!m_stream->IsConnected())
     {
         LOG(ERROR) << "SHOWSTOPPER: stream callback are disconnected from the server context";
     }
+    EventTrace::Record(TraceEvent::Finish, m_trace_stream);
     m_stream->UnblockFinish();
+    m_stream->WriteResponse(std::move(response));
+    m_stream->FinishStream();
+}
 
-    if (!status.ok())
+void SpeechSquadContext::StreamCancelled(std::shared_ptr<ServerStream> stream)
+{
+    VLOG(1) << this << ": speech squad client cancelled the stream; cancelling riva clients";
+    CancelDownstream();
+}
+
+void SpeechSquadContext::ProtocolError()
+{
+    CancelDownstream();
+}
+
+// tears the stream down like a cancellation, but finishes it with the status of the reason, see
+// stream_rejection.h
+void SpeechSquadContext::Reject(const char *reason)
+{
     {
-        LOG(ERROR) << "tts error detected - issuing cancellation on squad stream";
-        DCHECK_NOTNULL(m_stream);
-        m_stream->CancelStream();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_should_cancel)
+        {
+            m_rejected = reason;
+        }
+    }
+    CancelDownstream();
+}
+
+void SpeechSquadContext::CallCompleted(bool failed)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending--;
+        if (failed && !m_should_cancel.exchange(true))
+        {
+            CancelCalls();
+        }
+    }
+    CompleteIfIdle();
+}
+
+// cancels every riva call in flight; their completion callbacks observe m_should_cancel and the
+// last one tears down the squad stream. with no call in flight the stream is torn down here.
+void SpeechSquadContext::CancelDownstream()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_should_cancel.exchange(true))
+        {
+            return;
+        }
+        CancelCalls();
+    }
+    CompleteIfIdle();
+}
+
+// requires m_mutex; drops the calls still waiting for a dispatch slot, which no longer count as
+// pending, and returns how many
+int SpeechSquadContext::WithdrawCalls()
+{
+    int withdrawn = 0;
+    for (auto waiting = m_waiting.begin(); waiting != m_waiting.end();)
+    {
+        if (!GetResources()->dispatch_scheduler().Withdraw(m_class, waiting->first))
+        {
+            // granted already; its task sees m_should_cancel and returns the slot
+            ++waiting;
+            continue;
+        }
+        GetResources()->stage_calls().Dequeued(waiting->second);
+        m_pending--;
+        withdrawn++;
+        waiting = m_waiting.erase(waiting);
+    }
+    return withdrawn;
+}
+
+// requires m_mutex; cancelling a completed call is a no-op, calls waiting for a slot are withdrawn
+void SpeechSquadContext::CancelCalls()
+{
+    WithdrawCalls();
+    if (m_asr_client)
+    {
+        m_asr_client->Cancel();
+    }
+    for (auto &client : m_nlp_clients)
+    {
+        if (client)
+        {
+            client->GetClientContext().TryCancel();
+        }
+    }
+    for (auto &client : m_text_clients)
+    {
+        if (client)
+        {
+            client->GetClientContext().TryCancel();
+        }
+    }
+    if (m_tts_client)
+    {
+        m_tts_client->GetClientContext().TryCancel();
+    }
+}
+
+// finishes or cancels the squad stream once no riva call is outstanding
+void SpeechSquadContext::CompleteIfIdle()
+{
+    bool        cancel;
+    std::string rejected;
+    std::string breach;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_pending > 0 || m_finished || !(m_should_cancel || m_tts_complete))
+        {
+            return;
+        }
+        m_finished = true;
+        cancel     = m_should_cancel;
+        rejected   = m_rejected;
+
+        // a cancelled stream counts against the budgets with the time it ran, once its stages started;
+        // before that the client was still uploading and the e2e latency had not begun
+        if (cancel && !m_stage_start.empty())
+        {
+            breach = CheckLatencyBudgets(ResponseLatency(), nullptr);
+        }
+    }
+
+    if (!cancel)
+    {
+        FinishSquadStream();
         return;
     }
+    LOG_IF(WARNING, !breach.empty()) << this << ": " << breach;
 
-    // get tts meta data
-    ExtractTimings(meta_data);
+    DCHECK_NOTNULL(m_stream);
+    if (!m_stream->IsConnected())
+    {
+        LOG(ERROR) << "SHOWSTOPPER: stream callback are disconnected from the server context";
+    }
+    ExportSpans(true);
+    EventTrace::Record(TraceEvent::Cancel, m_trace_stream);
+    m_stream->UnblockFinish();
+    if (!rejected.empty())
+    {
+        // the reason rides on the last response; the rejection interceptor sets the status from it
+        SpeechSquadInferResponse response;
+        response.mutable_metadata()->set_trace_id(m_trace.trace_id);
+        response.mutable_metadata()->set_rejected(rejected);
+        m_stream->WriteResponse(std::move(response));
+        m_stream->FinishStream();
+        return;
+    }
+    m_stream->CancelStream();
+}
 
-    // send component timings
-    SpeechSquadInferResponse response;
+void SpeechSquadContext::StageStarted(const std::string &stage)
+{
+    EventTrace::Record(TraceEvent::StageStart, m_trace_stream, stage);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stage_start[stage] = std::chrono::high_resolution_clock::now();
+}
 
-    // riva latencies extracted from trailing meta data
-    auto timings = response.mutable_metadata()->mutable_component_timing();
-    for (auto it = m_timings.cbegin(); it != m_timings.cend(); it++)
+// records the latency of the stage on its first call and streams its completion to the squad client,
+// with event as the rest of the message; returns false on later calls
+bool SpeechSquadContext::StageFinished(const std::string &stage, SpeechSquadInferResponse &&event)
+{
+    auto now = std::chrono::high_resolution_clock::now();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto start = m_stage_start.find(stage);
+        if (start == m_stage_start.end() || m_stage_latency.count(stage))
+        {
+            return false;
+        }
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(now - start->second).count();
+        m_stage_latency[stage] = (float)us / 1000.;
+    }
+    EventTrace::Record(TraceEvent::StageEnd, m_trace_stream, stage);
+
+    // ms since the stream started, so the client can lay out the critical path of the stream
+    if (!m_should_cancel)
+    {
+        auto us = std::chrono::duration_cast<std::chrono::microseconds>(now - m_stream_start).count();
+        (*event.mutable_metadata()->mutable_component_timing())["tracing.speech_squad." + stage + "_done"] = (float)us / 1000.;
+        m_stream->WriteResponse(std::move(event));
+    }
+    return true;
+}
+
+// ms from the end of the client's upload (the question text, or the close of its audio) to the first
+// tts audio, or to now when tts has not answered; requires m_mutex
+float SpeechSquadContext::ResponseLatency()
+{
+    auto origin = m_stage_start.count("asr") ? m_stage_start["asr"] : m_stream_start;
+    auto end    = std::chrono::high_resolution_clock::now();
+    auto tts    = m_stage_start.find("tts");
+    if (tts != m_stage_start.end() && m_stage_latency.count("tts"))
     {
-        (*timings)[it->first] = it->second;
+        end = tts->second + std::chrono::microseconds((std::int64_t)(m_stage_latency["tts"] * 1000));
     }
+    return (float)std::chrono::duration_cast<std::chrono::microseconds>(end - origin).count() / 1000.;
+}
+
+// " +<start ms> <stage> <latency ms>[ (+<overrun ms>)]" for every stage in order of start; requires m_mutex
+// checks the stream against the latency budgets and adds the overruns to timings, if given; returns
+// the breach to log for a sampled stream, which the caller logs once m_mutex is released. requires m_mutex
+std::string SpeechSquadContext::CheckLatencyBudgets(float e2e_ms, google::protobuf::Map<std::string, float> *timings)
+{
+    auto slo = GetResources()->slo_tracker();
+    if (slo == nullptr)
+    {
+        return std::string();
+    }
+    auto result = slo->Check(e2e_ms, m_stage_latency);
+    if (timings)
+    {
+        for (const auto &overrun : result.overruns)
+        {
+            (*timings)["tracing.speech_squad." + overrun.first + "_slo_overrun"] = overrun.second;
+        }
+    }
+    if (!result.sampled)
+    {
+        return std::string();
+    }
+    return "latency budget breached" + (result.culprit.empty() ? std::string() : " by " + result.culprit) + "; timeline:" +
+           Timeline(result.overruns);
+}
 
-    auto time_in_ms = [](std::chrono::high_resolution_clock::time_point start, std::chrono::high_resolution_clock::time_point end) {
-        auto us = std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
-        float ms = (float)us / 1000.;
-        return ms;
+std::string SpeechSquadContext::Timeline(const std::map<std::string, float> &overruns)
+{
+    std::vector<std::pair<std::chrono::high_resolution_clock::time_point, std::string>> stages;
+    for (const auto &stage : m_stage_start)
+    {
+        stages.emplace_back(stage.second, stage.first);
+    }
+    std::sort(stages.begin(), stages.end());
+
+    std::stringstream timeline;
+    timeline.precision(1);
+    timeline << std::fixed;
+    for (const auto &stage : stages)
+    {
+        timeline << " +" << (float)std::chrono::duration_cast<std::chrono::microseconds>(stage.first - m_stream_start).count() / 1000.
+                 << " " << stage.second << " ";
+        auto latency = m_stage_latency.find(stage.second);
+        if (latency == m_stage_latency.end())
+        {
+            timeline << "-";
+        }
+        else
+        {
+            timeline << latency->second;
+        }
+        auto overrun = overruns.find(stage.second);
+        if (overrun != overruns.end())
+        {
+            timeline << " (+" << overrun->second << ")";
+        }
+        timeline << ";";
+    }
+    auto e2e = overruns.find("e2e");
+    timeline << " e2e " << ResponseLatency();
+    if (e2e != overruns.end())
+    {
+        timeline << " (+" << e2e->second << ")";
+    }
+    return timeline.str();
+}
+
+// hands the stream span and a child span for every stage that started to the span exporter; stages
+// without a latency (still running, or cut short by a cancellation) end with the stream
+void SpeechSquadContext::ExportSpans(bool cancelled)
+{
+    auto exporter = GetResources()->span_exporter();
+    if (!exporter || m_trace.trace_id.empty())
+    {
+        return;
+    }
+
+    auto end     = std::chrono::high_resolution_clock::now();
+    auto unix_ns = [this](std::chrono::high_resolution_clock::time_point time) -> std::uint64_t {
+        auto wall = m_stream_start_wall + std::chrono::duration_cast<std::chrono::system_clock::duration>(time - m_stream_start);
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(wall.time_since_epoch()).count();
     };
 
-    // speech squad measured latencies
-    (*timings)["tracing.speech_squad.asr_latency"] = time_in_ms(m_asr_writes_done, m_asr_on_complete);
-    (*timings)["tracing.speech_squad.nlp_latency"] = time_in_ms(m_nlp_start, m_nlp_finish);
-    (*timings)["tracing.speech_squad.tts_latency"] = time_in_ms(m_tts_start, m_tts_first_packet);
+    std::vector<Span> spans;
+    Span              stream{m_trace.trace_id, m_trace.span_id, m_trace.parent_span_id, "SpeechSquadInfer", true,
+                             unix_ns(m_stream_start), unix_ns(end), cancelled, {}};
+    stream.attributes["speech_squad.stream_class"] = GetResources()->dispatch_scheduler().name(m_class);
+    stream.attributes["speech_squad.question"]     = m_question;
+    spans.push_back(std::move(stream));
 
-    m_stream->WriteResponse(std::move(response));
-    m_stream->FinishStream();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& stage : m_stage_start)
+    {
+        auto latency = m_stage_latency.find(stage.first);
+        auto stop    = latency == m_stage_latency.end() ? end : stage.second + std::chrono::microseconds((std::int64_t)(latency->second * 1000));
+        spans.push_back(Span{m_trace.trace_id, TraceContext::NewSpanId(), m_trace.span_id, stage.first, false, unix_ns(stage.second),
+                             unix_ns(stop), latency == m_stage_latency.end() && cancelled, {}});
+    }
+    exporter->Export(std::move(spans));
 }
 
 void SpeechSquadContext::ExtractTimings(const meta_data_t &meta_data)
 {
+    std::lock_guard<std::mutex> lock(m_mutex);
     for (auto it = meta_data.cbegin(); it != meta_data.cend(); it++)
     {
         VLOG(2) << this << ": meta_data - " << it->first << ": " << it->second;
@@ -27,7 +27,12 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #pragma once
+#include <atomic>
+#include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <vector>
 
 #include <nvrpc/context.h>
 #include <nvrpc/client/client_unary.h>
@@ -35,7 +40,11 @@
 #include <nvrpc/client/client_single_up_multiple_down.h>
 
 #include "settings.h"
+#include "fiber_workers.h"
+#include "memory_budget.h"
 #include "resources.h"
+#include "span_exporter.h"
+#include "stream_rejection.h"
 
 namespace demo
 {
@@ -43,6 +52,7 @@ namespace demo
     {
         void StreamInitialized(std::shared_ptr<ServerStream>) final override;
         void RequestsFinished(std::shared_ptr<ServerStream>) final override;
+        void StreamCancelled(std::shared_ptr<ServerStream>) final override;
 
         void RequestReceived(SpeechSquadInferRequest&& input, std::shared_ptr<ServerStream> stream) final override;
 
@@ -51,34 +61,153 @@ namespace demo
             Uninitialized,
             Initialized,
             ReceivingAudio,
-            AudioUploadComplete
+            AudioUploadComplete,
+            TextQuestion
         };
 
     public:
+        // the autoscaling executor destroys retired contexts without a final OnContextReset
+        ~SpeechSquadContext() override
+        {
+            m_strand.close();
+            m_memory.Close();
+        }
+
+        // runs stage logic for this stream on the fiber workers, in order of arrival; inline
+        // on the calling thread when fiber workers are disabled, still one task at a time
+        void Dispatch(std::function<void()> task)
+        {
+            m_strand.post(std::move(task));
+        }
+
         // callbacks
         void ASRCallbackOnResponse(asr_response_t&&);
         void ASRCallbackOnFinish(const ::grpc::Status&, const meta_data_t&);
-        void NLPCallbackOnResponse(const nlp_response_t&);
-        void NLPCallbackOnComplete(const ::grpc::Status&, const meta_data_t&);
+        void NLPCallbackOnResponse(int window, const nlp_response_t&);
+        void NLPCallbackOnComplete(int window, const ::grpc::Status&, const meta_data_t&);
+        void TextCallbackOnResponse(int stage, const text_response_t&);
+        void TextCallbackOnComplete(int stage, const ::grpc::Status&, const meta_data_t&);
         void TTSCallbackOnResponse(tts_response_t&&);
         void TTSCallbackOnComplete(const ::grpc::Status&, const meta_data_t&);
 
+        // trace the stream and its riva calls belong to; empty until the config arrived
+        const TraceContext& trace() const
+        {
+            return m_trace;
+        }
+
+        // id of the stream in the event trace; contexts are reused, stream ids are not
+        std::uint64_t trace_stream() const
+        {
+            return m_trace_stream;
+        }
+
+        // a write to riva asr was taken by the stream; bytes of audio it carried
+        void ASRRequestSent(std::size_t bytes);
+        // riva tts audio received and queued for the stage logic; counted until it is forwarded
+        void TTSResponseQueued(std::size_t bytes);
+
     private:
         void OnContextReset() final override;
 
+        void ProcessRequest(SpeechSquadInferRequest&&, std::shared_ptr<ServerStream>);
+        void ProcessRequestsFinished();
+
+        // sets a named text of the stage graph and issues every stage waiting on it
+        void SetText(const std::string& name, const std::string& text);
+        void WriteAudio(asr_request_t&&);
+        void MemoryExceeded(const char* what);
+        void IssueTextRequest(int stage, const std::string& text);
+        void IssueNLPRequest();
+        void IssueNLPWindows(const std::vector<std::string>& contexts);
+        void NLPWindowFinished(int window, const nlp_response_t*);
+        void AnswerSelected();
+        void IssueTTSRequest(const std::string& text);
+        int  TTSSampleRate();
+        void FinishSquadStream();
+
         void ExtractTimings(const meta_data_t&);
+        float       ResponseLatency();
+        std::string CheckLatencyBudgets(float e2e_ms, google::protobuf::Map<std::string, float>* timings);
+        std::string Timeline(const std::map<std::string, float>& overruns);
+        void        ExportSpans(bool cancelled);
+        void StageStarted(const std::string& stage);
+        bool StageFinished(const std::string& stage, SpeechSquadInferResponse&& event = SpeechSquadInferResponse());
+
+        template <typename Client, typename Create>
+        bool StartCall(std::unique_ptr<Client>&, Create);
+        void ScheduleCall(const std::string& stage, std::function<bool()> issue);
+        void ReleaseCall(const std::string& stage);
+        int  WithdrawCalls();
+        void CallCompleted(bool failed);
+        void ProtocolError();
+        void Reject(const char* reason);
+        void CancelDownstream();
+        void CancelCalls();
+        void CompleteIfIdle();
 
         // state variables
         State       m_state;
         std::string m_context;
+        std::string m_document_id;
+        std::vector<std::string> m_paragraphs;
+        std::string m_transcript;
         std::string m_question;
         std::string m_answer;
         float       m_nlp_score;
         AudioConfig m_tts_config;
-        bool        m_first_tts_response;
-        bool        m_should_cancel;
         bool        m_debug_tts;
 
+        // dispatch scheduler class of the stream, and when it started for the per class latency
+        int                                            m_class;
+        std::chrono::high_resolution_clock::time_point m_stream_start;
+
+        // degradation tier the stream was configured under
+        Degradation::Tier m_degradation;
+
+        // trace context of the stream, and the wall clock time it started for the exported spans
+        TraceContext                          m_trace;
+        std::chrono::system_clock::time_point m_stream_start_wall;
+        std::uint64_t                         m_trace_stream;
+
+        // set once the stream is being torn down; guarded with the riva clients by m_mutex so a
+        // cancellation either sees the client in flight or the issuer sees the flag
+        std::atomic<bool> m_should_cancel;
+        std::mutex        m_mutex;
+
+        // reason the stream was rejected for, see stream_rejection.h; empty unless Reject() tore it down
+        std::string m_rejected;
+
+        // riva calls issued and not yet completed; the last one to complete finishes the squad
+        // stream after tts, or cancels it once m_should_cancel is set
+        int  m_pending;
+        bool m_tts_complete;
+        bool m_finished;
+
+        // calls of ScheduleCall waiting for a dispatch slot, by scheduler call id, with their stage
+        std::map<std::uint64_t, std::string> m_waiting;
+
+        // nlp fan-out over the squad context windows
+        std::vector<bool> m_nlp_window_done;
+        int               m_nlp_remaining;
+        bool              m_nlp_has_result;
+        bool              m_nlp_decided;
+
+        // buffered bytes of the stream; audio beyond the asr queue limit waits in m_asr_held until
+        // riva asr takes the earlier writes, and writes are closed once it drained. the held audio
+        // is only touched from tasks on m_strand
+        StreamMemory              m_memory;
+        std::deque<asr_request_t> m_asr_held;
+        std::size_t               m_asr_outstanding;
+        bool                      m_asr_close_held;
+
+        // ingress capture id of the stream; m_capturing is cleared when the capture drops it
+        std::uint64_t m_capture_id;
+        bool          m_capturing;
+
+        // serializes the stage logic of the stream
+        FiberStrand m_strand;
+
         // timing meta data
         std::multimap<std::string, float> m_timings;
 
@@ -86,19 +215,14 @@ namespace demo
         std::shared_ptr<ServerStream> m_stream;
 
         // riva clients
-        std::unique_ptr<asr_client_t> m_asr_client;
-        std::unique_ptr<nlp_client_t> m_nlp_client;
-        std::unique_ptr<tts_client_t> m_tts_client;
-
-        // timers
-        std::chrono::high_resolution_clock::time_point m_asr_writes_done;
-        std::chrono::high_resolution_clock::time_point m_asr_on_complete;
-
-        std::chrono::high_resolution_clock::time_point m_nlp_start;
-        std::chrono::high_resolution_clock::time_point m_nlp_finish;
-
-        std::chrono::high_resolution_clock::time_point m_tts_start;
-        std::chrono::high_resolution_clock::time_point m_tts_first_packet;
+        std::unique_ptr<asr_client_t>               m_asr_client;
+        std::vector<std::unique_ptr<nlp_client_t>>  m_nlp_clients;
+        std::unique_ptr<tts_client_t>               m_tts_client;
+        std::vector<std::unique_ptr<text_client_t>> m_text_clients;
+
+        // stage timers; latency in ms of every stage that ran
+        std::map<std::string, std::chrono::high_resolution_clock::time_point> m_stage_start;
+        std::map<std::string, float>                                          m_stage_latency;
     };
 
 } // namespace demo
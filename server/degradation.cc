@@ -0,0 +1,74 @@
+#include "degradation.h"
+
+#include <cstdlib>
+#include <sstream>
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+Degradation::Degradation(const std::string& thresholds, double hysteresis, int tts_sample_rate, int tts_max_chars)
+: m_hysteresis(hysteresis), m_tts_sample_rate(tts_sample_rate), m_tts_max_chars(tts_max_chars), m_tier(None)
+{
+    std::stringstream list(thresholds);
+    std::string       threshold;
+    while (std::getline(list, threshold, ','))
+    {
+        char* end;
+        auto  value = std::strtod(threshold.c_str(), &end);
+        if (threshold.empty() || *end != '\0' || value <= 0 || (!m_thresholds.empty() && value <= m_thresholds.back()))
+        {
+            LOG(FATAL) << "invalid degradation thresholds " << thresholds << "; expected ascending positive pressures p1,p2,...";
+        }
+        m_thresholds.push_back(value);
+    }
+    if (m_thresholds.empty() || m_thresholds.size() > Reject)
+    {
+        LOG(FATAL) << "degradation thresholds " << thresholds << " must name 1 to " << (int)Reject << " tiers";
+    }
+    CHECK_GE(hysteresis, 0.0);
+    CHECK_LT(hysteresis, 1.0);
+    CHECK_GT(tts_sample_rate, 0);
+    CHECK_GT(tts_max_chars, 0);
+}
+
+Degradation::Tier Degradation::Update(double pressure)
+{
+    int current = m_tier;
+    int tier    = current;
+
+    // up at once to the highest tier reached, down one tier at a time
+    while (tier < (int)m_thresholds.size() && pressure >= m_thresholds[tier])
+    {
+        tier++;
+    }
+    if (tier == current && tier > None && pressure < m_thresholds[tier - 1] * (1 - m_hysteresis))
+    {
+        tier--;
+    }
+
+    if (tier != current)
+    {
+        LOG(WARNING) << "degradation " << name((Tier)current) << " -> " << name((Tier)tier) << " at pressure " << pressure;
+        m_tier = tier;
+    }
+    return (Tier)tier;
+}
+
+const char* Degradation::name(Tier tier)
+{
+    switch (tier)
+    {
+    case None:
+        return "none";
+    case LowTtsRate:
+        return "tts_low_rate";
+    case CappedTtsText:
+        return "tts_text_capped";
+    case TextOnly:
+        return "text_only";
+    case Reject:
+        return "reject";
+    }
+    return "unknown";
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <string>
+#include <vector>
+
+namespace demo
+{
+    // degradation tiers of the squad streams under overload. each tier adds to the ones below it:
+    //   LowTtsRate    riva tts synthesizes at a lower sample rate
+    //   CappedTtsText the answer is cut to at most tts_max_chars before synthesis
+    //   TextOnly      riva tts is skipped; the answer is returned as text only
+    //   Reject        new streams are rejected
+    // the control loop feeds the pressure of the server (the utilization score of the load report: stage
+    // latency against the latency budgets, riva calls queued against the dispatch bound, contexts and
+    // buffered bytes); a tier is entered once the pressure reaches its threshold and left, one tier at a
+    // time, once the pressure fell below threshold * (1 - hysteresis). a stream keeps the tier it was
+    // configured under. a stage latency stops counting once no stream has finished the stage for a while
+    // (see StageLatencies), so tiers that stop streams from finishing (Reject) or a stage from running
+    // (TextOnly) are still left once the load is gone.
+    class Degradation
+    {
+    public:
+        enum Tier : int
+        {
+            None          = 0,
+            LowTtsRate    = 1,
+            CappedTtsText = 2,
+            TextOnly      = 3,
+            Reject        = 4
+        };
+
+        // "p1,p2,..." ascending pressures at which tiers 1, 2, ... start; tiers past the last are never entered
+        Degradation(const std::string& thresholds, double hysteresis, int tts_sample_rate, int tts_max_chars);
+
+        // returns the tier in effect from now on
+        Tier Update(double pressure);
+
+        Tier tier() const
+        {
+            return (Tier)m_tier.load(std::memory_order_relaxed);
+        }
+
+        int tts_sample_rate() const
+        {
+            return m_tts_sample_rate;
+        }
+
+        int tts_max_chars() const
+        {
+            return m_tts_max_chars;
+        }
+
+        static const char* name(Tier);
+
+    private:
+        std::vector<double> m_thresholds; // of tier i + 1
+        double              m_hysteresis;
+        int                 m_tts_sample_rate;
+        int                 m_tts_max_chars;
+        std::atomic<int>    m_tier;
+    };
+
+} // namespace demo
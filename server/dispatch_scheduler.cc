@@ -0,0 +1,196 @@
+#include "dispatch_scheduler.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+// clients choose the class names, so only this many unknown names are remembered and logged
+static constexpr std::size_t max_unknown_names = 64;
+
+std::vector<DispatchClass> demo::parse_dispatch_classes(const std::string& spec)
+{
+    std::vector<DispatchClass> classes;
+    std::stringstream          entries(spec);
+    std::string                entry;
+    while (std::getline(entries, entry, ','))
+    {
+        auto colon = entry.find(':');
+        if (colon == std::string::npos || colon == 0)
+        {
+            LOG(FATAL) << "stream class \"" << entry << "\": expected <name>:<weight>";
+        }
+        DispatchClass cls{entry.substr(0, colon), std::atoi(entry.c_str() + colon + 1)};
+        if (cls.weight <= 0)
+        {
+            LOG(FATAL) << "stream class " << cls.name << ": weight must be a positive integer";
+        }
+        for (const auto& other : classes)
+        {
+            if (other.name == cls.name)
+            {
+                LOG(FATAL) << "stream class " << cls.name << " is defined twice";
+            }
+        }
+        classes.push_back(cls);
+    }
+    if (classes.empty())
+    {
+        LOG(FATAL) << "no stream classes in \"" << spec << "\"";
+    }
+    return classes;
+}
+
+DispatchScheduler::DispatchScheduler(std::vector<DispatchClass> classes, int default_class, int max_inflight)
+: m_default(default_class), m_max_inflight(max_inflight), m_inflight(0), m_queued(0), m_virtual_time(0), m_next_call(1),
+  m_unknown(0)
+{
+    CHECK(!classes.empty());
+    CHECK_GE(default_class, 0);
+    CHECK_LT(default_class, (int)classes.size());
+    CHECK_GE(max_inflight, 0);
+    for (auto& cls : classes)
+    {
+        m_classes.push_back(Class{std::move(cls.name), (double)cls.weight, 0, {}, 0, 0, 0, 0, 0});
+    }
+}
+
+int DispatchScheduler::find(const std::string& name)
+{
+    for (int i = 0; i < (int)m_classes.size(); i++)
+    {
+        if (m_classes[i].name == name)
+        {
+            return i;
+        }
+    }
+    if (name.empty())
+    {
+        return m_default;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_unknown++;
+    if (m_unknown_names.size() < max_unknown_names && m_unknown_names.insert(name).second)
+    {
+        LOG(WARNING) << "unknown stream class " << name << "; using " << m_classes[m_default].name
+                     << (m_unknown_names.size() == max_unknown_names ? "; further unknown names are not logged" : "");
+    }
+    return m_default;
+}
+
+std::uint64_t DispatchScheduler::NewCall()
+{
+    return m_next_call++;
+}
+
+void DispatchScheduler::Acquire(int cls, std::uint64_t call, std::function<void()> granted)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_max_inflight > 0 && (m_inflight >= m_max_inflight || m_queued > 0))
+        {
+            auto& queue = m_classes[cls];
+            auto  start = std::max(m_virtual_time, queue.last_finish);
+            queue.last_finish = start + 1.0 / queue.weight;
+            queue.waiting.push_back(Waiter{queue.last_finish, call, std::move(granted)});
+            m_queued++;
+            return;
+        }
+        m_inflight++;
+    }
+    granted();
+}
+
+bool DispatchScheduler::Withdraw(int cls, std::uint64_t call)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& queue  = m_classes[cls];
+    auto  waiter = std::find_if(queue.waiting.begin(), queue.waiting.end(), [call](const Waiter& w) { return w.call == call; });
+    if (waiter == queue.waiting.end())
+    {
+        return false;
+    }
+    if (waiter + 1 == queue.waiting.end())
+    {
+        // the next call of the class starts where the withdrawn one did
+        queue.last_finish = waiter->finish - 1.0 / queue.weight;
+    }
+    queue.waiting.erase(waiter);
+    m_queued--;
+    return true;
+}
+
+void DispatchScheduler::Release()
+{
+    std::function<void()> granted;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        Class* next = nullptr;
+        for (auto& queue : m_classes)
+        {
+            if (!queue.waiting.empty() && (next == nullptr || queue.waiting.front().finish < next->waiting.front().finish))
+            {
+                next = &queue;
+            }
+        }
+        if (next == nullptr)
+        {
+            m_inflight--;
+            return;
+        }
+        // the slot passes straight to the next call; m_inflight is unchanged
+        m_virtual_time = next->waiting.front().finish;
+        granted        = std::move(next->waiting.front().granted);
+        next->waiting.pop_front();
+        m_queued--;
+    }
+    granted();
+}
+
+void DispatchScheduler::RecordWait(int cls, float ms)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_classes[cls].calls++;
+    m_classes[cls].total_wait_ms += ms;
+}
+
+void DispatchScheduler::RecordStream(int cls, float ms)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto& queue = m_classes[cls];
+    queue.streams++;
+    queue.total_ms += ms;
+    queue.max_ms = std::max(queue.max_ms, ms);
+}
+
+DispatchScheduler::Load DispatchScheduler::load()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    Load                        load{m_inflight, m_max_inflight, {}, m_unknown};
+    for (const auto& queue : m_classes)
+    {
+        load.queued.push_back((int)queue.waiting.size());
+    }
+    return load;
+}
+
+std::vector<DispatchScheduler::ClassStats> DispatchScheduler::stats()
+{
+    std::vector<ClassStats>     stats;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& queue : m_classes)
+    {
+        stats.push_back(ClassStats{queue.name, (int)queue.waiting.size(), queue.streams,
+                                   queue.streams ? (float)(queue.total_ms / queue.streams) : 0.f, queue.max_ms, queue.calls,
+                                   queue.calls ? (float)(queue.total_wait_ms / queue.calls) : 0.f});
+        queue.streams       = 0;
+        queue.total_ms      = 0;
+        queue.max_ms        = 0;
+        queue.calls         = 0;
+        queue.total_wait_ms = 0;
+    }
+    return stats;
+}
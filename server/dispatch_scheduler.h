@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace demo
+{
+    struct DispatchClass
+    {
+        std::string name;
+        int         weight;
+    };
+
+    // "name:weight,..." e.g. "interactive:8,batch:1"
+    std::vector<DispatchClass> parse_dispatch_classes(const std::string& spec);
+
+    // weighted fair queuing of the riva nlp, text stage and tts calls over a bounded number in flight.
+    // below the bound a call is admitted at once; above it calls wait in a queue per stream class and a
+    // finishing call hands its slot to the head with the smallest virtual finish time (self-clocked fair
+    // queuing: the virtual time is the finish time of the call last admitted), so a class of weight w
+    // gets w slots for every slot of a class of weight 1 while both wait.
+    // with max_inflight 0 every call is admitted at once and only the per class metrics are kept.
+    class DispatchScheduler
+    {
+    public:
+        struct ClassStats
+        {
+            std::string   name;
+            int           queued;       // calls waiting for a slot now
+            std::uint64_t streams;      // streams finished since the previous stats() call
+            float         mean_ms;      // their mean and max end to end latency
+            float         max_ms;
+            std::uint64_t calls;        // calls admitted since the previous stats() call
+            float         mean_wait_ms; // their mean wait for a slot
+        };
+
+        DispatchScheduler(std::vector<DispatchClass> classes, int default_class, int max_inflight);
+
+        // index of the named class; the default class for an empty or unknown name. an unknown name is
+        // counted in load() and logged the first time it is seen
+        int find(const std::string& name);
+
+        const std::string& name(int cls) const
+        {
+            return m_classes[cls].name;
+        }
+
+        // an id for Acquire() and Withdraw(), unique over the calls of all streams
+        std::uint64_t NewCall();
+
+        // granted runs once the call holds a slot; inline when one is free, otherwise from the Release()
+        // of another call. the holder returns the slot with Release()
+        void Acquire(int cls, std::uint64_t call, std::function<void()> granted);
+        void Release();
+
+        // drops a call still waiting for a slot, e.g. of a cancelled stream, without running granted;
+        // false if it is not waiting, because it was granted already or is not queued yet
+        bool Withdraw(int cls, std::uint64_t call);
+
+        void RecordWait(int cls, float ms);
+        void RecordStream(int cls, float ms);
+
+        // one entry per class; the counters restart with every call
+        std::vector<ClassStats> stats();
+
+        struct Load
+        {
+            int              inflight;     // calls holding a slot
+            int              max_inflight; // 0 when unbounded
+            std::vector<int> queued;       // calls waiting for a slot, by class
+            std::uint64_t    unknown;      // streams that named an unknown class since the start
+        };
+
+        Load load();
+
+    private:
+        struct Waiter
+        {
+            double                finish; // virtual finish time
+            std::uint64_t         call;
+            std::function<void()> granted;
+        };
+
+        struct Class
+        {
+            std::string name;
+            double      weight;
+            double      last_finish;
+
+            std::deque<Waiter> waiting; // by virtual finish time
+
+            std::uint64_t streams;
+            double        total_ms;
+            float         max_ms;
+            std::uint64_t calls;
+            double        total_wait_ms;
+        };
+
+        std::vector<Class> m_classes;
+        int                m_default;
+        int                m_max_inflight;
+
+        std::mutex m_mutex;
+        int        m_inflight;
+        int        m_queued;
+        double     m_virtual_time;
+
+        std::atomic<std::uint64_t> m_next_call;
+
+        std::uint64_t         m_unknown;
+        std::set<std::string> m_unknown_names; // logged already
+    };
+
+} // namespace demo
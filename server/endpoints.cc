@@ -0,0 +1,86 @@
+#include "endpoints.h"
+
+#include <algorithm>
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <sys/socket.h>
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+std::vector<std::string> demo::split_endpoints(const std::string& urls)
+{
+    std::vector<std::string> endpoints;
+    std::size_t              start = 0;
+    while (start <= urls.size())
+    {
+        auto end = urls.find(',', start);
+        if (end == std::string::npos)
+        {
+            end = urls.size();
+        }
+        auto url   = urls.substr(start, end - start);
+        auto first = url.find_first_not_of(" \t");
+        auto last  = url.find_last_not_of(" \t");
+        if (first != std::string::npos)
+        {
+            endpoints.push_back(url.substr(first, last - first + 1));
+        }
+        start = end + 1;
+    }
+    return endpoints;
+}
+
+std::vector<std::string> demo::resolve_endpoints(const std::string& url, bool resolve)
+{
+    // unix:, dns:///, ipv4: ... are left to grpc; a bracketed ipv6 literal is not a scheme
+    auto colon = url.rfind(':');
+    auto is_uri = url.compare(0, 5, "unix:") == 0 || url.find(":/") != std::string::npos ||
+                  (url.find(':') != colon && url.front() != '[');
+    if (!resolve || is_uri || colon == std::string::npos)
+    {
+        return {url};
+    }
+
+    auto host = url.substr(0, colon);
+    auto port = url.substr(colon + 1);
+    if (host.size() > 1 && host.front() == '[' && host.back() == ']')
+    {
+        return {url};
+    }
+
+    struct addrinfo hints = {};
+    hints.ai_family       = AF_UNSPEC;
+    hints.ai_socktype     = SOCK_STREAM;
+
+    struct addrinfo* results = nullptr;
+    auto             rc      = getaddrinfo(host.c_str(), port.c_str(), &hints, &results);
+    if (rc != 0)
+    {
+        LOG(WARNING) << "failed to resolve " << url << ": " << gai_strerror(rc);
+        return {};
+    }
+
+    std::vector<std::string> endpoints;
+    for (auto* ai = results; ai != nullptr; ai = ai->ai_next)
+    {
+        char address[INET6_ADDRSTRLEN];
+        if (ai->ai_family == AF_INET)
+        {
+            inet_ntop(AF_INET, &reinterpret_cast<struct sockaddr_in*>(ai->ai_addr)->sin_addr, address, sizeof(address));
+            endpoints.push_back(std::string(address) + ":" + port);
+        }
+        else if (ai->ai_family == AF_INET6)
+        {
+            inet_ntop(AF_INET6, &reinterpret_cast<struct sockaddr_in6*>(ai->ai_addr)->sin6_addr, address, sizeof(address));
+            endpoints.push_back("[" + std::string(address) + "]:" + port);
+        }
+    }
+    freeaddrinfo(results);
+
+    std::sort(endpoints.begin(), endpoints.end());
+    endpoints.erase(std::unique(endpoints.begin(), endpoints.end()), endpoints.end());
+    return endpoints;
+}
@@ -0,0 +1,16 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace demo
+{
+    // splits a comma separated list of grpc targets, e.g. "riva-0:50051,riva-1:50051"
+    std::vector<std::string> split_endpoints(const std::string& urls);
+
+    // expands a target into the endpoints it currently stands for. host:port targets are
+    // resolved to one ip:port endpoint per address when resolve is set; unix sockets, ip
+    // literals and grpc uris (scheme:...) are returned unchanged. returns an empty vector if
+    // the name does not resolve. the result is sorted and free of duplicates.
+    std::vector<std::string> resolve_endpoints(const std::string& url, bool resolve);
+
+} // namespace demo
@@ -0,0 +1,282 @@
+#include "event_trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+namespace
+{
+    struct Event
+    {
+        std::uint64_t tsc;
+        std::uint64_t stream;
+        std::uint32_t value;
+        std::uint16_t label;
+        TraceEvent    event;
+    };
+
+    // a seqlock per slot: seq is odd while the ring's thread stores event i and 2 * i + 2 once it is
+    // complete. the fields are relaxed atomics, so a dump that races the writer sees seq change rather
+    // than reading a torn event
+    struct Slot
+    {
+        std::atomic<std::uint64_t> seq{0};
+        std::atomic<std::uint64_t> tsc{0};
+        std::atomic<std::uint64_t> stream{0};
+        std::atomic<std::uint64_t> payload{0}; // value | label << 32 | event << 48
+    };
+
+    struct Ring
+    {
+        explicit Ring(std::size_t size) : slots(size), head(0) {}
+
+        std::vector<Slot>          slots;
+        std::atomic<std::uint64_t> head; // events ever written; the next slot is head & (size - 1)
+    };
+
+    const char* event_names[] = {"stream_start", "config",       "audio_in",      "writes_done",  "asr_held",
+                                 "asr_sent",     "asr_response", "nlp_response",  "text_response", "tts_response",
+                                 "stage_start",  "stage_end",    "finish",        "cancel"};
+    static_assert(sizeof(event_names) / sizeof(event_names[0]) == (std::size_t)TraceEvent::Count, "a name for every event");
+
+    std::uint64_t ticks()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    std::atomic<bool>          enabled(false);
+    std::size_t                ring_size = 0;
+    std::atomic<std::uint64_t> streams(0);
+
+    // tsc and steady clock at Enable, to scale ticks to microseconds at dump time
+    std::uint64_t                         origin_ticks;
+    std::chrono::steady_clock::time_point origin_time;
+
+    // rings are registered once per thread and live until exit; threads that exit leave their ring behind
+    std::mutex                         rings_mutex;
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    // stage labels, interned; each thread caches the ids it looked up
+    std::mutex                                     labels_mutex;
+    std::vector<std::string>                       labels;
+    std::unordered_map<std::string, std::uint16_t> label_ids;
+
+    thread_local Ring* thread_ring = nullptr;
+
+    Ring* this_thread_ring()
+    {
+        if (thread_ring == nullptr)
+        {
+            std::lock_guard<std::mutex> lock(rings_mutex);
+            rings.push_back(std::make_unique<Ring>(ring_size));
+            thread_ring = rings.back().get();
+        }
+        return thread_ring;
+    }
+
+    std::uint16_t intern(const std::string& label)
+    {
+        thread_local std::unordered_map<std::string, std::uint16_t> cache;
+        auto cached = cache.find(label);
+        if (cached != cache.end())
+        {
+            return cached->second;
+        }
+        std::lock_guard<std::mutex> lock(labels_mutex);
+        auto                        id = label_ids.emplace(label, (std::uint16_t)labels.size());
+        if (id.second)
+        {
+            labels.push_back(label);
+        }
+        cache.emplace(label, id.first->second);
+        return id.first->second;
+    }
+
+    void append(TraceEvent event, std::uint64_t stream, std::uint32_t value, std::uint16_t label)
+    {
+        auto  ring = this_thread_ring();
+        auto  head = ring->head.load(std::memory_order_relaxed);
+        auto& slot = ring->slots[head & (ring_size - 1)];
+        slot.seq.store(2 * head + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.tsc.store(ticks(), std::memory_order_relaxed);
+        slot.stream.store(stream, std::memory_order_relaxed);
+        slot.payload.store(value | (std::uint64_t)label << 32 | (std::uint64_t)event << 48, std::memory_order_relaxed);
+        slot.seq.store(2 * head + 2, std::memory_order_release);
+        ring->head.store(head + 1, std::memory_order_release);
+    }
+
+    // false if event i was overwritten or is being written while it is copied
+    bool read(const Ring& ring, std::uint64_t i, Event& event)
+    {
+        const auto& slot = ring.slots[i & (ring_size - 1)];
+        auto        seq  = slot.seq.load(std::memory_order_acquire);
+        if (seq != 2 * i + 2)
+        {
+            return false;
+        }
+        auto payload = slot.payload.load(std::memory_order_relaxed);
+        event        = Event{slot.tsc.load(std::memory_order_relaxed), slot.stream.load(std::memory_order_relaxed),
+                      (std::uint32_t)payload, (std::uint16_t)(payload >> 32), (TraceEvent)(payload >> 48)};
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.seq.load(std::memory_order_relaxed) == seq;
+    }
+
+    void json_string(std::ostream& out, const std::string& text)
+    {
+        out << '"';
+        for (auto c : text)
+        {
+            if (c == '"' || c == '\\')
+            {
+                out << '\\' << c;
+            }
+            else if ((unsigned char)c < 0x20)
+            {
+                out << ' ';
+            }
+            else
+            {
+                out << c;
+            }
+        }
+        out << '"';
+    }
+} // namespace
+
+void EventTrace::Enable(std::size_t events_per_thread)
+{
+    CHECK_GT(events_per_thread, 0);
+    CHECK(!enabled) << "event trace already enabled";
+    ring_size = 1;
+    while (ring_size < events_per_thread)
+    {
+        ring_size <<= 1;
+    }
+    origin_ticks = ticks();
+    origin_time  = std::chrono::steady_clock::now();
+    enabled      = true;
+    LOG(INFO) << "recording stream events; " << ring_size << " per thread";
+}
+
+bool EventTrace::Enabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+std::uint64_t EventTrace::NewStream()
+{
+    return ++streams;
+}
+
+void EventTrace::Record(TraceEvent event, std::uint64_t stream, std::uint32_t value)
+{
+    if (!Enabled())
+    {
+        return;
+    }
+    append(event, stream, value, 0);
+}
+
+void EventTrace::Record(TraceEvent event, std::uint64_t stream, const std::string& label)
+{
+    if (!Enabled())
+    {
+        return;
+    }
+    append(event, stream, 0, intern(label));
+}
+
+bool EventTrace::Dump(const std::string& path)
+{
+    if (!Enabled())
+    {
+        LOG(WARNING) << "event trace is not enabled; nothing to dump";
+        return false;
+    }
+
+    // snapshot every ring; events rewritten while they are copied fail their seqlock check and are skipped
+    std::vector<std::vector<Event>> snapshots;
+    {
+        std::lock_guard<std::mutex> lock(rings_mutex);
+        for (const auto& ring : rings)
+        {
+            auto               end   = ring->head.load(std::memory_order_acquire);
+            auto               begin = end > ring_size ? end - ring_size : 0;
+            std::vector<Event> events;
+            events.reserve(end - begin);
+            for (auto i = begin; i < end; i++)
+            {
+                Event event;
+                if (read(*ring, i, event))
+                {
+                    events.push_back(event);
+                }
+            }
+            snapshots.push_back(std::move(events));
+        }
+    }
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(labels_mutex);
+        names = labels;
+    }
+
+    // ticks per microsecond over the life of the trace
+    auto elapsed_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - origin_time).count();
+    auto scale      = elapsed_us > 0 ? (double)(ticks() - origin_ticks) / elapsed_us : 1.0;
+
+    std::ofstream out(path);
+    if (!out)
+    {
+        LOG(ERROR) << "unable to write event trace to " << path;
+        return false;
+    }
+    out << "{\"traceEvents\":[\n";
+    bool        first  = true;
+    std::size_t events = 0;
+    for (std::size_t thread = 0; thread < snapshots.size(); thread++)
+    {
+        for (const auto& event : snapshots[thread])
+        {
+            out << (first ? "" : ",\n");
+            first = false;
+            events++;
+
+            auto ts = (double)(std::int64_t)(event.tsc - origin_ticks) / scale;
+            if (event.event == TraceEvent::StageStart || event.event == TraceEvent::StageEnd)
+            {
+                // async slices, one row per stream
+                out << "{\"ph\":\"" << (event.event == TraceEvent::StageStart ? "b" : "e") << "\",\"cat\":\"stage\",\"name\":";
+                json_string(out, event.label < names.size() ? names[event.label] : "?");
+                out << ",\"id\":\"" << event.stream << "\",\"pid\":1,\"tid\":" << thread
+                    << ",\"ts\":" << std::fixed << ts << "}";
+            }
+            else
+            {
+                out << "{\"ph\":\"i\",\"s\":\"t\",\"name\":\"" << event_names[(int)event.event] << "\",\"pid\":1,\"tid\":" << thread
+                    << ",\"ts\":" << std::fixed << ts << ",\"args\":{\"stream\":" << event.stream << ",\"value\":" << event.value << "}}";
+            }
+        }
+    }
+    out << "\n]}\n";
+    LOG(INFO) << "dumped " << events << " stream events from " << snapshots.size() << " threads to " << path;
+    return (bool)out;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace demo
+{
+    enum class TraceEvent : std::uint8_t
+    {
+        StreamStart,  // context took on a stream
+        Config,       // squad config received
+        AudioIn,      // audio from the squad client; value = bytes
+        WritesDone,   // the squad client closed its writes
+        AsrHeld,      // audio held back from riva asr; value = bytes
+        AsrSent,      // riva asr took a write; value = bytes
+        AsrResponse,  // riva asr callback, on the client executor
+        NlpResponse,  // riva nlp callback, on the client executor; value = window
+        TextResponse, // text stage callback, on the client executor; value = stage
+        TtsResponse,  // riva tts callback, on the client executor; value = bytes
+        StageStart,   // label = stage
+        StageEnd,     // label = stage
+        Finish,       // stream finished
+        Cancel,       // stream cancelled
+        Count
+    };
+
+    // always-on flight recorder of the squad streams. every thread appends fixed size binary events with
+    // a tsc timestamp to a ring of its own; writers never lock or wait, so the cost is a few stores per
+    // event. Dump converts the rings to chrome trace json (chrome://tracing or perfetto): instant events on
+    // one track per thread and the stages of every stream as async slices. rings are read while they are
+    // written; events overwritten during the dump are skipped. streams are told apart by a serial id, since
+    // contexts are reused
+    class EventTrace
+    {
+    public:
+        // events_per_thread is rounded up to a power of two; must precede the first Record
+        static void Enable(std::size_t events_per_thread);
+
+        static bool Enabled();
+
+        // serial id for the events of a new stream
+        static std::uint64_t NewStream();
+
+        static void Record(TraceEvent, std::uint64_t stream, std::uint32_t value = 0);
+        static void Record(TraceEvent, std::uint64_t stream, const std::string& label);
+
+        // false if the file could not be written
+        static bool Dump(const std::string& path);
+    };
+
+} // namespace demo
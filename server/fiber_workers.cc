@@ -0,0 +1,196 @@
+#include "fiber_workers.h"
+
+#include <algorithm>
+#include <system_error>
+
+#include <glog/logging.h>
+
+#include "numa.h"
+
+using namespace demo;
+
+namespace numa = boost::fibers::numa;
+
+// take cpus round robin over the numa nodes so every node gets a share of the workers; the
+// returned topology only lists the chosen cpus, which is all the work stealing scheduler visits.
+// with fewer workers than nodes the first nodes get them, in the order of current_numa_node()
+static std::vector<numa::node> select_cpus(int workers)
+{
+    auto topology = numa::topology();
+
+    std::vector<numa::node>                               selected;
+    std::vector<std::set<std::uint32_t>::const_iterator> next, last;
+    for (const auto& node : topology)
+    {
+        selected.push_back(numa::node{node.id, {}, node.distance});
+        next.push_back(node.logical_cpus.begin());
+        last.push_back(node.logical_cpus.end());
+    }
+
+    int count = 0;
+    for (bool progress = true; progress && count < workers;)
+    {
+        progress = false;
+        for (std::size_t i = 0; i < selected.size() && count < workers; i++)
+        {
+            if (next[i] != last[i])
+            {
+                selected[i].logical_cpus.insert(*next[i]++);
+                progress = true;
+                count++;
+            }
+        }
+    }
+    if (count < workers)
+    {
+        LOG(WARNING) << "requested " << workers << " fiber workers; only " << count << " cpus available";
+    }
+
+    selected.erase(std::remove_if(selected.begin(), selected.end(), [](const numa::node& n) { return n.logical_cpus.empty(); }),
+                   selected.end());
+    return selected;
+}
+
+FiberWorkers::FiberWorkers(int workers) : m_in_flight(0), m_count(0), m_registered(0), m_stopped(0)
+{
+    auto topology = select_cpus(workers);
+
+    for (const auto& node : topology)
+    {
+        m_count += node.logical_cpus.size();
+        m_tasks.push_back(std::make_unique<Tasks>(1024));
+    }
+    m_threads.reserve(m_count);
+
+    for (std::size_t i = 0; i < topology.size(); i++)
+    {
+        for (auto cpu : topology[i].logical_cpus)
+        {
+            LOG(INFO) << "starting fiber worker on cpu " << cpu << " (numa node " << topology[i].id << ")";
+            m_threads.emplace_back(
+                [this, cpu, node = topology[i].id, topology, tasks = m_tasks[i].get()] { Worker(cpu, node, topology, tasks); });
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_cv.wait(lock, [this] { return m_registered == m_count; });
+}
+
+FiberWorkers::~FiberWorkers()
+{
+    for (auto& tasks : m_tasks)
+    {
+        tasks->close();
+    }
+    for (auto& thread : m_threads)
+    {
+        thread.join();
+    }
+}
+
+void FiberWorkers::enqueue(std::function<void()> task, int node)
+{
+    m_in_flight++;
+    if (m_tasks[node % m_tasks.size()]->push(std::move(task)) != boost::fibers::channel_op_status::success)
+    {
+        m_in_flight--;
+        LOG(ERROR) << "fiber workers are shut down; dropping task";
+    }
+}
+
+void FiberWorkers::Worker(std::uint32_t cpu, std::uint32_t node, const std::vector<numa::node>& topology, Tasks* tasks)
+{
+    try
+    {
+        numa::pin_thread(cpu);
+    } catch (const std::system_error& e)
+    {
+        LOG(WARNING) << "unable to pin fiber worker to cpu " << cpu << ": " << e.what();
+    }
+    boost::fibers::use_scheduling_algorithm<numa::algo::work_stealing>(cpu, node, topology, true);
+
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_registered++;
+        m_cv.notify_all();
+        m_cv.wait(lock, [this] { return m_registered == m_count; });
+    }
+
+    // the main fiber only launches tasks; fibers launched here may be stolen by other workers
+    std::function<void()> task;
+    while (tasks->pop(task) == boost::fibers::channel_op_status::success)
+    {
+        boost::fibers::fiber([this, task = std::move(task)] {
+            task();
+            m_in_flight--;
+        }).detach();
+    }
+
+    while (m_in_flight > 0)
+    {
+        boost::this_fiber::yield();
+    }
+
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_stopped++;
+    m_cv.notify_all();
+    m_cv.wait(lock, [this] { return m_stopped == m_count; });
+}
+
+void FiberStrand::open(FiberWorkers* workers)
+{
+    std::lock_guard<boost::fibers::mutex> lock(m_mutex);
+    m_workers = workers;
+    m_node    = current_numa_node();
+    m_closed  = false;
+}
+
+void FiberStrand::close()
+{
+    std::unique_lock<boost::fibers::mutex> lock(m_mutex);
+    m_closed = true;
+    m_tasks.clear();
+    if (m_running && m_running_fiber != boost::this_fiber::get_id())
+    {
+        m_idle.wait(lock, [this] { return !m_running; });
+    }
+}
+
+void FiberStrand::post(std::function<void()> task)
+{
+    std::unique_lock<boost::fibers::mutex> lock(m_mutex);
+    if (m_closed)
+    {
+        return;
+    }
+    m_tasks.push_back(std::move(task));
+    if (m_running)
+    {
+        return;
+    }
+    m_running = true;
+    lock.unlock();
+    if (m_workers == nullptr)
+    {
+        drain();
+        return;
+    }
+    m_workers->enqueue([this] { drain(); }, m_node);
+}
+
+void FiberStrand::drain()
+{
+    std::unique_lock<boost::fibers::mutex> lock(m_mutex);
+    m_running_fiber = boost::this_fiber::get_id();
+    while (!m_tasks.empty() && !m_closed)
+    {
+        auto task = std::move(m_tasks.front());
+        m_tasks.pop_front();
+        lock.unlock();
+        task();
+        lock.lock();
+    }
+    m_running_fiber = boost::fibers::fiber::id();
+    m_running       = false;
+    m_idle.notify_all();
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/fiber/all.hpp>
+#include <boost/fiber/numa/all.hpp>
+
+namespace demo
+{
+    // os threads pinned across the numa nodes, each running a boost fiber scheduler that steals
+    // work from its own node first. tasks handed to enqueue() run as detached fibers, so the
+    // completion queue threads that produce them only pay for a channel push. every node with
+    // workers has its own task channel, so a task starts on the node it was enqueued for and only
+    // moves to another node when that node's workers run out of work. a task must not block its
+    // worker thread: std mutexes are fine for short critical sections, but anything it waits on has
+    // to be a fiber primitive or a callback.
+    class FiberWorkers
+    {
+    public:
+        FiberWorkers(int workers);
+        ~FiberWorkers();
+
+        // node as returned by current_numa_node(); nodes without workers share the channels of
+        // the nodes with workers
+        void enqueue(std::function<void()> task, int node);
+
+        std::size_t size() const
+        {
+            return m_threads.size();
+        }
+
+    private:
+        using Tasks = boost::fibers::buffered_channel<std::function<void()>>;
+
+        void Worker(std::uint32_t cpu, std::uint32_t node, const std::vector<boost::fibers::numa::node>& topology, Tasks* tasks);
+
+        std::vector<std::unique_ptr<Tasks>> m_tasks; // by node with workers
+        std::vector<std::thread>            m_threads;
+        std::atomic<long>                   m_in_flight;
+
+        // work stealing dereferences every scheduler of the topology; no worker may start
+        // scheduling before all of them have registered, or exit before all are idle
+        std::size_t             m_count;
+        std::mutex              m_mutex;
+        std::condition_variable m_cv;
+        std::size_t             m_registered;
+        std::size_t             m_stopped;
+    };
+
+    // runs the tasks posted to it one at a time and in order on the fiber workers; events of one
+    // squad stream must not overtake each other. without workers, the caller that finds the strand
+    // idle runs the queued tasks inline, so events posted from other threads meanwhile still wait
+    // their turn. its state is guarded by fiber primitives: close() may wait for a task running on
+    // a worker, which suspends a calling fiber instead of blocking the worker thread under it and
+    // every fiber scheduled there.
+    class FiberStrand
+    {
+    public:
+        FiberStrand() : m_workers(nullptr), m_node(0), m_closed(true), m_running(false) {}
+
+        // does not wait: tasks posted while a task of the previous stream is still running queue
+        // behind it. the tasks run on the workers of the numa node of the calling thread
+        void open(FiberWorkers* workers);
+
+        // drops queued tasks; waits for the running task unless called from it
+        void close();
+
+        void post(std::function<void()> task);
+
+    private:
+        void drain();
+
+        boost::fibers::mutex              m_mutex;
+        boost::fibers::condition_variable m_idle;
+        FiberWorkers*                     m_workers;
+        int                               m_node;
+        bool                              m_closed;
+        bool                              m_running;
+        boost::fibers::fiber::id          m_running_fiber;
+        std::deque<std::function<void()>> m_tasks;
+    };
+
+} // namespace demo
@@ -0,0 +1,76 @@
+#include "health_service.h"
+
+#include <chrono>
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+using ::grpc::health::v1::HealthCheckRequest;
+using ::grpc::health::v1::HealthCheckResponse;
+
+HealthService::HealthService() : m_serving(false) {}
+
+void HealthService::SetServing(bool serving)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_serving == serving)
+        {
+            return;
+        }
+        m_serving = serving;
+    }
+    LOG(INFO) << "health: " << (serving ? "SERVING" : "NOT_SERVING");
+    m_cv.notify_all();
+}
+
+HealthService::status_t HealthService::Status(const std::string& service) const
+{
+    if (!service.empty() && service != "SpeechSquadService")
+    {
+        return HealthCheckResponse::SERVICE_UNKNOWN;
+    }
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_serving ? HealthCheckResponse::SERVING : HealthCheckResponse::NOT_SERVING;
+}
+
+::grpc::Status HealthService::Check(::grpc::ServerContext* context, const HealthCheckRequest* request, HealthCheckResponse* response)
+{
+    auto status = Status(request->service());
+    if (status == HealthCheckResponse::SERVICE_UNKNOWN)
+    {
+        return ::grpc::Status(::grpc::StatusCode::NOT_FOUND, "unknown service " + request->service());
+    }
+    response->set_status(status);
+    return ::grpc::Status::OK;
+}
+
+::grpc::Status HealthService::Watch(::grpc::ServerContext* context, const HealthCheckRequest* request,
+                                    ::grpc::ServerWriter<HealthCheckResponse>* writer)
+{
+    int last = -1;
+    for (;;)
+    {
+        auto status = Status(request->service());
+        if (status != last)
+        {
+            HealthCheckResponse response;
+            response.set_status(status);
+            if (!writer->Write(response))
+            {
+                return ::grpc::Status::OK;
+            }
+            last = status;
+        }
+
+        // a cancelled watch is only noticed here, so wake up periodically
+        std::unique_lock<std::mutex> lock(m_mutex);
+        auto                         serving = m_serving;
+        m_cv.wait_for(lock, std::chrono::seconds(1), [this, serving] { return m_serving != serving; });
+        if (context->IsCancelled())
+        {
+            return ::grpc::Status::CANCELLED;
+        }
+    }
+}
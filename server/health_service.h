@@ -0,0 +1,39 @@
+#pragma once
+#include <condition_variable>
+#include <mutex>
+#include <string>
+
+#include <grpcpp/grpcpp.h>
+
+#include "health.grpc.pb.h"
+#include "health.pb.h"
+
+namespace demo
+{
+    // grpc.health.v1 for the server ("") and SpeechSquadService. reports NOT_SERVING until
+    // SetServing(true), so a readiness probe keeps traffic away while the server warms up.
+    class HealthService final : public ::grpc::health::v1::Health::Service
+    {
+        using status_t = ::grpc::health::v1::HealthCheckResponse::ServingStatus;
+
+    public:
+        HealthService();
+
+        void SetServing(bool serving);
+
+        ::grpc::Status Check(::grpc::ServerContext*, const ::grpc::health::v1::HealthCheckRequest*,
+                             ::grpc::health::v1::HealthCheckResponse*) override;
+
+        // streams the status of the service whenever it changes, until the client goes away
+        ::grpc::Status Watch(::grpc::ServerContext*, const ::grpc::health::v1::HealthCheckRequest*,
+                             ::grpc::ServerWriter<::grpc::health::v1::HealthCheckResponse>*) override;
+
+    private:
+        status_t Status(const std::string& service) const;
+
+        mutable std::mutex      m_mutex;
+        std::condition_variable m_cv;
+        bool                    m_serving;
+    };
+
+} // namespace demo
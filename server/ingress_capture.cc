@@ -0,0 +1,148 @@
+#include "ingress_capture.h"
+
+#include <chrono>
+#include <cstdio>
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+static const char capture_magic[8] = {'S', 'Q', 'C', 'A', 'P', '0', '0', '1'};
+
+static std::uint64_t now_ns()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename T>
+static void write_int(std::ostream& out, T value)
+{
+    for (std::size_t i = 0; i < sizeof(T); i++)
+    {
+        out.put((char)((std::uint64_t)value >> (8 * i)));
+    }
+}
+
+IngressCapture::IngressCapture(const std::string& path, std::size_t max_file_bytes, int max_files, std::size_t max_queued_bytes)
+: m_path(path), m_max_file_bytes(max_file_bytes), m_max_files(max_files), m_max_queued_bytes(max_queued_bytes), m_next_stream(0),
+  m_queued_bytes(0), m_dropped_streams(0), m_stop(false), m_file_bytes(0), m_file_index(0)
+{
+    CHECK_GT(max_file_bytes, 0);
+    CHECK_GE(max_files, 0);
+    Rotate();
+    m_thread = std::thread([this] { Writer(); });
+}
+
+IngressCapture::~IngressCapture()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+    LOG_IF(WARNING, m_dropped_streams) << "ingress capture dropped " << m_dropped_streams << " streams; the writer fell behind";
+}
+
+bool IngressCapture::Capture(std::uint64_t stream, const SpeechSquadInferRequest& request)
+{
+    auto timestamp = now_ns();
+    return Enqueue(Record{stream, timestamp, Kind::Request, request.SerializeAsString()});
+}
+
+bool IngressCapture::CaptureWritesDone(std::uint64_t stream)
+{
+    return Enqueue(Record{stream, now_ns(), Kind::WritesDone, std::string()});
+}
+
+bool IngressCapture::Enqueue(Record&& record)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queued_bytes + record.payload.size() > m_max_queued_bytes)
+        {
+            m_dropped.push_back(record.stream);
+            m_dropped_streams++;
+            return false;
+        }
+        m_queued_bytes += record.payload.size();
+        m_queue.push_back(std::move(record));
+    }
+    m_cv.notify_one();
+    return true;
+}
+
+void IngressCapture::Writer()
+{
+    std::deque<Record>         records;
+    std::vector<std::uint64_t> dropped;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stop || !m_queue.empty() || !m_dropped.empty(); });
+            if (m_queue.empty() && m_dropped.empty())
+            {
+                break;
+            }
+            records.swap(m_queue);
+            dropped.swap(m_dropped);
+            m_queued_bytes = 0;
+        }
+
+        for (const auto& record : records)
+        {
+            Write(record);
+        }
+        // after the records that made it, so the reader discards the whole stream
+        for (auto stream : dropped)
+        {
+            Write(Record{stream, now_ns(), Kind::StreamDropped, std::string()});
+        }
+        records.clear();
+        dropped.clear();
+        m_file.flush();
+    }
+    m_file.flush();
+}
+
+void IngressCapture::Write(const Record& record)
+{
+    if (m_file_bytes >= m_max_file_bytes)
+    {
+        Rotate();
+    }
+
+    std::uint32_t length = sizeof(record.stream) + sizeof(record.timestamp_ns) + sizeof(std::uint8_t) + record.payload.size();
+    write_int(m_file, length);
+    write_int(m_file, record.stream);
+    write_int(m_file, record.timestamp_ns);
+    write_int<std::uint8_t>(m_file, record.kind);
+    m_file.write(record.payload.data(), record.payload.size());
+    m_file_bytes += sizeof(length) + length;
+}
+
+void IngressCapture::Rotate()
+{
+    if (m_file.is_open())
+    {
+        m_file.close();
+        m_file_index++;
+    }
+
+    auto name = m_path + "." + std::to_string(m_file_index);
+    m_file.open(name, std::ios::binary | std::ios::trunc);
+    if (!m_file)
+    {
+        LOG(FATAL) << "unable to open ingress capture file " << name;
+    }
+    m_file.write(capture_magic, sizeof(capture_magic));
+    m_file_bytes = sizeof(capture_magic);
+
+    if (m_max_files > 0 && m_file_index >= (std::uint64_t)m_max_files)
+    {
+        auto expired = m_path + "." + std::to_string(m_file_index - m_max_files);
+        std::remove(expired.c_str());
+    }
+    VLOG(1) << "ingress capture writing to " << name;
+}
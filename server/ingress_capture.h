@@ -0,0 +1,91 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "settings.h"
+
+namespace demo
+{
+    // tap on the incoming squad streams for replay load tests. every request is appended with the
+    // monotonic time it arrived to <path>.<n>; a file is rotated once it exceeds max_file_bytes and
+    // only the newest max_files are kept (0 keeps all). the request path only serializes and queues;
+    // a background thread does the file i/o.
+    //
+    // file format, integers little endian:
+    //   "SQCAP001"
+    //   repeated: u32 length, then length bytes of
+    //     u64 stream id, u64 steady clock ns, u8 kind, payload (the rest)
+    //   kind 0: a serialized SpeechSquadInferRequest
+    //   kind 1: the client closed its writes; no payload
+    //   kind 2: records of the stream were dropped; the stream must not be replayed
+    //
+    // when more than max_queued_bytes are waiting on the writer the stream of the record is dropped
+    // rather than blocking the request path.
+    class IngressCapture
+    {
+    public:
+        enum Kind : std::uint8_t
+        {
+            Request       = 0,
+            WritesDone    = 1,
+            StreamDropped = 2
+        };
+
+        IngressCapture(const std::string& path, std::size_t max_file_bytes, int max_files, std::size_t max_queued_bytes);
+        ~IngressCapture();
+
+        // id for the records of a new stream
+        std::uint64_t NewStream()
+        {
+            return m_next_stream++;
+        }
+
+        // false once the stream was dropped; the caller stops capturing it
+        bool Capture(std::uint64_t stream, const SpeechSquadInferRequest&);
+        bool CaptureWritesDone(std::uint64_t stream);
+
+    private:
+        struct Record
+        {
+            std::uint64_t stream;
+            std::uint64_t timestamp_ns;
+            Kind          kind;
+            std::string   payload;
+        };
+
+        bool Enqueue(Record&&);
+        void Writer();
+        void Write(const Record&);
+        void Rotate();
+
+        std::string m_path;
+        std::size_t m_max_file_bytes;
+        int         m_max_files;
+        std::size_t m_max_queued_bytes;
+
+        std::atomic<std::uint64_t> m_next_stream;
+
+        std::mutex                 m_mutex;
+        std::condition_variable    m_cv;
+        std::deque<Record>         m_queue;
+        std::size_t                m_queued_bytes;
+        std::vector<std::uint64_t> m_dropped; // streams waiting for their StreamDropped record
+        std::uint64_t              m_dropped_streams;
+        bool                       m_stop;
+
+        // owned by the writer thread
+        std::ofstream m_file;
+        std::size_t   m_file_bytes;
+        std::uint64_t m_file_index;
+
+        std::thread m_thread;
+    };
+
+} // namespace demo
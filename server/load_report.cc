@@ -0,0 +1,240 @@
+#include "load_report.h"
+
+#include <algorithm>
+#include <sstream>
+#include <thread>
+
+#include <sys/resource.h>
+
+#include <glog/logging.h>
+
+#include "resources.h"
+
+using namespace demo;
+
+using ::xds::data::orca::v3::OrcaLoadReport;
+using ::xds::service::orca::v3::OrcaLoadReportRequest;
+
+static double cpu_seconds()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+LoadReporter::LoadReporter(std::shared_ptr<SpeechSquadResources> resources, std::vector<AutoscalingExecutor*> executors)
+: m_resources(resources), m_executors(std::move(executors)), m_sampled(clock_type::now()), m_cpu_seconds(cpu_seconds()),
+  m_streams(0), m_cpu_utilization(0), m_rps(0)
+{
+}
+
+void LoadReporter::Report(OrcaLoadReport* report)
+{
+    {
+        // rates over the time since the previous sample; reports closer together share the sample
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto                        now     = clock_type::now();
+        auto                        elapsed = std::chrono::duration<double>(now - m_sampled).count();
+        if (elapsed >= 1.0)
+        {
+            auto cpu          = cpu_seconds();
+            auto streams      = m_resources->stage_latencies().streams();
+            m_cpu_utilization = (cpu - m_cpu_seconds) / elapsed / std::max(1u, std::thread::hardware_concurrency());
+            m_rps             = (streams - m_streams) / elapsed;
+            m_cpu_seconds     = cpu;
+            m_streams         = streams;
+            m_sampled         = now;
+        }
+        report->set_cpu_utilization(m_cpu_utilization);
+        report->set_rps_fractional(m_rps);
+    }
+
+    auto   utilization = report->mutable_utilization();
+    auto   named       = report->mutable_named_metrics();
+    double score       = 0;
+
+    ContextLoad contexts{0, 0, 0};
+    for (auto executor : m_executors)
+    {
+        auto load = executor->load();
+        contexts.busy += load.busy;
+        contexts.registered += load.registered;
+        contexts.capacity += load.capacity;
+    }
+    (*named)["streams_in_flight"]   = contexts.busy;
+    (*named)["contexts_registered"] = contexts.registered;
+    (*named)["contexts_capacity"]   = contexts.capacity;
+    if (contexts.capacity > 0)
+    {
+        (*utilization)["contexts"] = (double)contexts.busy / contexts.capacity;
+        score                      = std::max(score, (double)contexts.busy / contexts.capacity);
+    }
+
+    auto& scheduler = m_resources->dispatch_scheduler();
+    auto  dispatch  = scheduler.load();
+    int   queued    = 0;
+    for (std::size_t cls = 0; cls < dispatch.queued.size(); cls++)
+    {
+        (*named)["queue_depth." + scheduler.name(cls)] = dispatch.queued[cls];
+        queued += dispatch.queued[cls];
+    }
+    (*named)["riva_calls_in_flight"]        = dispatch.inflight;
+    (*named)["unknown_stream_class_streams"] = dispatch.unknown;
+    if (dispatch.max_inflight > 0)
+    {
+        (*utilization)["riva_calls"] = std::min(1.0, (double)dispatch.inflight / dispatch.max_inflight);
+        score                        = std::max(score, (double)(dispatch.inflight + queued) / dispatch.max_inflight);
+    }
+
+    for (const auto& stage : m_resources->stage_calls().counts())
+    {
+        (*named)["stage_queued." + stage.first]    = stage.second.queued;
+        (*named)["stage_in_flight." + stage.first] = stage.second.inflight;
+    }
+
+    for (const auto& service : m_resources->channel_stream_counts())
+    {
+        long streams = 0;
+        for (auto count : service.second)
+        {
+            streams += count;
+        }
+        (*named)["riva_streams." + service.first] = streams;
+    }
+
+    auto& memory = m_resources->memory_budget();
+    if (memory.cap() > 0)
+    {
+        auto used = (double)memory.used() / memory.cap();
+        report->set_mem_utilization(std::min(1.0, used));
+        (*utilization)["memory"] = std::min(1.0, used);
+        score                    = std::max(score, used);
+    }
+
+    if (auto spans = m_resources->span_exporter())
+    {
+        (*named)["spans_dropped"] = spans->dropped();
+    }
+
+    auto slo = m_resources->slo_tracker();
+    for (const auto& stage : m_resources->stage_latencies().averages())
+    {
+        (*named)["latency_ms." + stage.first] = stage.second;
+        if (slo == nullptr)
+        {
+            continue;
+        }
+        auto budget = slo->budgets().find(stage.first);
+        if (budget != slo->budgets().end() && budget->second > 0)
+        {
+            double used                              = stage.second / budget->second;
+            (*utilization)["latency." + stage.first] = std::min(1.0, used);
+            score                                    = std::max(score, used);
+        }
+    }
+
+    report->set_application_utilization(score);
+}
+
+static void label_value(std::ostream& out, const std::string& text)
+{
+    out << '"';
+    for (auto c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out << '\\' << c;
+        }
+        else if (c == '\n')
+        {
+            out << "\\n";
+        }
+        else
+        {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+std::string LoadReporter::Prometheus()
+{
+    OrcaLoadReport report;
+    Report(&report);
+
+    std::stringstream out;
+    out << "# TYPE speechsquad_application_utilization gauge\n"
+        << "speechsquad_application_utilization " << report.application_utilization() << "\n"
+        << "# TYPE speechsquad_cpu_utilization gauge\n"
+        << "speechsquad_cpu_utilization " << report.cpu_utilization() << "\n"
+        << "# TYPE speechsquad_mem_utilization gauge\n"
+        << "speechsquad_mem_utilization " << report.mem_utilization() << "\n"
+        << "# TYPE speechsquad_streams_per_second gauge\n"
+        << "speechsquad_streams_per_second " << report.rps_fractional() << "\n"
+        << "# TYPE speechsquad_utilization gauge\n";
+    for (const auto& utilization : std::map<std::string, double>(report.utilization().begin(), report.utilization().end()))
+    {
+        out << "speechsquad_utilization{resource=";
+        label_value(out, utilization.first);
+        out << "} " << utilization.second << "\n";
+    }
+    out << "# TYPE speechsquad_load gauge\n";
+    for (const auto& metric : std::map<std::string, double>(report.named_metrics().begin(), report.named_metrics().end()))
+    {
+        out << "speechsquad_load{name=";
+        label_value(out, metric.first);
+        out << "} " << metric.second << "\n";
+    }
+    return out.str();
+}
+
+LoadReportService::LoadReportService(std::shared_ptr<LoadReporter> reporter, std::chrono::milliseconds min_interval, int max_streams)
+: m_reporter(reporter), m_min_interval(min_interval), m_max_streams(max_streams), m_streams(0)
+{
+    CHECK_GT(max_streams, 0);
+}
+
+::grpc::Status LoadReportService::StreamCoreMetrics(::grpc::ServerContext* context, const OrcaLoadReportRequest* request,
+                                                    ::grpc::ServerWriter<OrcaLoadReport>* writer)
+{
+    if (m_streams.fetch_add(1) >= m_max_streams)
+    {
+        m_streams--;
+        LOG(WARNING) << "refused a load report stream; " << m_max_streams << " are served already";
+        return ::grpc::Status(::grpc::StatusCode::RESOURCE_EXHAUSTED, "too many load report streams");
+    }
+
+    auto interval = std::chrono::seconds(request->report_interval().seconds()) +
+                    std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::nanoseconds(request->report_interval().nanos()));
+    auto status = Stream(context, std::max<std::chrono::milliseconds>(interval, m_min_interval), writer);
+    m_streams--;
+    return status;
+}
+
+::grpc::Status LoadReportService::Stream(::grpc::ServerContext* context, std::chrono::milliseconds interval,
+                                         ::grpc::ServerWriter<OrcaLoadReport>* writer)
+{
+    VLOG(1) << "streaming load reports every " << interval.count() << " ms";
+
+    for (;;)
+    {
+        OrcaLoadReport report;
+        m_reporter->Report(&report);
+        if (!writer->Write(report))
+        {
+            return ::grpc::Status::OK;
+        }
+
+        // a cancelled stream is only noticed here, so sleep in slices of at most a second
+        auto next = std::chrono::steady_clock::now() + interval;
+        while (std::chrono::steady_clock::now() < next)
+        {
+            if (context->IsCancelled())
+            {
+                return ::grpc::Status::CANCELLED;
+            }
+            std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(next - std::chrono::steady_clock::now(),
+                                                                                      std::chrono::seconds(1)));
+        }
+    }
+}
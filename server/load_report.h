@@ -0,0 +1,79 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <grpcpp/grpcpp.h>
+
+#include "orca.grpc.pb.h"
+#include "orca_load_report.pb.h"
+
+#include "autoscaling_executor.h"
+
+namespace demo
+{
+    class SpeechSquadResources;
+
+    // load of the server as an ORCA load report:
+    // - utilization: the contexts in use of the most the executors may grow to, the riva calls in flight of
+    //   --max_dispatch_inflight, the buffered bytes of --memory_limit_mb and the recent stage latencies of
+    //   their --slo_budgets, each in [0, 1]
+    // - application_utilization: the largest of those before capping, with queued riva calls counted
+    //   against the dispatch bound; above 1 the server is past one of its limits
+    // - named_metrics: the streams and contexts, the calls queued per stream class, the calls queued and in
+    //   flight per stage, the streams that named an unknown class, the streams in flight per riva endpoint,
+    //   the spans the span export dropped and the recent latency of every stage in ms
+    // - cpu_utilization and rps_fractional (finished streams) over the last second or more
+    class LoadReporter
+    {
+    public:
+        LoadReporter(std::shared_ptr<SpeechSquadResources>, std::vector<AutoscalingExecutor*>);
+
+        void Report(::xds::data::orca::v3::OrcaLoadReport*);
+
+        // the report in the prometheus text exposition format
+        std::string Prometheus();
+
+    private:
+        using clock_type = std::chrono::steady_clock;
+
+        std::shared_ptr<SpeechSquadResources> m_resources;
+        std::vector<AutoscalingExecutor*>     m_executors;
+
+        // process cpu time and streams at the previous sample
+        std::mutex             m_mutex;
+        clock_type::time_point m_sampled;
+        double                 m_cpu_seconds;
+        std::uint64_t          m_streams;
+        double                 m_cpu_utilization;
+        double                 m_rps;
+    };
+
+    // xds.service.orca.v3.OpenRcaService, the out-of-band load reports of ORCA aware balancers (grpc xds,
+    // envoy). reports are streamed at the interval the client asks for, but no more often than
+    // min_interval. a sync service: every subscribed balancer holds a grpc server thread for as long as
+    // it stays subscribed, so at most max_streams are served at once and further ones fail with
+    // RESOURCE_EXHAUSTED, which balancers retry with backoff
+    class LoadReportService final : public ::xds::service::orca::v3::OpenRcaService::Service
+    {
+    public:
+        LoadReportService(std::shared_ptr<LoadReporter>, std::chrono::milliseconds min_interval, int max_streams);
+
+        ::grpc::Status StreamCoreMetrics(::grpc::ServerContext*, const ::xds::service::orca::v3::OrcaLoadReportRequest*,
+                                         ::grpc::ServerWriter<::xds::data::orca::v3::OrcaLoadReport>*) override;
+
+    private:
+        ::grpc::Status Stream(::grpc::ServerContext*, std::chrono::milliseconds interval,
+                              ::grpc::ServerWriter<::xds::data::orca::v3::OrcaLoadReport>*);
+
+        std::shared_ptr<LoadReporter> m_reporter;
+        std::chrono::milliseconds     m_min_interval;
+        int                           m_max_streams;
+        std::atomic<int>              m_streams;
+    };
+
+} // namespace demo
@@ -24,52 +24,473 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <memory>
+#include <sstream>
+#include <thread>
+
+#include <cerrno>
+#include <cstring>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
 
 #include <nvrpc/executor.h>
 #include <nvrpc/server.h>
+#include <trtlab/core/thread_pool.h>
 
 #include "speech_squad.grpc.pb.h"
 #include "speech_squad.pb.h"
 
+#include "autoscaling_executor.h"
 #include "context.h"
+#include "event_trace.h"
+#include "health_service.h"
+#include "load_report.h"
+#include "metrics_endpoint.h"
 #include "resources.h"
+#include "stream_rejection.h"
+#include "vcr.h"
 
 // old server: "misty2-speech.riva-ai.nvidia.com"
 
 DEFINE_string(logging_name, "speech_squad", "possibly change this if you have multiple backends");
-DEFINE_string(asr_service_url, "asr.riva.nvda:80", "url for riva asr endpoint");
-DEFINE_string(nlp_service_url, "nlp.riva.nvda:80", "url for riva nlp endpoint");
-DEFINE_string(tts_service_url, "tts.riva.nvda:80", "url for riva tts endpoint");
+DEFINE_string(listen_address, "0.0.0.0:1337", "address to serve on; host:port or unix:///path/to/socket");
+DEFINE_string(asr_service_url, "asr.riva.nvda:80", "comma separated urls for riva asr endpoints; host:port or unix:///path/to/socket");
+DEFINE_string(nlp_service_url, "nlp.riva.nvda:80", "comma separated urls for riva nlp endpoints; host:port or unix:///path/to/socket");
+DEFINE_string(tts_service_url, "tts.riva.nvda:80", "comma separated urls for riva tts endpoints; host:port or unix:///path/to/socket");
+DEFINE_int32(service_resolve_interval_ms, 0,
+             "when > 0, riva service host names are resolved to one channel group per address and re-resolved at this interval");
 DEFINE_string(asr_model_name, "quartznet-asr-trt-ensemble-vad-streaming", "model to user for ASR");
 DEFINE_int32(threads, 10, "number of forward progress threads / completion queues");
-DEFINE_int32(contexts_per_thread, 100, "maximum number of concurrent contexts allowed to be in flight");
-DEFINE_int32(channels, 50, "number of channels");
+DEFINE_int32(client_threads, 0, "threads / completion queues for the downstream riva calls; 0 uses --threads");
+DEFINE_bool(numa_pinning, false,
+            "split --threads and --client_threads over the numa nodes, one server and one client executor per node, each thread pinned to its own cpu");
+DEFINE_string(stage_graph, "", "file of text stages to insert into the asr -> qa -> tts pipeline; see stage_graph.h");
+DEFINE_int32(fiber_workers, 0,
+             "numa pinned work stealing fiber workers running the per-stream stage logic; 0 runs it on the completion queue threads");
+DEFINE_int32(contexts_per_thread, 100, "contexts registered per completion queue; the concurrent streams it serves, or the floor with --max_contexts_per_thread");
+DEFINE_int32(max_contexts_per_thread, 0, "contexts are added on busy completion queues up to this many; 0 keeps --contexts_per_thread fixed");
+DEFINE_int32(context_scaling_step, 10, "contexts added to a completion queue at a time, and the idle headroom that triggers it");
+DEFINE_int32(context_cooldown_ms, 60000, "extra contexts retire as their streams finish once a queue has had headroom this long");
+DEFINE_int32(stats_interval_ms, 0,
+             "when > 0, log the context utilization of every completion queue and the latencies of every stream class at this interval");
+DEFINE_string(stream_classes, "", "name:weight,... stream classes sharing the riva nlp and tts calls by weight, e.g. interactive:8,batch:1");
+DEFINE_string(default_stream_class, "", "class of streams that name no known class; defaults to the first of --stream_classes");
+DEFINE_int32(event_trace_per_thread, 16384, "stream events kept in the flight recorder ring of every thread; 0 disables it");
+DEFINE_string(event_trace_dump, "/tmp/speechsquad_events",
+              "on SIGUSR1 the flight recorder is written as chrome trace json to <path>.<pid>.<n>.json");
+DEFINE_string(slo_budgets, "",
+              "latency budgets in ms, e.g. e2e:1500,asr:150,nlp:50,tts:100; e2e runs from the end of the client upload to the first tts "
+              "audio, asr to the final transcript, tts to its first audio, others (retrieval, text stages) for the whole stage");
+DEFINE_int32(slo_window_s, 60, "latency budget breaches are counted over this many seconds");
+DEFINE_int32(slo_log_sample, 100, "the timeline of one in this many streams breaching a latency budget is logged; 0 never");
+DEFINE_int32(load_report_min_interval_ms, 1000, "shortest interval the orca load reports are streamed at, whatever the balancer asks for");
+DEFINE_int32(load_report_max_streams, 8,
+             "most orca load report streams served at once; each holds a grpc sync server thread, further balancers are refused "
+             "with RESOURCE_EXHAUSTED");
+DEFINE_int32(metrics_port, 0, "http port serving the load report to prometheus scrapes at /metrics; 0 disables it");
+DEFINE_string(degradation_thresholds, "",
+              "p1,p2,... load report utilization at which new streams are degraded by tier: 1 lowers the tts sample rate, 2 cuts "
+              "the answer spoken, 3 answers in text only, 4 rejects streams; empty disables degradation");
+DEFINE_double(degradation_hysteresis, 0.2, "a tier is left once the utilization fell this fraction below its threshold");
+DEFINE_int32(degraded_tts_sample_rate, 16000, "tts sample rate from the first degradation tier");
+DEFINE_int32(degraded_tts_max_chars, 200, "answer characters synthesized from the second degradation tier");
+DEFINE_string(span_export, "", "append the spans of every stream (squad stream, stages) as OTLP/JSON lines to this file; empty disables it");
+DEFINE_int32(span_export_queue, 65536, "spans queued on the span export writer beyond this are dropped with their stream");
+DEFINE_int32(memory_limit_mb, 0, "bytes buffered by all streams above which new streams are rejected and growing streams cancelled; 0 is unbounded");
+DEFINE_int32(stream_memory_limit_kb, 0, "bytes one stream may buffer (context, asr audio, tts audio) before it is cancelled; 0 is unbounded");
+DEFINE_int32(asr_queue_limit_kb, 0, "asr audio outstanding on a riva asr stream beyond which further audio is held back; 0 is unbounded");
+DEFINE_int32(max_dispatch_inflight, 0, "riva nlp, text stage and tts calls in flight before calls queue by stream class; 0 is unbounded");
+DEFINE_int32(channels, 50, "number of channels; the initial and minimum channel count per riva service, split across its endpoints");
+DEFINE_int32(max_channels, 0, "upper bound on channels per riva service, split across its endpoints; 0 keeps --channels fixed");
+DEFINE_int32(channel_high_watermark, 80, "average in-flight streams per channel above which channels are added");
+DEFINE_int32(channel_low_watermark, 20, "average in-flight streams per channel below which channels are dropped");
+DEFINE_int32(channel_resize_interval_ms, 1000, "interval between channel pool resizes");
+DEFINE_int32(asr_stream_pool_per_channel, 0,
+             "pre-opened riva asr streams kept per asr channel, split over the numa nodes with --numa_pinning; 0 disables the pool");
+DEFINE_int32(asr_stream_pool_max_idle_ms, 30000, "pre-opened asr streams idle for longer than this are recycled");
+DEFINE_bool(nlp_affinity_routing, false, "route nlp requests by squad context hash instead of power of two choices");
+DEFINE_double(nlp_affinity_load_factor, 1.25, "max in-flight streams on an affinity channel relative to the average before falling back to the least loaded");
+
+DEFINE_int32(nlp_window_words, 0, "squad contexts longer than this many words are queried as concurrent overlapping windows; 0 disables");
+DEFINE_int32(nlp_window_overlap_words, 32, "words shared by adjacent squad context windows");
+DEFINE_double(nlp_window_accept_score, 0, "a window answer scoring at least this cancels the remaining windows; 0 waits for all windows");
+DEFINE_string(paragraphs_file, "", "tab separated <document id>\\t<paragraph> lines registered for context retrieval");
+DEFINE_string(ingress_capture, "", "append every incoming squad request with its arrival time to <path>.<n> for perf client replay");
+DEFINE_int32(ingress_capture_file_mb, 256, "ingress capture files are rotated once they exceed this size");
+DEFINE_int32(ingress_capture_max_files, 0, "newest ingress capture files kept; 0 keeps all");
+DEFINE_int32(ingress_capture_buffer_mb, 64, "captured requests queued on the writer beyond this are dropped with their stream");
+DEFINE_int32(warmup_rounds, 0,
+             "synthetic asr, nlp and tts calls sent through every riva channel before the health service reports SERVING, and "
+             "through channels added later before they join their pool; 0 disables");
+DEFINE_int32(warmup_audio_ms, 1000, "length of the silence streamed to riva asr by each warmup call");
+DEFINE_int32(warmup_timeout_ms, 10000, "deadline of each warmup call");
+DEFINE_int32(warmup_attempts, 10,
+             "warmup is retried until every call succeeds, at most this many times; then the server reports SERVING with the channels "
+             "that failed, so one dead riva endpoint does not keep it unready");
+DEFINE_string(vcr_record, "", "record every riva call (requests hash, responses, timings, status) to this file");
+DEFINE_string(vcr_replay, "", "serve the riva services from a --vcr_record file instead of calling the riva urls");
+DEFINE_int32(retrieval_top_k, 3, "best matching paragraphs sent to nlp when the server retrieves the squad context");
+DEFINE_int32(retrieval_threads, 2,
+             "threads running the bm25 context retrieval off the completion queue threads when --fiber_workers is 0; 0 retrieves inline");
 
 using namespace demo;
 
+// set by SIGUSR1; the control loop dumps the event trace
+static std::atomic<bool> dump_requested(false);
+
+static void request_dump(int)
+{
+    dump_requested = true;
+}
+
+// a socket file left behind by an unclean shutdown makes the bind fail. only a socket nobody listens
+// on is removed: anything else at the path, or a socket a live server accepts on, is left for the bind
+// to report
+static void remove_stale_socket(const std::string& address)
+{
+    for (const std::string scheme : {"unix://", "unix:"})
+    {
+        if (address.compare(0, scheme.size(), scheme) != 0)
+        {
+            continue;
+        }
+        auto path = address.substr(scheme.size());
+
+        struct stat info;
+        if (::lstat(path.c_str(), &info) != 0 || !S_ISSOCK(info.st_mode))
+        {
+            return;
+        }
+
+        struct sockaddr_un socket_address;
+        if (path.size() >= sizeof(socket_address.sun_path))
+        {
+            return;
+        }
+        std::memset(&socket_address, 0, sizeof(socket_address));
+        socket_address.sun_family = AF_UNIX;
+        std::memcpy(socket_address.sun_path, path.c_str(), path.size());
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+        {
+            return;
+        }
+        bool refused = ::connect(fd, reinterpret_cast<struct sockaddr*>(&socket_address), sizeof(socket_address)) != 0 &&
+                       errno == ECONNREFUSED;
+        ::close(fd);
+
+        if (!refused)
+        {
+            LOG(WARNING) << "socket " << path << " is in use or unreachable; leaving it in place";
+            return;
+        }
+        if (::unlink(path.c_str()) == 0)
+        {
+            LOG(INFO) << "removed stale socket " << path;
+        }
+        else
+        {
+            LOG(WARNING) << "unable to remove stale socket " << path << ": " << std::strerror(errno);
+        }
+        return;
+    }
+}
+
 int main(int argc, char* argv[])
 {
     FLAGS_alsologtostderr = 1; // Log to console
     ::google::InitGoogleLogging(FLAGS_logging_name.c_str());
     ::google::ParseCommandLineFlags(&argc, &argv, true);
 
-    auto server = std::make_unique<nvrpc::Server>("0.0.0.0:1337");
+    if (FLAGS_event_trace_per_thread > 0)
+    {
+        EventTrace::Enable(FLAGS_event_trace_per_thread);
+        ::signal(SIGUSR1, request_dump);
+    }
+
+    remove_stale_socket(FLAGS_listen_address);
+    auto server = std::make_unique<nvrpc::Server>(FLAGS_listen_address);
 
     std::string asr_url = FLAGS_asr_service_url;
     std::string nlp_url = FLAGS_nlp_service_url;
     std::string tts_url = FLAGS_tts_service_url;
+    bool        resolve = FLAGS_service_resolve_interval_ms > 0;
+
+    if (!FLAGS_vcr_record.empty() && !FLAGS_vcr_replay.empty())
+    {
+        LOG(FATAL) << "--vcr_record and --vcr_replay are mutually exclusive";
+    }
+    if (!FLAGS_vcr_record.empty())
+    {
+        SpeechSquadResources::record_downstream(FLAGS_vcr_record);
+    }
+
+    // replay answers all three services in process; the riva urls are ignored
+    std::unique_ptr<VcrReplayServer> vcr_replay;
+    if (!FLAGS_vcr_replay.empty())
+    {
+        auto address = "unix:///tmp/speechsquad_vcr_" + std::to_string(::getpid()) + ".sock";
+        remove_stale_socket(address);
+        vcr_replay = std::make_unique<VcrReplayServer>(FLAGS_vcr_replay, address);
+        asr_url = nlp_url = tts_url = address;
+        resolve = false;
+    }
+
+    ChannelLimits channels;
+    channels.min_channels   = FLAGS_channels;
+    channels.max_channels   = std::max(FLAGS_max_channels, FLAGS_channels);
+    channels.high_watermark = FLAGS_channel_high_watermark;
+    channels.low_watermark  = FLAGS_channel_low_watermark;
+
+    // with numa pinning a stream is served by the executor of one node, and its riva calls
+    // complete on the client executor of that node, see numa.h. nodes left without client threads
+    // share the executors of the first nodes
+    std::unique_ptr<NumaCpus>                             numa;
+    std::vector<std::shared_ptr<nvrpc::client::Executor>> client_executors;
+    auto client_threads = FLAGS_client_threads > 0 ? FLAGS_client_threads : FLAGS_threads;
+    if (FLAGS_numa_pinning)
+    {
+        numa = std::make_unique<NumaCpus>();
+        for (auto& cpus : numa->take(client_threads))
+        {
+            if (cpus.empty())
+            {
+                break;
+            }
+            LOG(INFO) << "numa node " << client_executors.size() << ": " << cpus.size() << " client threads";
+            client_executors.push_back(std::make_shared<nvrpc::client::Executor>(std::make_unique<::trtlab::ThreadPool>(cpus)));
+        }
+    }
+    else
+    {
+        client_executors.push_back(std::make_shared<nvrpc::client::Executor>(client_threads));
+    }
+
+    auto resources     = std::make_shared<SpeechSquadResources>(asr_url, nlp_url, tts_url, std::move(client_executors), channels, resolve,
+                                                            FLAGS_asr_model_name);
+    if (FLAGS_asr_stream_pool_per_channel > 0)
+    {
+        resources->enable_asr_stream_pool(FLAGS_asr_stream_pool_per_channel, std::chrono::milliseconds(FLAGS_asr_stream_pool_max_idle_ms));
+    }
 
-    auto resources     = std::make_shared<SpeechSquadResources>(asr_url, nlp_url, tts_url, FLAGS_threads, FLAGS_channels, FLAGS_asr_model_name);
-    auto executor      = server->RegisterExecutor(new executor_t(FLAGS_threads));
+    if (FLAGS_nlp_window_words > 0)
+    {
+        resources->enable_nlp_windowing(FLAGS_nlp_window_words, FLAGS_nlp_window_overlap_words, FLAGS_nlp_window_accept_score);
+    }
+
+    if (!FLAGS_paragraphs_file.empty())
+    {
+        resources->load_paragraphs(FLAGS_paragraphs_file, FLAGS_retrieval_top_k);
+    }
+
+    if (!FLAGS_stage_graph.empty())
+    {
+        resources->set_stage_graph(StageGraph::Load(FLAGS_stage_graph));
+    }
+
+    if (FLAGS_fiber_workers > 0)
+    {
+        resources->enable_fiber_workers(FLAGS_fiber_workers);
+    }
+    else if (FLAGS_retrieval_threads > 0)
+    {
+        resources->enable_retrieval_threads(FLAGS_retrieval_threads);
+    }
+
+    if (!FLAGS_ingress_capture.empty())
+    {
+        resources->enable_ingress_capture(FLAGS_ingress_capture, (std::size_t)FLAGS_ingress_capture_file_mb << 20,
+                                          FLAGS_ingress_capture_max_files, (std::size_t)FLAGS_ingress_capture_buffer_mb << 20);
+    }
+
+    if (FLAGS_nlp_affinity_routing)
+    {
+        resources->enable_nlp_affinity(FLAGS_nlp_affinity_load_factor);
+    }
+
+    if (!FLAGS_slo_budgets.empty())
+    {
+        resources->enable_slo_tracking(FLAGS_slo_budgets, FLAGS_slo_window_s, FLAGS_slo_log_sample);
+    }
+
+    if (!FLAGS_degradation_thresholds.empty())
+    {
+        resources->enable_degradation(FLAGS_degradation_thresholds, FLAGS_degradation_hysteresis, FLAGS_degraded_tts_sample_rate,
+                                      FLAGS_degraded_tts_max_chars);
+    }
+
+    if (!FLAGS_span_export.empty())
+    {
+        resources->enable_span_export(FLAGS_span_export, FLAGS_span_export_queue);
+    }
+
+    if (FLAGS_memory_limit_mb > 0 || FLAGS_stream_memory_limit_kb > 0 || FLAGS_asr_queue_limit_kb > 0)
+    {
+        resources->enable_memory_limits((std::size_t)FLAGS_memory_limit_mb << 20, (std::size_t)FLAGS_stream_memory_limit_kb << 10,
+                                        (std::size_t)FLAGS_asr_queue_limit_kb << 10);
+    }
+
+    if (!FLAGS_stream_classes.empty())
+    {
+        auto classes = parse_dispatch_classes(FLAGS_stream_classes);
+        auto name    = FLAGS_default_stream_class.empty() ? classes.front().name : FLAGS_default_stream_class;
+        resources->enable_dispatch_classes(std::move(classes), name, FLAGS_max_dispatch_inflight);
+    }
+    else if (FLAGS_max_dispatch_inflight > 0)
+    {
+        resources->enable_dispatch_classes({{"default", 1}}, "default", FLAGS_max_dispatch_inflight);
+    }
+
+    if (FLAGS_max_contexts_per_thread > 0 && FLAGS_max_contexts_per_thread < FLAGS_contexts_per_thread)
+    {
+        LOG(FATAL) << "--max_contexts_per_thread must be at least --contexts_per_thread";
+    }
+    ContextScaling scaling;
+    scaling.max_per_thread = FLAGS_max_contexts_per_thread;
+    scaling.step           = FLAGS_context_scaling_step;
+    scaling.cooldown       = std::chrono::milliseconds(FLAGS_context_cooldown_ms);
+
+    std::vector<AutoscalingExecutor*> executors;
     auto service       = server->RegisterAsyncService<SpeechSquadService>();
     auto rpc_streaming = service->RegisterRPC<SpeechSquadContext>(&SpeechSquadService::AsyncService::RequestSpeechSquadInfer);
-    executor->RegisterContexts(rpc_streaming, resources, FLAGS_contexts_per_thread);
+    if (numa)
+    {
+        // a context is bound to the completion queue of its executor, so its stream stays on one node
+        for (auto& cpus : numa->take(FLAGS_threads))
+        {
+            if (cpus.empty())
+            {
+                break;
+            }
+            LOG(INFO) << "numa node: " << cpus.size() << " server threads";
+            auto executor = server->RegisterExecutor(new AutoscalingExecutor(std::make_unique<::trtlab::ThreadPool>(cpus), scaling));
+            executor->RegisterContexts(rpc_streaming, resources, FLAGS_contexts_per_thread);
+            executors.push_back(executor);
+        }
+    }
+    else
+    {
+        auto executor = server->RegisterExecutor(new AutoscalingExecutor(FLAGS_threads, scaling));
+        executor->RegisterContexts(rpc_streaming, resources, FLAGS_contexts_per_thread);
+        executors.push_back(executor);
+    }
+
+    // rejected squad streams finish with UNAVAILABLE or RESOURCE_EXHAUSTED instead of CANCELLED
+    std::vector<std::unique_ptr<::grpc::experimental::ServerInterceptorFactoryInterface>> interceptors;
+    interceptors.push_back(stream_rejection_interceptor());
+    server->Builder().experimental().SetInterceptorCreators(std::move(interceptors));
+
+    // readiness: NOT_SERVING until the riva channels are warm
+    auto health = std::make_shared<HealthService>();
+    server->Builder().RegisterService(health.get());
+
+    // load reports for orca aware balancers, and for autoscalers through prometheus
+    auto load_reporter = std::make_shared<LoadReporter>(resources, executors);
+    auto load_report   = std::make_shared<LoadReportService>(load_reporter, std::chrono::milliseconds(FLAGS_load_report_min_interval_ms),
+                                                             FLAGS_load_report_max_streams);
+    server->Builder().RegisterService(load_report.get());
+    std::unique_ptr<MetricsEndpoint> metrics;
+    if (FLAGS_metrics_port > 0)
+    {
+        metrics = std::make_unique<MetricsEndpoint>(FLAGS_metrics_port, [load_reporter] { return load_reporter->Prometheus(); });
+    }
+
+    if (FLAGS_warmup_rounds > 0 && !vcr_replay)
+    {
+        // channels added later by the control loop are warmed before they join their pool
+        resources->enable_channel_warmup(FLAGS_warmup_rounds, FLAGS_warmup_audio_ms, std::chrono::milliseconds(FLAGS_warmup_timeout_ms));
+
+        // the server listens during warmup so probes see NOT_SERVING rather than a refused connection
+        std::thread([resources, health] {
+            for (int attempt = 1;
+                 !resources->warmup(FLAGS_warmup_rounds, FLAGS_warmup_audio_ms, std::chrono::milliseconds(FLAGS_warmup_timeout_ms)); attempt++)
+            {
+                if (attempt >= FLAGS_warmup_attempts)
+                {
+                    LOG(ERROR) << "warmup failed " << attempt << " times; serving without every channel warm";
+                    break;
+                }
+                LOG(ERROR) << "warmup failed; retrying";
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+            }
+            health->SetServing(true);
+        }).detach();
+    }
+    else
+    {
+        // no warmup requested, or replayed riva calls that only answer recorded requests
+        health->SetServing(true);
+    }
+
+    // the control loop periodically resizes the downstream channel pools and re-resolves the riva services in the background,
+    // moves the degradation tier with the load, dumps the event trace on request, and logs the context utilization of every completion queue, the
+    // latencies of every stream class, the latency budget breaches and the buffered bytes
+    auto last_resolve = std::chrono::steady_clock::now();
+    auto last_stats   = last_resolve;
+    int  dumps        = 0;
+    server->Run(std::chrono::milliseconds(FLAGS_channel_resize_interval_ms), [resources, resolve, last_resolve, executors,
+                                                                             load_reporter, last_stats, dumps]() mutable {
+        if (dump_requested.exchange(false))
+        {
+            EventTrace::Dump(FLAGS_event_trace_dump + "." + std::to_string(::getpid()) + "." + std::to_string(dumps++) + ".json");
+        }
+
+        auto now     = std::chrono::steady_clock::now();
+        bool refresh = resolve && now - last_resolve >= std::chrono::milliseconds(FLAGS_service_resolve_interval_ms);
+        if (resources->update_channels_async(refresh) && refresh)
+        {
+            last_resolve = now;
+        }
+        if (auto degradation = resources->degradation())
+        {
+            ::xds::data::orca::v3::OrcaLoadReport report;
+            load_reporter->Report(&report);
+            degradation->Update(report.application_utilization());
+        }
+        if (FLAGS_stats_interval_ms > 0 && now - last_stats >= std::chrono::milliseconds(FLAGS_stats_interval_ms))
+        {
+            // queue: busy/registered (peak since the last report)
+            std::stringstream stats;
+            int               queue = 0;
+            for (auto executor : executors)
+            {
+                for (const auto& q : executor->stats())
+                {
+                    stats << " " << queue++ << ":" << q.busy << "/" << q.registered << "(" << q.peak << ")";
+                }
+            }
+            LOG(INFO) << "contexts busy/registered(peak) per queue:" << stats.str();
 
-    server->Run();
+            for (const auto& cls : resources->dispatch_scheduler().stats())
+            {
+                LOG(INFO) << "stream class " << cls.name << ": " << cls.streams << " streams, mean " << cls.mean_ms << " ms, max "
+                          << cls.max_ms << " ms; " << cls.calls << " riva calls waited " << cls.mean_wait_ms << " ms on average, "
+                          << cls.queued << " queued";
+            }
+            if (auto slo = resources->slo_tracker())
+            {
+                // budget: breaches/streams over the window, e2e breaches blamed on the stage
+                std::stringstream breaches;
+                for (const auto& budget : slo->stats())
+                {
+                    breaches << " " << budget.budget << ":" << budget.breaches << "/" << budget.streams << "(" << budget.culprit << ")";
+                }
+                LOG(INFO) << "latency budget breaches/streams(e2e blame) over " << FLAGS_slo_window_s << "s:" << breaches.str();
+            }
+            LOG(INFO) << "buffered bytes: " << resources->memory_budget().used() << ", peak " << resources->memory_budget().peak();
+            last_stats = now;
+        }
+    });
 
     return 0;
 }
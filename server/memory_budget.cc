@@ -0,0 +1,63 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+
+using namespace demo;
+
+bool MemoryBudget::Add(std::size_t bytes)
+{
+    auto used = m_used += bytes;
+    auto peak = m_peak.load();
+    while (used > peak && !m_peak.compare_exchange_weak(peak, used))
+    {
+    }
+    return m_cap == 0 || used <= m_cap;
+}
+
+void MemoryBudget::Remove(std::size_t bytes)
+{
+    m_used -= bytes;
+}
+
+std::size_t MemoryBudget::peak()
+{
+    std::size_t used = m_used;
+    return std::max(used, m_peak.exchange(used));
+}
+
+void StreamMemory::Open(MemoryBudget* budget, std::size_t limit)
+{
+    m_budget = budget;
+    m_limit  = limit;
+}
+
+void StreamMemory::Close()
+{
+    if (m_budget)
+    {
+        m_budget->Remove(m_total.exchange(0));
+    }
+    for (auto& bytes : m_bytes)
+    {
+        bytes = 0;
+    }
+    m_budget = nullptr;
+}
+
+bool StreamMemory::Add(Kind kind, std::size_t bytes)
+{
+    m_bytes[kind] += bytes;
+    auto total     = m_total += bytes;
+    bool in_budget = m_budget == nullptr || m_budget->Add(bytes);
+    return in_budget && (m_limit == 0 || total <= m_limit);
+}
+
+void StreamMemory::Remove(Kind kind, std::size_t bytes)
+{
+    m_bytes[kind] -= bytes;
+    m_total -= bytes;
+    if (m_budget)
+    {
+        m_budget->Remove(bytes);
+    }
+}
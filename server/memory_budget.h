@@ -0,0 +1,77 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+
+namespace demo
+{
+    // bytes buffered by all squad streams against a server wide cap; 0 leaves it unbounded
+    class MemoryBudget
+    {
+    public:
+        explicit MemoryBudget(std::size_t cap) : m_cap(cap), m_used(0), m_peak(0) {}
+
+        // counts the bytes in any case; false once the cap is exceeded
+        bool Add(std::size_t bytes);
+        void Remove(std::size_t bytes);
+
+        // new streams are rejected while this holds
+        bool Exhausted() const
+        {
+            return m_cap && m_used >= m_cap;
+        }
+
+        std::size_t cap() const
+        {
+            return m_cap;
+        }
+
+        std::size_t used() const
+        {
+            return m_used;
+        }
+
+        // most bytes used since the previous call
+        std::size_t peak();
+
+    private:
+        std::size_t              m_cap;
+        std::atomic<std::size_t> m_used;
+        std::atomic<std::size_t> m_peak;
+    };
+
+    // the bytes one stream buffers, by kind, counted against its own limit and the server budget
+    class StreamMemory
+    {
+    public:
+        enum Kind
+        {
+            Context,   // squad context and candidate paragraphs
+            Audio,     // asr audio written to riva and not yet sent, or held back from it
+            Responses, // tts audio received from riva and not yet handed to the squad stream
+            Kinds
+        };
+
+        StreamMemory() : m_budget(nullptr), m_limit(0), m_total(0), m_bytes{} {}
+
+        void Open(MemoryBudget* budget, std::size_t limit);
+
+        // releases whatever is still counted
+        void Close();
+
+        // counts the bytes in any case; false once the stream or the server is over its limit
+        bool Add(Kind, std::size_t bytes);
+        void Remove(Kind, std::size_t bytes);
+
+        std::size_t bytes(Kind kind) const
+        {
+            return m_bytes[kind];
+        }
+
+    private:
+        MemoryBudget*            m_budget;
+        std::size_t              m_limit;
+        std::atomic<std::size_t> m_total;
+        std::atomic<std::size_t> m_bytes[Kinds];
+    };
+
+} // namespace demo
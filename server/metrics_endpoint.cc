@@ -0,0 +1,103 @@
+#include "metrics_endpoint.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+MetricsEndpoint::MetricsEndpoint(int port, std::function<std::string()> metrics)
+: m_metrics(std::move(metrics)), m_socket(::socket(AF_INET, SOCK_STREAM, 0)), m_running(true)
+{
+    if (m_socket < 0)
+    {
+        LOG(FATAL) << "unable to create the metrics socket: " << std::strerror(errno);
+    }
+    int reuse = 1;
+    ::setsockopt(m_socket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family      = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port        = htons(port);
+    if (::bind(m_socket, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(m_socket, 16) != 0)
+    {
+        LOG(FATAL) << "unable to listen for metrics scrapes on port " << port << ": " << std::strerror(errno);
+    }
+    m_thread = std::thread([this] { Serve(); });
+    LOG(INFO) << "serving load metrics on http port " << port << " /metrics";
+}
+
+MetricsEndpoint::~MetricsEndpoint()
+{
+    m_running = false;
+    m_thread.join();
+    ::close(m_socket);
+}
+
+void MetricsEndpoint::Serve()
+{
+    while (m_running)
+    {
+        // wake up periodically to notice the shutdown
+        pollfd listening{m_socket, POLLIN, 0};
+        if (::poll(&listening, 1, 500) <= 0)
+        {
+            continue;
+        }
+        int connection = ::accept(m_socket, nullptr, nullptr);
+        if (connection < 0)
+        {
+            continue;
+        }
+        Answer(connection);
+        ::close(connection);
+    }
+}
+
+void MetricsEndpoint::Answer(int connection)
+{
+    // the request line is all that matters; a scraper that does not send it within a second is dropped
+    std::string request;
+    char        buffer[1024];
+    while (request.find("\r\n") == std::string::npos && request.size() < 8192)
+    {
+        pollfd readable{connection, POLLIN, 0};
+        if (::poll(&readable, 1, 1000) <= 0)
+        {
+            return;
+        }
+        auto bytes = ::recv(connection, buffer, sizeof(buffer), 0);
+        if (bytes <= 0)
+        {
+            return;
+        }
+        request.append(buffer, bytes);
+    }
+
+    std::string status = "404 Not Found";
+    std::string body;
+    if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 14, "GET /metrics\r\n") == 0)
+    {
+        status = "200 OK";
+        body   = m_metrics();
+    }
+    auto response = "HTTP/1.0 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                    std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+    for (std::size_t sent = 0; sent < response.size();)
+    {
+        auto bytes = ::send(connection, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (bytes <= 0)
+        {
+            return;
+        }
+        sent += bytes;
+    }
+}
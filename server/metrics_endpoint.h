@@ -0,0 +1,28 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+namespace demo
+{
+    // minimal http/1.0 listener for prometheus scrapes: GET /metrics answers the text produced by
+    // metrics, anything else 404. one connection at a time on a thread of its own; scrapes are rare
+    // and the body is small
+    class MetricsEndpoint
+    {
+    public:
+        MetricsEndpoint(int port, std::function<std::string()> metrics);
+        ~MetricsEndpoint();
+
+    private:
+        void Serve();
+        void Answer(int connection);
+
+        std::function<std::string()> m_metrics;
+        int                          m_socket;
+        std::atomic<bool>            m_running;
+        std::thread                  m_thread;
+    };
+
+} // namespace demo
@@ -0,0 +1,82 @@
+#include "numa.h"
+
+#include <sched.h>
+
+#include <algorithm>
+
+#include <boost/fiber/numa/topology.hpp>
+#include <glog/logging.h>
+
+using namespace demo;
+
+// nodes in topology order; both NumaCpus and current_numa_node() index them this way
+static const std::vector<boost::fibers::numa::node>& numa_topology()
+{
+    static const auto topology = boost::fibers::numa::topology();
+    return topology;
+}
+
+NumaCpus::NumaCpus()
+{
+    for (const auto& node : numa_topology())
+    {
+        if (!node.logical_cpus.empty())
+        {
+            m_cpus.emplace_back(node.logical_cpus.begin(), node.logical_cpus.end());
+        }
+    }
+    m_next.resize(m_cpus.size(), 0);
+    CHECK(!m_cpus.empty()) << "no numa nodes with cpus found";
+}
+
+std::vector<::trtlab::cpu_set> NumaCpus::take(int threads)
+{
+    std::vector<::trtlab::cpu_set> sets(m_cpus.size());
+    for (std::size_t i = 0; i < m_cpus.size(); i++)
+    {
+        int share = threads / m_cpus.size() + (i < threads % m_cpus.size() ? 1 : 0);
+        if (share > (int)m_cpus[i].size())
+        {
+            LOG(WARNING) << "numa node " << i << " has " << m_cpus[i].size() << " cpus; " << share << " threads requested";
+            share = m_cpus[i].size();
+        }
+        if (m_next[i] + share > m_cpus[i].size())
+        {
+            // the node is exhausted; threads share cpus from here on
+            m_next[i] = 0;
+        }
+        for (int j = 0; j < share; j++)
+        {
+            sets[i].insert(::trtlab::affinity::system::cpu_from_logical_id(m_cpus[i][m_next[i]++]));
+        }
+    }
+    return sets;
+}
+
+int demo::current_numa_node()
+{
+    static const std::vector<int> node_of_cpu = [] {
+        std::vector<int> nodes;
+        int              index = 0;
+        for (const auto& node : numa_topology())
+        {
+            if (node.logical_cpus.empty())
+            {
+                continue;
+            }
+            for (auto cpu : node.logical_cpus)
+            {
+                if (cpu >= nodes.size())
+                {
+                    nodes.resize(cpu + 1, 0);
+                }
+                nodes[cpu] = index;
+            }
+            index++;
+        }
+        return nodes;
+    }();
+
+    auto cpu = ::sched_getcpu();
+    return (cpu >= 0 && cpu < (int)node_of_cpu.size()) ? node_of_cpu[cpu] : 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <trtlab/core/affinity.h>
+
+namespace demo
+{
+    // the logical cpus of every numa node, handed out node by node: executors pinned with
+    // successive take() calls get disjoint cpus for as long as a node has cpus left
+    class NumaCpus
+    {
+    public:
+        NumaCpus();
+
+        std::size_t nodes() const
+        {
+            return m_cpus.size();
+        }
+
+        // one cpu set per node, indexed like current_numa_node(); threads are split evenly over
+        // the nodes and each thread gets its own cpu. with fewer threads than nodes the last
+        // nodes get an empty set
+        std::vector<::trtlab::cpu_set> take(int threads);
+
+    private:
+        std::vector<std::vector<std::uint32_t>> m_cpus;
+        std::vector<std::size_t>                m_next;
+    };
+
+    // index of the numa node the calling thread is running on; 0 on single node hosts or when
+    // the cpu is unknown
+    //
+    // a stream stays on the node that serves it: its completion queue and server threads, the
+    // fiber workers its strand enqueues to, the client executor of its riva calls and the asr
+    // stream pool it checks out from all belong to that node. the exception is work stealing:
+    // fiber workers whose own node has no work left take fibers from other nodes
+    int current_numa_node();
+
+} // namespace demo
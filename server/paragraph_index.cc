@@ -0,0 +1,187 @@
+#include "paragraph_index.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <functional>
+#include <queue>
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+ParagraphIndex::ParagraphIndex(float k1, float b) : m_k1(k1), m_b(b), m_average_length(0) {}
+
+std::vector<std::string> ParagraphIndex::Tokenize(const std::string& text)
+{
+    std::vector<std::string> tokens;
+    std::string              token;
+    for (unsigned char c : text)
+    {
+        if (std::isalnum(c))
+        {
+            token.push_back(std::tolower(c));
+        }
+        else if (!token.empty())
+        {
+            tokens.push_back(std::move(token));
+            token.clear();
+        }
+    }
+    if (!token.empty())
+    {
+        tokens.push_back(std::move(token));
+    }
+    return tokens;
+}
+
+void ParagraphIndex::Add(const std::string& document, std::string paragraph)
+{
+    CHECK(m_offsets.empty()) << "paragraph index is already finalized";
+    m_pending.emplace_back(document, std::move(paragraph));
+}
+
+void ParagraphIndex::Finalize()
+{
+    CHECK(m_offsets.empty()) << "paragraph index is already finalized";
+
+    // group the paragraphs of a document under consecutive ids
+    std::stable_sort(m_pending.begin(), m_pending.end(),
+                     [](const std::pair<std::string, std::string>& a, const std::pair<std::string, std::string>& b) {
+                         return a.first < b.first;
+                     });
+
+    // term frequencies per paragraph, in paragraph order
+    std::vector<std::vector<std::pair<std::uint32_t, std::uint32_t>>> by_term;
+    std::uint64_t                                                      total_length = 0;
+
+    for (auto& entry : m_pending)
+    {
+        auto id = (std::uint32_t)m_paragraphs.size();
+        auto it = m_documents.emplace(entry.first, std::make_pair(id, id)).first;
+        it->second.second = id + 1;
+
+        std::unordered_map<std::uint32_t, std::uint32_t> frequencies;
+        auto                                             tokens = Tokenize(entry.second);
+        for (const auto& token : tokens)
+        {
+            auto term = m_terms.emplace(token, (std::uint32_t)m_terms.size()).first->second;
+            frequencies[term]++;
+        }
+        if (by_term.size() < m_terms.size())
+        {
+            by_term.resize(m_terms.size());
+        }
+        for (const auto& tf : frequencies)
+        {
+            by_term[tf.first].emplace_back(id, tf.second);
+        }
+
+        m_lengths.push_back(tokens.size());
+        total_length += tokens.size();
+        m_paragraphs.push_back(std::move(entry.second));
+    }
+    m_pending.clear();
+    m_pending.shrink_to_fit();
+
+    // flatten into one postings array; paragraphs were visited in id order so each run is sorted
+    m_offsets.reserve(by_term.size() + 1);
+    m_offsets.push_back(0);
+    for (auto& postings : by_term)
+    {
+        for (const auto& p : postings)
+        {
+            m_postings.push_back(Posting{p.first, p.second});
+        }
+        m_offsets.push_back(m_postings.size());
+        postings.clear();
+        postings.shrink_to_fit();
+    }
+
+    m_average_length = m_paragraphs.empty() ? 0 : (float)total_length / m_paragraphs.size();
+    VLOG(1) << "indexed " << m_paragraphs.size() << " paragraphs of " << m_documents.size() << " documents; " << m_terms.size()
+            << " terms";
+}
+
+std::vector<std::uint32_t> ParagraphIndex::Search(const std::string& query, std::size_t k, const std::string& document) const
+{
+    DCHECK(!m_offsets.empty() || m_paragraphs.empty()) << "paragraph index is not finalized";
+
+    std::uint32_t first = 0, last = m_paragraphs.size();
+    if (!document.empty())
+    {
+        auto it = m_documents.find(document);
+        if (it == m_documents.end())
+        {
+            return {};
+        }
+        first = it->second.first;
+        last  = it->second.second;
+    }
+    if (k == 0 || first == last)
+    {
+        return {};
+    }
+
+    auto terms = Tokenize(query);
+    std::sort(terms.begin(), terms.end());
+    terms.erase(std::unique(terms.begin(), terms.end()), terms.end());
+
+    // dense accumulator over the id range; the range is one document or the whole index
+    std::vector<float> scores(last - first, 0);
+    auto               n = (float)m_paragraphs.size();
+    for (const auto& token : terms)
+    {
+        auto term = m_terms.find(token);
+        if (term == m_terms.end())
+        {
+            continue;
+        }
+
+        auto begin = m_postings.begin() + m_offsets[term->second];
+        auto end   = m_postings.begin() + m_offsets[term->second + 1];
+        auto df    = (float)(end - begin);
+        auto idf   = std::log(1 + (n - df + 0.5f) / (df + 0.5f));
+
+        if (first != 0 || last != m_paragraphs.size())
+        {
+            begin = std::lower_bound(begin, end, first, [](const Posting& p, std::uint32_t id) { return p.paragraph < id; });
+        }
+        for (auto p = begin; p != end && p->paragraph < last; p++)
+        {
+            auto tf   = (float)p->frequency;
+            auto norm = m_k1 * (1 - m_b + m_b * m_lengths[p->paragraph] / m_average_length);
+            scores[p->paragraph - first] += idf * tf * (m_k1 + 1) / (tf + norm);
+        }
+    }
+
+    // heap of the k best (score, id) with the worst on top; ties prefer the lower id
+    using scored_t = std::pair<float, std::uint32_t>;
+    auto better    = [](const scored_t& a, const scored_t& b) { return a.first > b.first || (a.first == b.first && a.second < b.second); };
+    std::priority_queue<scored_t, std::vector<scored_t>, decltype(better)> heap(better);
+    for (std::uint32_t i = 0; i < scores.size(); i++)
+    {
+        if (scores[i] <= 0)
+        {
+            continue;
+        }
+        scored_t candidate(scores[i], first + i);
+        if (heap.size() < k)
+        {
+            heap.push(candidate);
+        }
+        else if (better(candidate, heap.top()))
+        {
+            heap.pop();
+            heap.push(candidate);
+        }
+    }
+
+    std::vector<std::uint32_t> ids(heap.size());
+    for (auto i = ids.size(); i > 0; i--)
+    {
+        ids[i - 1] = heap.top().second;
+        heap.pop();
+    }
+    return ids;
+}
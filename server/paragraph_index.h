@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace demo
+{
+    // in-memory bm25 index over squad paragraphs grouped by document. after Finalize() the
+    // paragraphs of a document have consecutive ids and every term's postings are one sorted run
+    // in a flat array, so scoring a query walks a few contiguous ranges.
+    class ParagraphIndex
+    {
+    public:
+        ParagraphIndex(float k1 = 1.2, float b = 0.75);
+
+        void Add(const std::string& document, std::string paragraph);
+
+        // builds the postings; no paragraphs may be added afterwards
+        void Finalize();
+
+        // ids of the k best scoring paragraphs, best first; restricted to one document unless
+        // document is empty. paragraphs sharing no term with the query are never returned.
+        std::vector<std::uint32_t> Search(const std::string& query, std::size_t k, const std::string& document = "") const;
+
+        bool has_document(const std::string& document) const
+        {
+            return m_documents.count(document) != 0;
+        }
+
+        const std::string& paragraph(std::uint32_t id) const
+        {
+            return m_paragraphs[id];
+        }
+
+        std::size_t size() const
+        {
+            return m_paragraphs.size();
+        }
+
+        // lower cased alphanumeric runs
+        static std::vector<std::string> Tokenize(const std::string& text);
+
+    private:
+        struct Posting
+        {
+            std::uint32_t paragraph;
+            std::uint32_t frequency;
+        };
+
+        float m_k1;
+        float m_b;
+        float m_average_length;
+
+        // paragraphs waiting for Finalize()
+        std::vector<std::pair<std::string, std::string>> m_pending;
+
+        std::vector<std::string>                                         m_paragraphs;
+        std::vector<std::uint32_t>                                       m_lengths;
+        std::map<std::string, std::pair<std::uint32_t, std::uint32_t>> m_documents;
+
+        // postings of term t are m_postings[m_offsets[t], m_offsets[t + 1])
+        std::unordered_map<std::string, std::uint32_t> m_terms;
+        std::vector<std::uint32_t>                      m_offsets;
+        std::vector<Posting>                            m_postings;
+    };
+
+} // namespace demo
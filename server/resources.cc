@@ -1,7 +1,15 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <grpcpp/grpcpp.h>
 #include <grpcpp/impl/codegen/channel_interface.h>
 
 #include "resources.h"
+#include "context.h"
+#include "vcr.h"
 
 using namespace demo;
 
@@ -24,116 +32,633 @@ bool WaitUntilReady(std::shared_ptr<::grpc::ChannelInterface> channel)
     return true;
 }
 
-int random_range(int upper_bound)
+static std::shared_ptr<VcrLog> vcr_log;
+
+// url may be host:port or a unix domain socket, e.g. unix:///var/run/riva/asr.sock
+std::shared_ptr<::grpc::Channel> create_channel(const std::string& url)
 {
-    int divisor = RAND_MAX / upper_bound;
-    int value;
+    ::grpc::ChannelArguments args;
+    // give every channel its own connection; by default grpc shares subchannels between channels
+    // with identical targets and arguments, which would collapse --channels into one connection
+    args.SetInt(GRPC_ARG_USE_LOCAL_SUBCHANNEL_POOL, 1);
+    if (vcr_log)
+    {
+        return ::grpc::experimental::CreateCustomChannelWithInterceptors(url, ::grpc::InsecureChannelCredentials(), args,
+                                                                         vcr_record_interceptors(vcr_log));
+    }
+    return ::grpc::CreateCustomChannel(url, ::grpc::InsecureChannelCredentials(), args);
+}
 
-    do
+// returns nullptr if the channel is not ready before the deadline
+template <typename Service>
+std::shared_ptr<typename Service::Stub> new_stub(const std::string& url)
+{
+    auto channel = create_channel(url);
+    if (!WaitUntilReady(channel))
     {
-        value = rand() / divisor;
-    } while (value == upper_bound);
+        LOG(ERROR) << "failed to connect to " << url;
+        return nullptr;
+    }
+    return Service::NewStub(channel);
+}
 
-    return value;
+// with channel warmup enabled, a new channel takes the warmup calls before it is handed to its pool,
+// so channels added under load do not take live traffic cold
+template <typename Service>
+std::shared_ptr<typename Service::Stub> SpeechSquadResources::new_warm_stub(const std::string& url)
+{
+    auto stub = new_stub<Service>(url);
+    if (stub == nullptr || m_channel_warmup.rounds == 0)
+    {
+        return stub;
+    }
+    auto calls = warmup_calls(stub, m_channel_warmup.audio_ms);
+    for (int i = 0; i < m_channel_warmup.rounds; i++)
+    {
+        for (const auto& call : calls)
+        {
+            ::grpc::ClientContext context;
+            context.set_deadline(std::chrono::system_clock::now() + m_channel_warmup.timeout);
+            auto status = call.second(&context);
+            if (!status.ok())
+            {
+                LOG(WARNING) << "warmup: " << call.first << " on a new channel to " << url << " failed: " << status.error_message();
+                return nullptr;
+            }
+        }
+    }
+    VLOG(1) << "warmup: new channel to " << url << " is warm";
+    return stub;
 }
 
-template <typename T>
-std::shared_ptr<T> get_stub(std::vector<std::shared_ptr<T>> stubs)
+SpeechSquadResources::SpeechSquadResources(std::string asr_url, std::string nlp_url, std::string tts_url,
+                                           std::vector<std::shared_ptr<nvrpc::client::Executor>> client_executors, ChannelLimits channels,
+                                           bool resolve_endpoints, std::string asr_model_name)
+    : m_client_executors(std::move(client_executors)), m_nlp_affinity_load_factor(0),
+      m_nlp_window(0), m_nlp_window_overlap(0), m_nlp_accept_score(0), m_retrieval_top_k(3), m_stream_memory_limit(0),
+      m_asr_queue_limit(0), m_channel_warmup{0, 0, std::chrono::milliseconds(0)}
 {
-    if (stubs.size() == 1)
+    m_asr_model_name = asr_model_name;
+    m_dispatch_scheduler = std::make_unique<DispatchScheduler>(std::vector<DispatchClass>{{"default", 1}}, 0, 0);
+    m_memory_budget      = std::make_unique<MemoryBudget>(0);
+
+    m_asr_stubs = std::make_unique<ServicePool<asr_stub_t>>(
+        "riva asr", asr_url, resolve_endpoints,
+        [this](const std::string& url) { return new_warm_stub<nvidia::riva::asr::RivaSpeechRecognition>(url); }, channels);
+    m_nlp_stubs = std::make_unique<ServicePool<nlp_stub_t>>(
+        "riva nlp", nlp_url, resolve_endpoints,
+        [this](const std::string& url) { return new_warm_stub<nvidia::riva::nlp::RivaLanguageUnderstanding>(url); }, channels);
+    m_tts_stubs = std::make_unique<ServicePool<tts_stub_t>>(
+        "riva tts", tts_url, resolve_endpoints,
+        [this](const std::string& url) { return new_warm_stub<nvidia::riva::tts::RivaSpeechSynthesis>(url); }, channels);
+
+    if (!m_asr_stubs->endpoints() || !m_nlp_stubs->endpoints() || !m_tts_stubs->endpoints())
     {
-        return stubs[0];
+        LOG(ERROR) << "failed to establish connections to downstream riva services";
+        exit(-1);
     }
+}
 
-    auto n = stubs.size();
-    auto r1 = random_range(n);
-    auto r2 = random_range(n);
+void SpeechSquadResources::record_downstream(const std::string& path)
+{
+    vcr_log = std::make_shared<VcrLog>(path);
+}
 
-    if (stubs[r1].use_count() < stubs[r2].use_count())
+SpeechSquadResources::~SpeechSquadResources()
+{
+    if (m_channel_update.valid())
     {
-        return stubs[r1];
+        m_channel_update.wait();
     }
-    return stubs[r2];
+    // pooled streams are cancelled before the client executors go away
+    m_asr_stream_pools.clear();
+    m_retrieval_threads.reset();
+    m_fiber_workers.reset();
 }
 
-SpeechSquadResources::SpeechSquadResources(std::string asr_url, std::string nlp_url, std::string tts_url, int threads, int channels, std::string asr_model_name)
-    : m_client_executor(std::make_shared<nvrpc::client::Executor>(threads))
+std::string SpeechSquadResources::get_model()
 {
-    LOG(INFO) << "riva asr connection established to " << asr_url;
-    LOG(INFO) << "riva nlp connection established to " << nlp_url;
-    LOG(INFO) << "riva tts connection established to " << tts_url;
 
-    m_asr_stubs.reserve(channels);
-    m_nlp_stubs.reserve(channels);
-    m_tts_stubs.reserve(channels);
-    m_asr_model_name = asr_model_name;
-    for (int i = 0; i < channels; i++)
+    return m_asr_model_name;
+
+}
+
+void SpeechSquadResources::refresh_endpoints()
+{
+    m_asr_stubs->refresh();
+    m_nlp_stubs->refresh();
+    m_tts_stubs->refresh();
+}
+
+bool SpeechSquadResources::update_channels_async(bool refresh)
+{
+    if (m_channel_update.valid() && m_channel_update.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
     {
-        auto asr_channel = grpc::CreateChannel(asr_url, grpc::InsecureChannelCredentials());
-        auto asr_stub = nvidia::riva::asr::RivaSpeechRecognition::NewStub(asr_channel);
-        m_asr_stubs.push_back(std::move(asr_stub));
+        return false;
+    }
+    m_channel_update = std::async(std::launch::async, [this, refresh] {
+        if (refresh)
+        {
+            refresh_endpoints();
+        }
+        resize_channels();
+    });
+    return true;
+}
 
-        auto nlp_channel = grpc::CreateChannel(nlp_url, grpc::InsecureChannelCredentials());
-        auto nlp_stub = nvidia::riva::nlp::RivaLanguageUnderstanding::NewStub(nlp_channel);
-        m_nlp_stubs.push_back(std::move(nlp_stub));
+void SpeechSquadResources::resize_channels()
+{
+    m_asr_stubs->resize();
+    m_nlp_stubs->resize();
+    m_tts_stubs->resize();
+
+    if (VLOG_IS_ON(1))
+    {
+        for (const auto& service : channel_stream_counts())
+        {
+            std::stringstream counts;
+            for (auto count : service.second)
+            {
+                counts << " " << count;
+            }
+            VLOG(1) << service.first << " streams per channel:" << counts.str();
+        }
+    }
+}
 
-        auto tts_channel = grpc::CreateChannel(tts_url, grpc::InsecureChannelCredentials());
-        auto tts_stub = nvidia::riva::tts::RivaSpeechSynthesis::NewStub(tts_channel);
-        m_tts_stubs.push_back(std::move(tts_stub));
+std::map<std::string, std::vector<long>> SpeechSquadResources::channel_stream_counts() const
+{
+    auto counts = m_asr_stubs->stream_counts();
+    for (const auto& service : {m_nlp_stubs->stream_counts(), m_tts_stubs->stream_counts()})
+    {
+        counts.insert(service.begin(), service.end());
+    }
+    return counts;
+}
 
-        DLOG(INFO) << "establishing connections to downstream riva services - " << i << " of " << channels;
-        if(!WaitUntilReady(asr_channel)) {
-            LOG(ERROR) << "failed to connect to " << asr_url;
-            exit(-1);
+void SpeechSquadResources::enable_asr_stream_pool(int per_channel, std::chrono::milliseconds max_idle)
+{
+    LOG(INFO) << "pre-opening " << per_channel << " riva asr streams per channel";
+    auto nodes = m_client_executors.size();
+    m_asr_stream_pools.clear();
+    for (std::size_t i = 0; i < nodes; i++)
+    {
+        auto share = per_channel / nodes + (i < per_channel % nodes ? 1 : 0);
+        if (share == 0)
+        {
+            // the first nodes hold the remainder; the streams of this node are opened on demand
+            m_asr_stream_pools.emplace_back();
+            continue;
         }
-        if(!WaitUntilReady(nlp_channel)) {
-            LOG(ERROR) << "failed to connect to " << nlp_url;
-            exit(-1);
+        m_asr_stream_pools.push_back(std::make_unique<ASRStreamPool>(
+            [this, executor = m_client_executors[i]](const std::shared_ptr<asr_stub_t>& stub) -> std::unique_ptr<asr_client_t> {
+                auto issued = m_asr_stubs->get(stub);
+                return issued.stub ? new_asr_client(nullptr, std::move(issued), executor) : nullptr;
+            },
+            [this] { return m_asr_stubs->stubs(); }, share, max_idle));
+    }
+}
+
+// traceparent header of the riva calls of a squad stream; empty for pre-opened asr streams, which
+// belong to no stream when they are opened
+static std::string traceparent(SpeechSquadContext *context)
+{
+    return context && !context->trace().trace_id.empty() ? context->trace().traceparent() : std::string();
+}
+
+std::unique_ptr<asr_client_t> SpeechSquadResources::create_asr_client(SpeechSquadContext *context)
+{
+    auto node = client_node();
+    if (node < m_asr_stream_pools.size() && m_asr_stream_pools[node])
+    {
+        auto client = m_asr_stream_pools[node]->Checkout(context);
+        if (client)
+        {
+            return client;
         }
-        if (!(WaitUntilReady(tts_channel))) {
-            LOG(ERROR) << "failed to connect to " << tts_url;
-            exit(-1);
+    }
+    return new_asr_client(context, m_asr_stubs->get(), m_client_executors[node]);
+}
+
+std::unique_ptr<asr_client_t> SpeechSquadResources::new_asr_client(SpeechSquadContext *context, IssuedStub<asr_stub_t> issued,
+                                                                   std::shared_ptr<nvrpc::client::Executor> executor)
+{
+    auto prepare_asr_fn = [asr_stub = std::move(issued.stub), trace = traceparent(context)](::grpc::ClientContext * context,
+                                                                                       ::grpc::CompletionQueue * cq) -> auto
+    {
+        if (!trace.empty())
+        {
+            context->AddMetadata("traceparent", trace);
+        }
+        return std::move(asr_stub->PrepareAsyncStreamingRecognize(context, cq));
+    };
+
+    return std::make_unique<asr_client_t>(context, std::move(issued.call), prepare_asr_fn, executor);
+}
+
+void SpeechSquadResources::enable_nlp_affinity(double load_factor)
+{
+    CHECK_GE(load_factor, 1.0);
+    LOG(INFO) << "routing riva nlp requests by context affinity; load factor " << load_factor;
+    m_nlp_affinity_load_factor = load_factor;
+}
+
+void SpeechSquadResources::enable_nlp_windowing(int window, int overlap, float accept_score)
+{
+    CHECK_GT(window, 0);
+    CHECK_GE(overlap, 0);
+    CHECK_GT(window, overlap);
+    LOG(INFO) << "splitting squad contexts into windows of " << window << " words overlapping by " << overlap;
+    m_nlp_window         = window;
+    m_nlp_window_overlap = overlap;
+    m_nlp_accept_score   = accept_score;
+}
+
+std::vector<std::string> SpeechSquadResources::nlp_windows(const std::string &squad_context) const
+{
+    if (m_nlp_window == 0)
+    {
+        return {squad_context};
+    }
+
+    // [begin, end) of every word
+    std::vector<std::pair<std::size_t, std::size_t>> words;
+    for (std::size_t end = 0;;)
+    {
+        auto begin = squad_context.find_first_not_of(" \t\n\r", end);
+        if (begin == std::string::npos)
+        {
+            break;
+        }
+        end = std::min(squad_context.find_first_of(" \t\n\r", begin), squad_context.size());
+        words.emplace_back(begin, end);
+    }
+    if (words.size() <= (std::size_t)m_nlp_window)
+    {
+        return {squad_context};
+    }
+
+    std::vector<std::string> windows;
+    std::size_t              stride = m_nlp_window - m_nlp_window_overlap;
+    for (std::size_t first = 0;; first += stride)
+    {
+        auto last = std::min(first + m_nlp_window, words.size()) - 1;
+        windows.push_back(squad_context.substr(words[first].first, words[last].second - words[first].first));
+        if (last == words.size() - 1)
+        {
+            break;
         }
     }
+    return windows;
 }
 
-SpeechSquadResources::~SpeechSquadResources() {}
+void SpeechSquadResources::load_paragraphs(const std::string &path, int top_k)
+{
+    CHECK_GT(top_k, 0);
+    m_retrieval_top_k = top_k;
 
-std::string SpeechSquadResources::get_model()
+    std::ifstream file(path);
+    if (!file)
+    {
+        LOG(FATAL) << "unable to open paragraphs file " << path;
+    }
+
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++)
+    {
+        auto tab = line.find('\t');
+        if (tab == std::string::npos)
+        {
+            LOG(FATAL) << path << ":" << number << ": expected <document id>\\t<paragraph>";
+        }
+        m_paragraph_index.Add(line.substr(0, tab), line.substr(tab + 1));
+    }
+    m_paragraph_index.Finalize();
+    LOG(INFO) << "registered " << m_paragraph_index.size() << " paragraphs for retrieval from " << path;
+}
+
+bool SpeechSquadResources::has_document(const std::string &document_id) const
 {
+    return document_id == "*" ? m_paragraph_index.size() > 0 : m_paragraph_index.has_document(document_id);
+}
 
-    return m_asr_model_name;
+std::vector<std::string> SpeechSquadResources::retrieve_contexts(const std::string &question, const std::string &document_id,
+                                                                 const std::vector<std::string> &paragraphs) const
+{
+    std::vector<std::string> contexts;
+    if (!paragraphs.empty())
+    {
+        // a small throw-away index over the candidates of this request
+        ParagraphIndex index;
+        for (const auto &paragraph : paragraphs)
+        {
+            index.Add("", paragraph);
+        }
+        index.Finalize();
+        for (auto id : index.Search(question, m_retrieval_top_k))
+        {
+            contexts.push_back(index.paragraph(id));
+        }
+        return contexts;
+    }
 
+    for (auto id : m_paragraph_index.Search(question, m_retrieval_top_k, document_id == "*" ? "" : document_id))
+    {
+        contexts.push_back(m_paragraph_index.paragraph(id));
+    }
+    return contexts;
 }
 
-std::unique_ptr<asr_client_t> SpeechSquadResources::create_asr_client(SpeechSquadContext *context)
+void SpeechSquadResources::retrieve_contexts_async(std::string question, std::string document_id, std::vector<std::string> paragraphs,
+                                                   std::function<void(std::vector<std::string>)> done)
 {
-    auto prepare_asr_fn = [asr_stub = get_stub(m_asr_stubs)](::grpc::ClientContext * context, ::grpc::CompletionQueue * cq) -> auto
+    auto retrieve = [this, question = std::move(question), document_id = std::move(document_id), paragraphs = std::move(paragraphs),
+                     done = std::move(done)] { done(retrieve_contexts(question, document_id, paragraphs)); };
+    if (m_fiber_workers)
     {
-        return std::move(asr_stub->PrepareAsyncStreamingRecognize(context, cq));
+        m_fiber_workers->enqueue(std::move(retrieve), current_numa_node());
+        return;
+    }
+    if (m_retrieval_threads)
+    {
+        m_retrieval_threads->enqueue(std::move(retrieve));
+        return;
+    }
+    retrieve();
+}
+
+void SpeechSquadResources::enable_retrieval_threads(int threads)
+{
+    CHECK_GT(threads, 0);
+    m_retrieval_threads = std::make_unique<::trtlab::ThreadPool>(threads);
+}
+
+void SpeechSquadResources::enable_fiber_workers(int workers)
+{
+    CHECK_GT(workers, 0);
+    m_fiber_workers = std::make_unique<FiberWorkers>(workers);
+    LOG(INFO) << "running speech squad stage logic on " << m_fiber_workers->size() << " fiber workers";
+}
+
+std::vector<std::pair<std::string, SpeechSquadResources::WarmupCall>> SpeechSquadResources::warmup_calls(std::shared_ptr<asr_stub_t> stub,
+                                                                                                      int audio_ms)
+{
+    const int sample_rate = 16000;
+    return {{"riva asr", [this, stub, audio_ms](::grpc::ClientContext* context) {
+                 auto stream = stub->StreamingRecognize(context);
+
+                 asr_request_t request;
+                 auto          streaming_config = request.mutable_streaming_config();
+                 streaming_config->set_interim_results(false);
+                 auto config = streaming_config->mutable_config();
+                 config->set_encoding(AudioEncoding::LINEAR_PCM);
+                 config->set_sample_rate_hertz(sample_rate);
+                 config->set_language_code("en-US");
+                 config->set_audio_channel_count(1);
+                 config->set_max_alternatives(1);
+                 config->set_model(m_asr_model_name);
+                 stream->Write(request);
+
+                 // silence in 100ms chunks
+                 for (int ms = 0; ms < audio_ms; ms += 100)
+                 {
+                     asr_request_t audio;
+                     audio.set_audio_content(std::string(sample_rate / 10 * sizeof(std::int16_t), '\0'));
+                     if (!stream->Write(audio))
+                     {
+                         break;
+                     }
+                 }
+                 stream->WritesDone();
+
+                 asr_response_t response;
+                 while (stream->Read(&response))
+                 {
+                 }
+                 return stream->Finish();
+             }}};
+}
+
+std::vector<std::pair<std::string, SpeechSquadResources::WarmupCall>> SpeechSquadResources::warmup_calls(std::shared_ptr<nlp_stub_t> stub, int)
+{
+    std::vector<std::pair<std::string, WarmupCall>> calls;
+    calls.emplace_back("riva nlp", [stub](::grpc::ClientContext* context) {
+        nlp_request_t request;
+        request.set_query("Which service answers the question?");
+        request.set_context("The question is transcribed by speech recognition and answered by the question answering service.");
+        nlp_response_t response;
+        return stub->NaturalQuery(context, request, &response);
+    });
+
+    for (const auto& stage : m_stage_graph.stages())
+    {
+        calls.emplace_back("riva nlp " + stage.name, [stub, stage](::grpc::ClientContext* context) {
+            text_request_t request;
+            request.add_text("which service answers the question");
+            request.set_top_n(1);
+            if (!stage.model.empty())
+            {
+                request.mutable_model()->set_model_name(stage.model);
+            }
+            text_response_t response;
+            return stage.method == TextStage::Method::PunctuateText ? stub->PunctuateText(context, request, &response)
+                                                                     : stub->TransformText(context, request, &response);
+        });
+    }
+    return calls;
+}
+
+std::vector<std::pair<std::string, SpeechSquadResources::WarmupCall>> SpeechSquadResources::warmup_calls(std::shared_ptr<tts_stub_t> stub, int)
+{
+    return {{"riva tts", [stub](::grpc::ClientContext* context) {
+                 tts_request_t request;
+                 request.set_text("The question answering service.");
+                 request.set_encoding(nvidia::riva::AudioEncoding::LINEAR_PCM);
+                 request.set_sample_rate_hz(tts_sample_rate_hz);
+                 request.set_language_code("en-US");
+                 request.set_voice_name(tts_voice_name);
+
+                 auto           stream = stub->SynthesizeOnline(context, request);
+                 tts_response_t response;
+                 while (stream->Read(&response))
+                 {
+                 }
+                 return stream->Finish();
+             }}};
+}
+
+bool SpeechSquadResources::warmup(int rounds, int audio_ms, std::chrono::milliseconds timeout)
+{
+    CHECK_GT(rounds, 0);
+
+    std::atomic<int>         calls{0}, failures{0};
+    std::vector<std::thread> threads;
+
+    // every channel is warmed on its own thread; the calls of a channel run back to back
+    auto warm = [&](const std::pair<std::string, WarmupCall>& call) {
+        threads.emplace_back([&, call] {
+            for (int i = 0; i < rounds; i++)
+            {
+                ::grpc::ClientContext context;
+                context.set_deadline(std::chrono::system_clock::now() + timeout);
+                auto status = call.second(&context);
+                calls++;
+                if (!status.ok())
+                {
+                    LOG(WARNING) << "warmup: " << call.first << " failed: " << status.error_message();
+                    failures++;
+                }
+            }
+        });
     };
 
-    return std::make_unique<asr_client_t>(context, prepare_asr_fn, m_client_executor);
+    for (const auto& stub : m_asr_stubs->stubs())
+    {
+        for (const auto& call : warmup_calls(stub, audio_ms))
+        {
+            warm(call);
+        }
+    }
+    for (const auto& stub : m_nlp_stubs->stubs())
+    {
+        for (const auto& call : warmup_calls(stub, audio_ms))
+        {
+            warm(call);
+        }
+    }
+    for (const auto& stub : m_tts_stubs->stubs())
+    {
+        for (const auto& call : warmup_calls(stub, audio_ms))
+        {
+            warm(call);
+        }
+    }
+
+    for (auto& thread : threads)
+    {
+        thread.join();
+    }
+    LOG(INFO) << "warmup: " << calls << " calls on " << threads.size() << " channels; " << failures << " failed";
+    return failures == 0;
+}
+
+void SpeechSquadResources::enable_channel_warmup(int rounds, int audio_ms, std::chrono::milliseconds timeout)
+{
+    CHECK_GT(rounds, 0);
+    m_channel_warmup = ChannelWarmup{rounds, audio_ms, timeout};
+}
+
+void SpeechSquadResources::enable_ingress_capture(const std::string& path, std::size_t max_file_bytes, int max_files,
+                                                  std::size_t max_queued_bytes)
+{
+    m_ingress_capture = std::make_unique<IngressCapture>(path, max_file_bytes, max_files, max_queued_bytes);
+    LOG(INFO) << "capturing incoming squad streams to " << path << ".*";
+}
+
+void SpeechSquadResources::enable_slo_tracking(const std::string& budgets, int window_s, int sample_every)
+{
+    m_slo_tracker = std::make_unique<SloTracker>(budgets, window_s, sample_every);
+    LOG(INFO) << "tracking latency budgets " << budgets << " over " << window_s << "s";
 }
 
-std::unique_ptr<nlp_client_t> SpeechSquadResources::create_nlp_client(SpeechSquadContext *context)
+void SpeechSquadResources::enable_degradation(const std::string& thresholds, double hysteresis, int tts_sample_rate, int tts_max_chars)
 {
-    auto prepare_nlp_fn = [nlp_stub = get_stub(m_nlp_stubs)](::grpc::ClientContext * context, const nlp_request_t &request,
-                                                             ::grpc::CompletionQueue *cq) -> auto
+    m_degradation = std::make_unique<Degradation>(thresholds, hysteresis, tts_sample_rate, tts_max_chars);
+    LOG(INFO) << "degrading streams at pressures " << thresholds << "; tts at " << tts_sample_rate << " hz, answers cut to "
+              << tts_max_chars << " chars";
+}
+
+void SpeechSquadResources::enable_span_export(const std::string& path, std::size_t max_queued_spans)
+{
+    m_span_exporter = std::make_unique<SpanExporter>(path, max_queued_spans);
+}
+
+void SpeechSquadResources::enable_memory_limits(std::size_t global_bytes, std::size_t stream_bytes, std::size_t asr_queue_bytes)
+{
+    LOG(INFO) << "buffered bytes bounded to " << global_bytes << " for the server, " << stream_bytes << " per stream and "
+              << asr_queue_bytes << " queued per riva asr stream (0 is unbounded)";
+    m_memory_budget       = std::make_unique<MemoryBudget>(global_bytes);
+    m_stream_memory_limit = stream_bytes;
+    m_asr_queue_limit     = asr_queue_bytes;
+}
+
+void SpeechSquadResources::enable_dispatch_classes(std::vector<DispatchClass> classes, const std::string& default_class,
+                                                   int max_inflight)
+{
+    auto found = std::find_if(classes.begin(), classes.end(), [&](const DispatchClass& cls) { return cls.name == default_class; });
+    if (found == classes.end())
+    {
+        LOG(FATAL) << "default stream class " << default_class << " is not one of the stream classes";
+    }
+    std::stringstream names;
+    for (const auto& cls : classes)
     {
+        names << " " << cls.name << ":" << cls.weight;
+    }
+    LOG(INFO) << "scheduling riva nlp and tts calls over stream classes" << names.str() << "; "
+              << (max_inflight ? std::to_string(max_inflight) + " in flight" : std::string("unbounded"));
+    auto index           = found - classes.begin();
+    m_dispatch_scheduler = std::make_unique<DispatchScheduler>(std::move(classes), index, max_inflight);
+}
+
+std::unique_ptr<nlp_client_t> SpeechSquadResources::create_nlp_client(SpeechSquadContext *context, int window, const std::string &squad_context)
+{
+    auto issued = (m_nlp_affinity_load_factor > 0 ? m_nlp_stubs->get(std::hash<std::string>()(squad_context), m_nlp_affinity_load_factor)
+                                                  : m_nlp_stubs->get());
+
+    auto prepare_nlp_fn = [nlp_stub = std::move(issued.stub), trace = traceparent(context)](::grpc::ClientContext * context, const nlp_request_t &request,
+                                                                                      ::grpc::CompletionQueue *cq) -> auto
+    {
+        if (!trace.empty())
+        {
+            context->AddMetadata("traceparent", trace);
+        }
         return std::move(nlp_stub->PrepareAsyncNaturalQuery(context, request, cq));
     };
 
-    return std::make_unique<nlp_client_t>(context, prepare_nlp_fn, m_client_executor);
+    return std::make_unique<nlp_client_t>(context, window, std::move(issued.call), prepare_nlp_fn, client_executor());
+}
+
+void SpeechSquadResources::set_stage_graph(StageGraph graph)
+{
+    m_stage_graph = std::move(graph);
+}
+
+std::unique_ptr<text_client_t> SpeechSquadResources::create_text_client(SpeechSquadContext *context, int stage)
+{
+    auto method = m_stage_graph.stages()[stage].method;
+    auto issued = m_nlp_stubs->get();
+
+    auto prepare_text_fn = [nlp_stub = std::move(issued.stub), method, trace = traceparent(context)](
+                               ::grpc::ClientContext * context, const text_request_t &request, ::grpc::CompletionQueue *cq) -> auto
+    {
+        if (!trace.empty())
+        {
+            context->AddMetadata("traceparent", trace);
+        }
+        if (method == TextStage::Method::PunctuateText)
+        {
+            return std::move(nlp_stub->PrepareAsyncPunctuateText(context, request, cq));
+        }
+        return std::move(nlp_stub->PrepareAsyncTransformText(context, request, cq));
+    };
+
+    return std::make_unique<text_client_t>(context, stage, std::move(issued.call), prepare_text_fn, client_executor());
 }
 
 std::unique_ptr<tts_client_t> SpeechSquadResources::create_tts_client(SpeechSquadContext *context)
 {
-    auto prepare_tts_fn = [tts_stub = get_stub(m_tts_stubs)](::grpc::ClientContext * context, const tts_request_t &request,
-                                                             ::grpc::CompletionQueue *cq) -> auto
+    auto issued = m_tts_stubs->get();
+
+    auto prepare_tts_fn = [tts_stub = std::move(issued.stub), trace = traceparent(context)](::grpc::ClientContext * context, const tts_request_t &request,
+                                                                                         ::grpc::CompletionQueue *cq) -> auto
     {
+        if (!trace.empty())
+        {
+            context->AddMetadata("traceparent", trace);
+        }
         return std::move(tts_stub->PrepareAsyncSynthesizeOnline(context, request, cq));
     };
 
-    return std::make_unique<tts_client_t>(context, prepare_tts_fn, m_client_executor);
+    return std::make_unique<tts_client_t>(context, std::move(issued.call), prepare_tts_fn, client_executor());
 }
@@ -1,4 +1,5 @@
 #pragma once
+#include <future>
 #include <memory>
 #include <vector>
 
@@ -6,6 +7,7 @@
 
 #include <trtlab/core/resources.h>
 #include <trtlab/core/pool.h>
+#include <trtlab/core/thread_pool.h>
 
 #include <nvrpc/client/executor.h>
 #include <nvrpc/client/client_unary.h>
@@ -13,7 +15,21 @@
 #include <nvrpc/client/client_single_up_multiple_down.h>
 
 #include "settings.h"
+#include "asr_stream_pool.h"
 #include "clients.h"
+#include "degradation.h"
+#include "dispatch_scheduler.h"
+#include "fiber_workers.h"
+#include "ingress_capture.h"
+#include "memory_budget.h"
+#include "numa.h"
+#include "paragraph_index.h"
+#include "service_pool.h"
+#include "slo_tracker.h"
+#include "span_exporter.h"
+#include "stage_calls.h"
+#include "stage_latencies.h"
+#include "stage_graph.h"
 
 namespace demo
 {
@@ -23,29 +39,257 @@ namespace demo
 
     using asr_client_t = ASRClient;
     using nlp_client_t = NLPClient;
+    using text_client_t = TextClient;
     using tts_client_t = TTSClient;
 
+    using asr_stub_t = nvidia::riva::asr::RivaSpeechRecognition::Stub;
+    using nlp_stub_t = nvidia::riva::nlp::RivaLanguageUnderstanding::Stub;
+    using tts_stub_t = nvidia::riva::tts::RivaSpeechSynthesis::Stub;
+
+    // voice and sample rate of the riva tts calls, squad streams and warmup alike
+    constexpr char tts_voice_name[]   = "ljspeech";
+    constexpr int  tts_sample_rate_hz = 22050;
+
     class SpeechSquadResources : public ::trtlab::Resources
     {
     public:
-        SpeechSquadResources(std::string asr_url, std::string nlp_url, std::string tts_url, int threads, int channels, std::string asr_model_name);
+        // each url is a comma separated list of targets; with resolve_endpoints set, host names are
+        // expanded to one channel group per address and re-resolved by refresh_endpoints().
+        // client_executors holds one executor per numa node, or a single unpinned executor.
+        SpeechSquadResources(std::string asr_url, std::string nlp_url, std::string tts_url,
+                             std::vector<std::shared_ptr<nvrpc::client::Executor>> client_executors, ChannelLimits channels,
+                             bool resolve_endpoints, std::string asr_model_name);
         ~SpeechSquadResources() override;
 
+        // record every downstream riva call to a vcr log; must precede construction, since the
+        // recording interceptors are attached when the channels are created
+        static void record_downstream(const std::string& path);
+
+        // the executor of the numa node the calling thread runs on, so the downstream calls of a
+        // stream complete on the node that serves it (see current_numa_node())
         std::shared_ptr<nvrpc::client::Executor> client_executor()
         {
-            return m_client_executor;
+            return m_client_executors[client_node()];
         }
 
         std::unique_ptr<asr_client_t> create_asr_client(SpeechSquadContext*);
-        std::unique_ptr<nlp_client_t> create_nlp_client(SpeechSquadContext*);
+        std::unique_ptr<nlp_client_t> create_nlp_client(SpeechSquadContext*, int window, const std::string& squad_context);
+        std::unique_ptr<text_client_t> create_text_client(SpeechSquadContext*, int stage);
         std::unique_ptr<tts_client_t> create_tts_client(SpeechSquadContext*);
         std::string                   get_model();
+
+        // keep per_channel pre-opened asr streams for every asr channel; create_asr_client
+        // checks a stream out of the pool before opening a new one. with numa pinning every node
+        // has its own pool, whose streams complete on the client executor of that node, and the
+        // streams are split over the nodes like the threads
+        void enable_asr_stream_pool(int per_channel, std::chrono::milliseconds max_idle);
+
+        // route nlp requests for the same squad context to the same channel, so a replica's
+        // tokenization/encoder cache sees its contexts again; load_factor bounds the skew
+        void enable_nlp_affinity(double load_factor);
+
+        // split squad contexts longer than window words into windows overlapping by overlap words,
+        // each queried concurrently; an answer scoring at least accept_score ends the fan-out
+        void enable_nlp_windowing(int window, int overlap, float accept_score);
+
+        // the squad context windows to query; the whole context when windowing is disabled
+        std::vector<std::string> nlp_windows(const std::string& squad_context) const;
+
+        float nlp_accept_score() const
+        {
+            return m_nlp_accept_score;
+        }
+
+        // register the paragraphs of a tab separated "<document id>\t<paragraph>" file for retrieval;
+        // the top_k best bm25 matches of a question are sent to nlp
+        void load_paragraphs(const std::string& path, int top_k);
+
+        bool has_document(const std::string& document_id) const;
+
+        // best matching paragraphs for the question from a registered document ("*" for every
+        // registered paragraph) or from the given candidates when paragraphs is not empty
+        std::vector<std::string> retrieve_contexts(const std::string& question, const std::string& document_id,
+                                                   const std::vector<std::string>& paragraphs) const;
+
+        // retrieve_contexts() off the calling thread: on the fiber workers of its numa node, else on
+        // the retrieval threads, else inline. done is called with the contexts on that thread
+        void retrieve_contexts_async(std::string question, std::string document_id, std::vector<std::string> paragraphs,
+                                     std::function<void(std::vector<std::string>)> done);
+
+        // threads for retrieve_contexts_async() while the fiber workers are disabled
+        void enable_retrieval_threads(int threads);
+
+        // insert the text stages of the graph into the pipeline; text stages call the riva nlp service
+        void set_stage_graph(StageGraph graph);
+
+        const StageGraph& stage_graph() const
+        {
+            return m_stage_graph;
+        }
+
+        // run the per-stream stage logic on fiber workers instead of the completion queue threads
+        void enable_fiber_workers(int workers);
+
+        // nullptr when stage logic runs on the completion queue threads
+        FiberWorkers* fiber_workers()
+        {
+            return m_fiber_workers.get();
+        }
+
+        // schedule the riva nlp, text stage and tts calls of the streams by stream class, with at most
+        // max_inflight in flight (0 for no bound); streams without a known class are default_class
+        void enable_dispatch_classes(std::vector<DispatchClass> classes, const std::string& default_class, int max_inflight);
+
+        // a single class admitting every call unless enable_dispatch_classes was called
+        DispatchScheduler& dispatch_scheduler()
+        {
+            return *m_dispatch_scheduler;
+        }
+
+        // bound the bytes buffered by all streams (global_bytes), by one stream (stream_bytes) and the asr
+        // audio outstanding on one riva asr stream (asr_queue_bytes); 0 leaves a bound off. audio past
+        // asr_queue_bytes is held back until riva asr takes the earlier writes
+        void enable_memory_limits(std::size_t global_bytes, std::size_t stream_bytes, std::size_t asr_queue_bytes);
+
+        MemoryBudget& memory_budget()
+        {
+            return *m_memory_budget;
+        }
+
+        std::size_t stream_memory_limit() const
+        {
+            return m_stream_memory_limit;
+        }
+
+        std::size_t asr_queue_limit() const
+        {
+            return m_asr_queue_limit;
+        }
+
+        // check every finished or cancelled stream against the latency budgets, see SloTracker
+        void enable_slo_tracking(const std::string& budgets, int window_s, int sample_every);
+
+        // nullptr unless slo tracking is enabled
+        SloTracker* slo_tracker()
+        {
+            return m_slo_tracker.get();
+        }
+
+        // degrade new streams by tier as the pressure of the server rises, see Degradation
+        void enable_degradation(const std::string& thresholds, double hysteresis, int tts_sample_rate, int tts_max_chars);
+
+        // nullptr unless degradation is enabled
+        Degradation* degradation()
+        {
+            return m_degradation.get();
+        }
+
+        // recent stage latencies of the finished streams, for the load reports
+        StageLatencies& stage_latencies()
+        {
+            return m_stage_latencies;
+        }
+
+        // riva calls queued and in flight per stage, for the load reports
+        StageCalls& stage_calls()
+        {
+            return m_stage_calls;
+        }
+
+        // export the spans of every stream to an OTLP/JSON file, see SpanExporter
+        void enable_span_export(const std::string& path, std::size_t max_queued_spans);
+
+        // nullptr unless span export is enabled
+        SpanExporter* span_exporter()
+        {
+            return m_span_exporter.get();
+        }
+
+        // append every incoming squad request to rotating capture files for replay by the perf client
+        void enable_ingress_capture(const std::string& path, std::size_t max_file_bytes, int max_files, std::size_t max_queued_bytes);
+
+        // nullptr unless ingress capture is enabled
+        IngressCapture* ingress_capture()
+        {
+            return m_ingress_capture.get();
+        }
+
+        // sends rounds of synthetic asr (audio_ms of silence), nlp, text stage and tts calls through
+        // every downstream channel, each call bounded by timeout; false if any call failed
+        bool warmup(int rounds, int audio_ms, std::chrono::milliseconds timeout);
+
+        // channels created from now on, as resize_channels() and refresh_endpoints() grow the pools, take
+        // the same warmup calls before they are added; a channel that fails one is not added
+        void enable_channel_warmup(int rounds, int audio_ms, std::chrono::milliseconds timeout);
+
+        // grow/shrink the downstream channels against the in-flight watermarks
+        void resize_channels();
+
+        // re-resolve the downstream service targets and add/drain endpoint groups
+        void refresh_endpoints();
+
+        // runs refresh_endpoints() when refresh is set, then resize_channels(), on a background thread,
+        // since name lookups and new channels block; false while the previous update is still running
+        bool update_channels_async(bool refresh);
+
+        // in-flight streams per channel for each downstream service endpoint
+        std::map<std::string, std::vector<long>> channel_stream_counts() const;
+
     private:
-        std::string                                                        m_asr_model_name;
-        std::shared_ptr<nvrpc::client::Executor>                           m_client_executor;
-        std::vector<std::shared_ptr<nvidia::riva::asr::RivaSpeechRecognition::Stub>> m_asr_stubs;
-        std::vector<std::shared_ptr<nvidia::riva::nlp::RivaLanguageUnderstanding::Stub>> m_nlp_stubs;
-        std::vector<std::shared_ptr<nvidia::riva::tts::RivaSpeechSynthesis::Stub>> m_tts_stubs;
+        // index of the client executor, and asr stream pool, of the calling thread's numa node
+        std::size_t client_node()
+        {
+            return m_client_executors.size() == 1 ? 0 : current_numa_node() % m_client_executors.size();
+        }
+
+        // opens the stream on the issued channel
+        std::unique_ptr<asr_client_t> new_asr_client(SpeechSquadContext*, IssuedStub<asr_stub_t>,
+                                                     std::shared_ptr<nvrpc::client::Executor>);
+
+        // the warmup calls of one channel, by name; audio_ms of silence are streamed to riva asr
+        using WarmupCall = std::function<::grpc::Status(::grpc::ClientContext*)>;
+        std::vector<std::pair<std::string, WarmupCall>> warmup_calls(std::shared_ptr<asr_stub_t>, int audio_ms);
+        std::vector<std::pair<std::string, WarmupCall>> warmup_calls(std::shared_ptr<nlp_stub_t>, int audio_ms);
+        std::vector<std::pair<std::string, WarmupCall>> warmup_calls(std::shared_ptr<tts_stub_t>, int audio_ms);
+
+        // new_stub, then the channel warmup; nullptr if either fails
+        template <typename Service>
+        std::shared_ptr<typename Service::Stub> new_warm_stub(const std::string& url);
+
+        struct ChannelWarmup
+        {
+            int                       rounds; // 0 while disabled
+            int                       audio_ms;
+            std::chrono::milliseconds timeout;
+        };
+
+        std::string                              m_asr_model_name;
+        std::vector<std::shared_ptr<nvrpc::client::Executor>> m_client_executors;
+        std::unique_ptr<ServicePool<asr_stub_t>> m_asr_stubs;
+        std::unique_ptr<ServicePool<nlp_stub_t>> m_nlp_stubs;
+        std::unique_ptr<ServicePool<tts_stub_t>> m_tts_stubs;
+        std::vector<std::unique_ptr<ASRStreamPool>> m_asr_stream_pools; // by client executor; nullptr for none
+        std::unique_ptr<FiberWorkers>            m_fiber_workers;
+        std::unique_ptr<::trtlab::ThreadPool>    m_retrieval_threads;
+        std::unique_ptr<IngressCapture>          m_ingress_capture;
+        std::unique_ptr<DispatchScheduler>       m_dispatch_scheduler;
+        std::unique_ptr<MemoryBudget>            m_memory_budget;
+        std::unique_ptr<SloTracker>              m_slo_tracker;
+        std::unique_ptr<SpanExporter>            m_span_exporter;
+        std::unique_ptr<Degradation>             m_degradation;
+        std::size_t                              m_stream_memory_limit;
+        std::size_t                              m_asr_queue_limit;
+        StageGraph                               m_stage_graph;
+        StageLatencies                           m_stage_latencies;
+        StageCalls                               m_stage_calls;
+        double                                   m_nlp_affinity_load_factor;
+        int                                      m_nlp_window;
+        int                                      m_nlp_window_overlap;
+        float                                    m_nlp_accept_score;
+        ParagraphIndex                           m_paragraph_index;
+        int                                      m_retrieval_top_k;
+        std::future<void>                        m_channel_update;
+        ChannelWarmup                            m_channel_warmup;
     };
 
 } // namespace demo
@@ -0,0 +1,301 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+#include "endpoints.h"
+#include "stub_pool.h"
+
+namespace demo
+{
+    // the stubs of one downstream riva service, grouped per endpoint. the service is given as a
+    // comma separated list of targets; with resolve set, host names are expanded to one group per
+    // address and refresh() adds groups for new addresses and drains groups for vanished ones.
+    // the channel limits are for the whole service and are split across the endpoints a group
+    // is connected alongside.
+    template <typename Stub>
+    class ServicePool
+    {
+        using Pool = StubPool<Stub>;
+
+    public:
+        // creates a stub on a new channel to the given target; nullptr if it is not ready
+        using StubFactory = std::function<std::shared_ptr<Stub>(const std::string&)>;
+
+        ServicePool(std::string name, std::string urls, bool resolve, StubFactory factory, ChannelLimits limits)
+        : m_name(std::move(name)), m_urls(split_endpoints(urls)), m_resolve(resolve), m_factory(std::move(factory)), m_limits(limits)
+        {
+            refresh();
+        }
+
+        const std::string& name() const
+        {
+            return m_name;
+        }
+
+        // number of endpoint groups
+        std::size_t endpoints() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_pools.size();
+        }
+
+        // number of channels over all endpoints
+        std::size_t size() const
+        {
+            std::size_t size = 0;
+            for (const auto& pool : pools())
+            {
+                size += pool->size();
+            }
+            return size;
+        }
+
+        // power of two choices over endpoints, then over the channels of the chosen endpoint
+        IssuedStub<Stub> get() const
+        {
+            auto pools = this->pools();
+            CHECK(!pools.empty()) << m_name << ": no endpoints connected";
+
+            if (pools.size() == 1)
+            {
+                return pools[0]->get();
+            }
+
+            auto& p1 = pools[random_range(pools.size())];
+            auto& p2 = pools[random_range(pools.size())];
+            return (load(*p1) * p2->size() < load(*p2) * p1->size() ? p1 : p2)->get();
+        }
+
+        // rendezvous hashing with bounded load over endpoints, then over their channels
+        IssuedStub<Stub> get(std::uint64_t key, double load_factor) const
+        {
+            std::vector<std::string>           names;
+            std::vector<std::shared_ptr<Pool>> pools;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (const auto& it : m_pools)
+                {
+                    names.push_back(it.first);
+                    pools.push_back(it.second);
+                }
+            }
+            CHECK(!pools.empty()) << m_name << ": no endpoints connected";
+
+            if (pools.size() == 1)
+            {
+                return pools[0]->get(key, load_factor);
+            }
+
+            long total = 0;
+            std::vector<long> loads;
+            for (const auto& pool : pools)
+            {
+                loads.push_back(load(*pool));
+                total += loads.back();
+            }
+            auto bound = (long)std::ceil(load_factor * (total + 1) / pools.size());
+
+            int           preferred = -1, least_loaded = 0;
+            std::uint64_t best_score = 0;
+            for (int i = 0; i < (int)pools.size(); i++)
+            {
+                if (loads[i] < loads[least_loaded])
+                {
+                    least_loaded = i;
+                }
+                if (loads[i] >= bound)
+                {
+                    continue;
+                }
+                auto score = mix_hash(key ^ std::hash<std::string>()(names[i]));
+                if (preferred < 0 || score > best_score)
+                {
+                    preferred  = i;
+                    best_score = score;
+                }
+            }
+            return pools[preferred < 0 ? least_loaded : preferred]->get(key, load_factor);
+        }
+
+        // counts a call on the given channel; the stub is null if the channel left the service
+        IssuedStub<Stub> get(const std::shared_ptr<Stub>& stub) const
+        {
+            for (const auto& pool : pools())
+            {
+                auto issued = pool->get(stub);
+                if (issued.stub)
+                {
+                    return issued;
+                }
+            }
+            return IssuedStub<Stub>();
+        }
+
+        // the channels of every endpoint
+        std::vector<std::shared_ptr<Stub>> stubs() const
+        {
+            std::vector<std::shared_ptr<Stub>> stubs;
+            for (const auto& pool : pools())
+            {
+                auto channels = pool->stubs();
+                stubs.insert(stubs.end(), channels.begin(), channels.end());
+            }
+            return stubs;
+        }
+
+        // resize the channels of every endpoint against the in-flight watermarks
+        void resize()
+        {
+            for (const auto& pool : pools())
+            {
+                pool->resize();
+            }
+        }
+
+        // re-resolve the service targets; endpoints that disappeared stop receiving new streams and
+        // are released once their in-flight streams complete. a target whose lookup fails keeps the
+        // endpoints it stood for before, and vanished endpoints are only drained once one of the
+        // current endpoints is connected, so the service is never left without channels. blocks on
+        // name resolution and new channels; refreshes run one at a time.
+        void refresh()
+        {
+            std::lock_guard<std::mutex> refreshing(m_refresh_mutex);
+
+            std::vector<std::string> endpoints;
+            for (const auto& url : m_urls)
+            {
+                auto resolved = resolve_endpoints(url, m_resolve);
+                if (resolved.empty())
+                {
+                    resolved = m_resolved[url];
+                    LOG_IF(WARNING, !resolved.empty()) << m_name << ": keeping the previous endpoints of " << url;
+                }
+                m_resolved[url] = resolved;
+                endpoints.insert(endpoints.end(), resolved.begin(), resolved.end());
+            }
+            std::sort(endpoints.begin(), endpoints.end());
+            endpoints.erase(std::unique(endpoints.begin(), endpoints.end()), endpoints.end());
+            if (endpoints.empty())
+            {
+                LOG(WARNING) << m_name << ": no endpoints resolved; keeping the current set";
+                return;
+            }
+
+            std::vector<std::string> added;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for (const auto& endpoint : endpoints)
+                {
+                    if (m_pools.find(endpoint) == m_pools.end())
+                    {
+                        added.push_back(endpoint);
+                    }
+                }
+            }
+
+            // channels are established outside the lock; endpoints that fail are retried on the next refresh
+            std::map<std::string, std::shared_ptr<Pool>> connected;
+            auto                                         limits = endpoint_limits(endpoints.size());
+            for (const auto& endpoint : added)
+            {
+                auto pool = std::make_shared<Pool>(
+                    m_name + " " + endpoint, [this, endpoint] { return m_factory(endpoint); }, limits);
+                if (pool->size() < (std::size_t)limits.min_channels)
+                {
+                    LOG(ERROR) << m_name << ": failed to connect to " << endpoint;
+                    continue;
+                }
+                LOG(INFO) << m_name << ": connection established to " << endpoint;
+                connected[endpoint] = std::move(pool);
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pools.insert(connected.begin(), connected.end());
+
+            bool replaced = std::any_of(endpoints.begin(), endpoints.end(),
+                                        [this](const std::string& endpoint) { return m_pools.count(endpoint) > 0; });
+            for (auto it = m_pools.begin(); it != m_pools.end();)
+            {
+                if (std::find(endpoints.begin(), endpoints.end(), it->first) == endpoints.end())
+                {
+                    if (!replaced)
+                    {
+                        LOG(WARNING) << m_name << ": keeping vanished endpoint " << it->first << " until a current one connects";
+                        it++;
+                        continue;
+                    }
+                    LOG(INFO) << m_name << ": draining endpoint " << it->first;
+                    it = m_pools.erase(it);
+                    continue;
+                }
+                it++;
+            }
+        }
+
+        // in-flight streams per channel, keyed by "<service> <endpoint>"
+        std::map<std::string, std::vector<long>> stream_counts() const
+        {
+            std::map<std::string, std::vector<long>> counts;
+            for (const auto& pool : pools())
+            {
+                counts[pool->name()] = pool->stream_counts();
+            }
+            return counts;
+        }
+
+    private:
+        std::vector<std::shared_ptr<Pool>> pools() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<std::shared_ptr<Pool>> pools;
+            pools.reserve(m_pools.size());
+            for (const auto& it : m_pools)
+            {
+                pools.push_back(it.second);
+            }
+            return pools;
+        }
+
+        // the service limits split across count endpoints, rounded up so that every endpoint keeps a channel
+        ChannelLimits endpoint_limits(std::size_t count) const
+        {
+            auto limits         = m_limits;
+            auto share          = [count](int channels) { return std::max(1, (int)((channels + count - 1) / count)); };
+            limits.min_channels = share(m_limits.min_channels);
+            limits.max_channels = std::max(limits.min_channels, share(m_limits.max_channels));
+            return limits;
+        }
+
+        static long load(const Pool& pool)
+        {
+            long total = 0;
+            for (auto count : pool.stream_counts())
+            {
+                total += count;
+            }
+            return total;
+        }
+
+        std::string              m_name;
+        std::vector<std::string> m_urls;
+        bool                     m_resolve;
+        StubFactory              m_factory;
+        ChannelLimits            m_limits;
+
+        mutable std::mutex                           m_mutex;
+        std::map<std::string, std::shared_ptr<Pool>> m_pools;
+
+        // serializes refresh(); the endpoints every target last resolved to
+        std::mutex                                      m_refresh_mutex;
+        std::map<std::string, std::vector<std::string>> m_resolved;
+    };
+
+} // namespace demo
@@ -18,7 +18,6 @@
 namespace demo
 {
     using thread_t = trtlab::userspace_threads;
-    using executor_t = nvrpc::Executor;
 
     using asr_request_t = nvidia::riva::asr::StreamingRecognizeRequest;
     using asr_response_t = nvidia::riva::asr::StreamingRecognizeResponse;
@@ -26,6 +25,9 @@ namespace demo
     using nlp_request_t = nvidia::riva::nlp::NaturalQueryRequest;
     using nlp_response_t = nvidia::riva::nlp::NaturalQueryResponse;
 
+    using text_request_t = nvidia::riva::nlp::TextTransformRequest;
+    using text_response_t = nvidia::riva::nlp::TextTransformResponse;
+
     using tts_request_t = nvidia::riva::tts::SynthesizeSpeechRequest;
     using tts_response_t = nvidia::riva::tts::SynthesizeSpeechResponse;
 
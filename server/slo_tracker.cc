@@ -0,0 +1,125 @@
+#include "slo_tracker.h"
+
+#include <sstream>
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+static std::int64_t now_s()
+{
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+SloTracker::SloTracker(const std::string& budgets, int window_s, int sample_every)
+: m_window_s(window_s), m_sample_every(sample_every), m_breaches(0)
+{
+    CHECK_GT(window_s, 0);
+    CHECK_GE(sample_every, 0);
+
+    std::stringstream entries(budgets);
+    std::string       entry;
+    while (std::getline(entries, entry, ','))
+    {
+        auto colon = entry.find(':');
+        auto ms    = colon == std::string::npos ? 0.f : std::atof(entry.c_str() + colon + 1);
+        if (colon == 0 || ms <= 0)
+        {
+            LOG(FATAL) << "latency budget \"" << entry << "\": expected <e2e or stage>:<ms>";
+        }
+        m_budgets[entry.substr(0, colon)] = ms;
+    }
+}
+
+SloTracker::Result SloTracker::Check(float e2e_ms, const std::map<std::string, float>& stage_ms)
+{
+    Result result;
+    result.sampled = false;
+
+    // the stage furthest over its budget, else the slowest
+    std::string worst, slowest;
+    float       worst_overrun = 0, slowest_ms = -1;
+    for (const auto& stage : stage_ms)
+    {
+        if (stage.second > slowest_ms)
+        {
+            slowest    = stage.first;
+            slowest_ms = stage.second;
+        }
+        auto budget = m_budgets.find(stage.first);
+        if (budget != m_budgets.end() && stage.second > budget->second)
+        {
+            auto overrun                 = stage.second - budget->second;
+            result.overruns[stage.first] = overrun;
+            if (overrun > worst_overrun)
+            {
+                worst         = stage.first;
+                worst_overrun = overrun;
+            }
+        }
+    }
+    auto e2e = m_budgets.find("e2e");
+    if (e2e != m_budgets.end() && e2e_ms > e2e->second)
+    {
+        result.overruns["e2e"] = e2e_ms - e2e->second;
+        result.culprit         = worst.empty() ? slowest : worst;
+    }
+
+    auto                        second = now_s();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& budget : m_budgets)
+    {
+        bool checked = budget.first == "e2e" || stage_ms.count(budget.first);
+        Count(budget.first, second, checked, result.overruns.count(budget.first), budget.first == result.culprit);
+    }
+    if (!result.culprit.empty() && !m_budgets.count(result.culprit))
+    {
+        // a stage without a budget of its own
+        Count(result.culprit, second, false, false, true);
+    }
+    if (!result.overruns.empty() && m_sample_every > 0)
+    {
+        result.sampled = m_breaches++ % m_sample_every == 0;
+    }
+    return result;
+}
+
+void SloTracker::Count(const std::string& budget, std::int64_t second, bool checked, bool breached, bool culprit)
+{
+    auto& buckets = m_buckets[budget];
+    if (buckets.empty())
+    {
+        buckets.assign(m_window_s, Bucket{-1, 0, 0, 0});
+    }
+    auto& bucket = buckets[second % m_window_s];
+    if (bucket.second != second)
+    {
+        bucket = Bucket{second, 0, 0, 0};
+    }
+    bucket.streams += checked;
+    bucket.breaches += breached;
+    bucket.culprit += culprit;
+}
+
+std::vector<SloTracker::Stats> SloTracker::stats()
+{
+    std::vector<Stats>          stats;
+    auto                        second = now_s();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& buckets : m_buckets)
+    {
+        auto  budget = m_budgets.find(buckets.first);
+        Stats entry{buckets.first, budget == m_budgets.end() ? 0.f : budget->second, 0, 0, 0};
+        for (const auto& bucket : buckets.second)
+        {
+            if (bucket.second > second - m_window_s)
+            {
+                entry.streams += bucket.streams;
+                entry.breaches += bucket.breaches;
+                entry.culprit += bucket.culprit;
+            }
+        }
+        stats.push_back(entry);
+    }
+    return stats;
+}
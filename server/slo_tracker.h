@@ -0,0 +1,75 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace demo
+{
+    // latency budgets of the squad streams: "e2e" for the whole stream and one per stage, keyed like the
+    // stage latencies of the context ("asr" to the final transcript, "nlp", "tts" to the first audio,
+    // "retrieval" and the text stage names). breaches are counted over a rolling window of one second
+    // buckets; a breach of the e2e budget is attributed to the stage furthest over its own budget, or to
+    // the slowest stage when none is
+    class SloTracker
+    {
+    public:
+        struct Result
+        {
+            std::map<std::string, float> overruns; // ms over budget of every breached budget
+            std::string                  culprit;  // the stage an e2e breach is attributed to; empty if e2e held
+            bool                         sampled;  // the timeline of the stream should be logged
+        };
+
+        struct Stats
+        {
+            std::string   budget;
+            float         budget_ms;
+            std::uint64_t streams;  // streams checked against the budget in the window
+            std::uint64_t breaches; // of which over budget
+            std::uint64_t culprit;  // e2e breaches attributed to this stage
+        };
+
+        // "name:ms,..." e.g. "e2e:1500,asr:150,nlp:50,tts:100"; a breaching stream's timeline is logged
+        // once in every sample_every breaches (0 never)
+        SloTracker(const std::string& budgets, int window_s, int sample_every);
+
+        bool empty() const
+        {
+            return m_budgets.empty();
+        }
+
+        const std::map<std::string, float>& budgets() const
+        {
+            return m_budgets;
+        }
+
+        Result Check(float e2e_ms, const std::map<std::string, float>& stage_ms);
+
+        // one entry per budget, and per stage blamed for e2e breaches without a budget (budget_ms 0),
+        // over the rolling window
+        std::vector<Stats> stats();
+
+    private:
+        struct Bucket
+        {
+            std::int64_t  second;
+            std::uint64_t streams;
+            std::uint64_t breaches;
+            std::uint64_t culprit;
+        };
+
+        void Count(const std::string& budget, std::int64_t second, bool checked, bool breached, bool culprit);
+
+        std::map<std::string, float> m_budgets;
+        int                          m_window_s;
+        int                          m_sample_every;
+
+        std::mutex                                 m_mutex;
+        std::map<std::string, std::vector<Bucket>> m_buckets; // m_window_s buckets per budget, by second
+        std::uint64_t                              m_breaches;
+    };
+
+} // namespace demo
@@ -0,0 +1,186 @@
+#include "span_exporter.h"
+
+#include <algorithm>
+#include <cctype>
+#include <random>
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+static std::string random_hex(int digits)
+{
+    thread_local std::mt19937_64 generator(std::random_device{}());
+    static const char            hex[] = "0123456789abcdef";
+
+    std::string id;
+    while ((int)id.size() < digits)
+    {
+        auto bits = generator();
+        for (int i = 0; i < 16 && (int)id.size() < digits; i++, bits >>= 4)
+        {
+            id.push_back(hex[bits & 0xf]);
+        }
+    }
+    // all zero ids are invalid
+    if (std::all_of(id.begin(), id.end(), [](char c) { return c == '0'; }))
+    {
+        id.back() = '1';
+    }
+    return id;
+}
+
+static bool is_id(const std::string& text, std::size_t digits)
+{
+    return text.size() == digits && std::all_of(text.begin(), text.end(), [](char c) { return std::isxdigit(c) && !std::isupper(c); }) &&
+           !std::all_of(text.begin(), text.end(), [](char c) { return c == '0'; });
+}
+
+TraceContext TraceContext::Continue(const std::string& incoming)
+{
+    TraceContext context;
+    context.span_id = NewSpanId();
+
+    if (incoming.size() == 55 && incoming.compare(0, 3, "00-") == 0 && incoming[35] == '-' && incoming[52] == '-' &&
+        is_id(incoming.substr(3, 32), 32) && is_id(incoming.substr(36, 16), 16))
+    {
+        context.trace_id       = incoming.substr(3, 32);
+        context.parent_span_id = incoming.substr(36, 16);
+        return context;
+    }
+    if (is_id(incoming, 32))
+    {
+        context.trace_id = incoming;
+        return context;
+    }
+    LOG_IF(WARNING, !incoming.empty()) << "ignoring malformed trace id " << incoming << "; starting a new trace";
+    context.trace_id = random_hex(32);
+    return context;
+}
+
+std::string TraceContext::traceparent() const
+{
+    return "00-" + trace_id + "-" + span_id + "-01";
+}
+
+std::string TraceContext::NewSpanId()
+{
+    return random_hex(16);
+}
+
+static void json_string(std::ostream& out, const std::string& text)
+{
+    out << '"';
+    for (auto c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out << '\\' << c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            out << ' ';
+        }
+        else
+        {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+SpanExporter::SpanExporter(const std::string& path, std::size_t max_queued)
+: m_file(path, std::ios::app), m_max_queued(max_queued), m_queued(0), m_dropped(0), m_stop(false)
+{
+    CHECK_GT(max_queued, 0);
+    if (!m_file)
+    {
+        LOG(FATAL) << "unable to open span export file " << path;
+    }
+    m_thread = std::thread([this] { Writer(); });
+    LOG(INFO) << "exporting stream spans to " << path;
+}
+
+SpanExporter::~SpanExporter()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+    LOG_IF(WARNING, m_dropped) << "span export dropped " << m_dropped << " spans; the writer fell behind";
+}
+
+void SpanExporter::Export(std::vector<Span>&& spans)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (m_queued + spans.size() > m_max_queued)
+        {
+            m_dropped += spans.size();
+            return;
+        }
+        m_queued += spans.size();
+        m_queue.push_back(std::move(spans));
+    }
+    m_cv.notify_one();
+}
+
+std::uint64_t SpanExporter::dropped()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_dropped;
+}
+
+void SpanExporter::Writer()
+{
+    std::deque<std::vector<Span>> batches;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+            {
+                break;
+            }
+            batches.swap(m_queue);
+            m_queued = 0;
+        }
+
+        for (const auto& spans : batches)
+        {
+            m_file << "{\"resourceSpans\":[{\"resource\":{\"attributes\":[{\"key\":\"service.name\",\"value\":{\"stringValue\":"
+                      "\"speech_squad\"}}]},\"scopeSpans\":[{\"scope\":{\"name\":\"speech_squad\"},\"spans\":[";
+            for (std::size_t i = 0; i < spans.size(); i++)
+            {
+                const auto& span = spans[i];
+                m_file << (i ? "," : "") << "{\"traceId\":\"" << span.trace_id << "\",\"spanId\":\"" << span.span_id << "\"";
+                if (!span.parent_span_id.empty())
+                {
+                    m_file << ",\"parentSpanId\":\"" << span.parent_span_id << "\"";
+                }
+                m_file << ",\"name\":";
+                json_string(m_file, span.name);
+                // SPAN_KIND_SERVER 2, SPAN_KIND_INTERNAL 1; STATUS_CODE_ERROR 2, STATUS_CODE_OK 1
+                m_file << ",\"kind\":" << (span.server ? 2 : 1) << ",\"startTimeUnixNano\":\"" << span.start_unix_ns
+                       << "\",\"endTimeUnixNano\":\"" << span.end_unix_ns << "\",\"attributes\":[";
+                bool first = true;
+                for (const auto& attribute : span.attributes)
+                {
+                    m_file << (first ? "" : ",") << "{\"key\":";
+                    json_string(m_file, attribute.first);
+                    m_file << ",\"value\":{\"stringValue\":";
+                    json_string(m_file, attribute.second);
+                    m_file << "}}";
+                    first = false;
+                }
+                m_file << "],\"status\":{\"code\":" << (span.error ? 2 : 1) << "}}";
+            }
+            m_file << "]}]}]}\n";
+        }
+        batches.clear();
+        m_file.flush();
+    }
+}
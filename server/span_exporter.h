@@ -0,0 +1,75 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace demo
+{
+    // w3c trace context of a squad stream: the trace it belongs to and the span of the server's handling
+    // of it, which parents the stage spans and the riva calls
+    struct TraceContext
+    {
+        std::string trace_id;       // 32 hex digits
+        std::string span_id;        // 16 hex digits
+        std::string parent_span_id; // of the caller; empty when the trace starts here
+
+        // adopts a "00-<trace id>-<parent span id>-<flags>" traceparent or a bare trace id; starts a new
+        // trace for anything else
+        static TraceContext Continue(const std::string& incoming);
+
+        // traceparent header for calls made on behalf of the span
+        std::string traceparent() const;
+
+        static std::string NewSpanId();
+    };
+
+    struct Span
+    {
+        std::string   trace_id;
+        std::string   span_id;
+        std::string   parent_span_id;
+        std::string   name;
+        bool          server; // SPAN_KIND_SERVER, else SPAN_KIND_INTERNAL
+        std::uint64_t start_unix_ns;
+        std::uint64_t end_unix_ns;
+        bool          error;
+
+        std::map<std::string, std::string> attributes;
+    };
+
+    // appends the spans of every stream as one OTLP/JSON ExportTraceServiceRequest per line, the layout of
+    // the opentelemetry collector's file exporter, so the file can be replayed into any OTLP backend. a
+    // background thread does the file i/o; the spans of a stream that would queue more than max_queued
+    // spans on it are dropped and counted
+    class SpanExporter
+    {
+    public:
+        SpanExporter(const std::string& path, std::size_t max_queued);
+        ~SpanExporter();
+
+        void Export(std::vector<Span>&& spans);
+
+        // spans dropped since the start
+        std::uint64_t dropped();
+
+    private:
+        void Writer();
+
+        std::ofstream                 m_file;
+        std::size_t                   m_max_queued;
+        std::mutex                    m_mutex;
+        std::condition_variable       m_cv;
+        std::deque<std::vector<Span>> m_queue;
+        std::size_t                   m_queued; // spans in m_queue
+        std::uint64_t                 m_dropped;
+        bool                          m_stop;
+        std::thread                   m_thread;
+    };
+
+} // namespace demo
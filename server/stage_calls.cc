@@ -0,0 +1,33 @@
+#include "stage_calls.h"
+
+using namespace demo;
+
+void StageCalls::Queued(const std::string& stage)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counts[stage].queued++;
+}
+
+void StageCalls::Dequeued(const std::string& stage)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counts[stage].queued--;
+}
+
+void StageCalls::Started(const std::string& stage)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counts[stage].inflight++;
+}
+
+void StageCalls::Finished(const std::string& stage)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_counts[stage].inflight--;
+}
+
+std::map<std::string, StageCalls::Count> StageCalls::counts()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_counts;
+}
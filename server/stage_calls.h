@@ -0,0 +1,32 @@
+#pragma once
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace demo
+{
+    // riva calls per stage ("asr", "nlp", "tts" and the text stages of the stage graph): those waiting
+    // for a dispatch slot and those in flight. asr calls start with their stream and never wait
+    class StageCalls
+    {
+    public:
+        struct Count
+        {
+            int queued;
+            int inflight;
+        };
+
+        void Queued(const std::string& stage);
+        void Dequeued(const std::string& stage);
+        void Started(const std::string& stage);
+        void Finished(const std::string& stage);
+
+        // every stage that has had a call since the start
+        std::map<std::string, Count> counts();
+
+    private:
+        std::mutex                   m_mutex;
+        std::map<std::string, Count> m_counts;
+    };
+
+} // namespace demo
@@ -0,0 +1,154 @@
+#include "stage_graph.h"
+
+#include <fstream>
+#include <set>
+#include <sstream>
+
+#include <glog/logging.h>
+
+using namespace demo;
+
+static const std::set<std::string> reserved_stages = {"asr", "nlp", "tts"};
+
+StageGraph::StageGraph() : m_question_source("transcript"), m_speech_source("answer") {}
+
+StageGraph StageGraph::Load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        LOG(FATAL) << "unable to open stage graph " << path;
+    }
+
+    StageGraph  graph;
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++)
+    {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+
+        TextStage   stage;
+        std::string method;
+        if (!(fields >> stage.name))
+        {
+            continue;
+        }
+
+        auto where = path + ":" + std::to_string(number);
+        if (!(fields >> method >> stage.input >> stage.output))
+        {
+            LOG(FATAL) << where << ": expected <name> <method> <input> <output> [model]";
+        }
+        fields >> stage.model;
+
+        if (method == "PunctuateText")
+        {
+            stage.method = TextStage::Method::PunctuateText;
+        }
+        else if (method == "TransformText")
+        {
+            stage.method = TextStage::Method::TransformText;
+        }
+        else
+        {
+            LOG(FATAL) << where << ": unknown method " << method << "; expected PunctuateText or TransformText";
+        }
+        graph.Add(std::move(stage), where);
+    }
+
+    graph.Validate(path);
+    for (const auto& stage : graph.m_stages)
+    {
+        LOG(INFO) << "stage " << stage.name << ": " << stage.input << " -> " << stage.output
+                  << (stage.model.empty() ? "" : " (" + stage.model + ")");
+    }
+    return graph;
+}
+
+void StageGraph::Add(TextStage stage, const std::string& where)
+{
+    if (reserved_stages.count(stage.name))
+    {
+        LOG(FATAL) << where << ": stage name " << stage.name << " is reserved for the built-in stages";
+    }
+    if (stage.output == "transcript" || stage.output == "answer")
+    {
+        LOG(FATAL) << where << ": " << stage.output << " is written by a built-in stage";
+    }
+    for (const auto& other : m_stages)
+    {
+        if (other.name == stage.name)
+        {
+            LOG(FATAL) << where << ": duplicate stage name " << stage.name;
+        }
+        if (other.output == stage.output)
+        {
+            LOG(FATAL) << where << ": " << stage.output << " is already written by stage " << other.name;
+        }
+    }
+
+    if (stage.output == "question")
+    {
+        m_question_source = "question";
+    }
+    if (stage.output == "speech")
+    {
+        m_speech_source = "speech";
+    }
+    m_consumers[stage.input].push_back(m_stages.size());
+    m_stages.push_back(std::move(stage));
+}
+
+const std::vector<int>& StageGraph::consumers(const std::string& text) const
+{
+    static const std::vector<int> none;
+    auto it = m_consumers.find(text);
+    return it == m_consumers.end() ? none : it->second;
+}
+
+void StageGraph::Validate(const std::string& path) const
+{
+    std::map<std::string, const TextStage*> writers;
+    for (const auto& stage : m_stages)
+    {
+        writers[stage.output] = &stage;
+    }
+
+    // every stage has a single input, so following the writers either reaches a built-in text
+    // or loops; the built-in text it reaches decides whether the stage runs before or after qa
+    auto origin = [&](const TextStage& stage) {
+        std::set<std::string> seen;
+        auto                  text = stage.input;
+        while (text != "transcript" && text != "answer")
+        {
+            auto writer = writers.find(text);
+            if (writer == writers.end())
+            {
+                LOG(FATAL) << path << ": stage " << stage.name << " reads " << text << ", which no stage writes";
+            }
+            if (!seen.insert(text).second)
+            {
+                LOG(FATAL) << path << ": stage " << stage.name << " is part of a cycle through " << text;
+            }
+            text = writer->second->input;
+        }
+        return text;
+    };
+
+    for (const auto& stage : m_stages)
+    {
+        if (stage.output != "question" && stage.output != "speech" && consumers(stage.output).empty())
+        {
+            LOG(FATAL) << path << ": stage " << stage.name << " writes " << stage.output << ", which no stage reads";
+        }
+        auto text = origin(stage);
+        if (stage.output == "question" && text != "transcript")
+        {
+            LOG(FATAL) << path << ": stage " << stage.name << " writes the question but depends on the answer";
+        }
+        if (stage.output == "speech" && text != "answer")
+        {
+            LOG(FATAL) << path << ": stage " << stage.name << " writes the speech but does not depend on the answer";
+        }
+    }
+}
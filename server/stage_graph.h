@@ -0,0 +1,79 @@
+#pragma once
+#include <map>
+#include <string>
+#include <vector>
+
+namespace demo
+{
+    // riva nlp text rewriting stage inserted into the asr -> qa -> tts pipeline
+    struct TextStage
+    {
+        enum class Method
+        {
+            PunctuateText,
+            TransformText
+        };
+
+        std::string name;
+        Method      method;
+        std::string input;
+        std::string output;
+        std::string model;
+    };
+
+    // dataflow graph of the text stages of a squad stream. stages read one named text and write
+    // another, and a stage is issued as soon as its input is set. there is no join: a stage cannot
+    // wait on two texts, and every output must be read by a stage or be the question or speech,
+    // since the stream waits for every stage it issued. the text stages therefore form a chain
+    // into the question and a chain into the speech, each run one stage after the other; stages
+    // do not run side by side with other text stages. the built-in stages produce and consume
+    // fixed names:
+    //
+    //   transcript  asr result, or the text question
+    //   question    qa query; the transcript when no stage writes it
+    //   answer      qa answer
+    //   speech      tts input; the answer when no stage writes it
+    //
+    // the config file has one stage per line, '#' starts a comment:
+    //
+    //   # name     method         input       output    [model]
+    //   punctuate  PunctuateText  transcript  question  riva_punctuation
+    //   normalize  TransformText  answer      speech    riva_text_norm
+    class StageGraph
+    {
+    public:
+        // the plain asr -> qa -> tts pipeline
+        StageGraph();
+
+        // aborts with a description of the first invalid line
+        static StageGraph Load(const std::string& path);
+
+        const std::vector<TextStage>& stages() const
+        {
+            return m_stages;
+        }
+
+        // indices of the stages reading the named text
+        const std::vector<int>& consumers(const std::string& text) const;
+
+        // names the qa and tts stages read their input from
+        const std::string& question_source() const
+        {
+            return m_question_source;
+        }
+        const std::string& speech_source() const
+        {
+            return m_speech_source;
+        }
+
+    private:
+        void Add(TextStage stage, const std::string& where);
+        void Validate(const std::string& path) const;
+
+        std::vector<TextStage>                  m_stages;
+        std::map<std::string, std::vector<int>> m_consumers;
+        std::string                             m_question_source;
+        std::string                             m_speech_source;
+    };
+
+} // namespace demo
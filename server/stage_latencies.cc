@@ -0,0 +1,49 @@
+#include "stage_latencies.h"
+
+using namespace demo;
+
+// weight of a stream in the moving averages; about the last 20 streams dominate
+static constexpr float latency_alpha = 0.1f;
+
+// a stage without a finished stream for this long is left out of the averages
+static constexpr std::chrono::seconds latency_stale(10);
+
+StageLatencies::StageLatencies() : m_streams(0) {}
+
+void StageLatencies::Record(const std::map<std::string, float>& stage_ms)
+{
+    auto                        now = clock_type::now();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (const auto& stage : stage_ms)
+    {
+        auto average = m_averages.emplace(stage.first, Average{stage.second, now});
+        if (!average.second)
+        {
+            auto& entry = average.first->second;
+            entry.ms += latency_alpha * (stage.second - entry.ms);
+            entry.updated = now;
+        }
+    }
+    m_streams++;
+}
+
+std::map<std::string, float> StageLatencies::averages()
+{
+    auto                         now = clock_type::now();
+    std::map<std::string, float> averages;
+    std::lock_guard<std::mutex>  lock(m_mutex);
+    for (const auto& average : m_averages)
+    {
+        if (now - average.second.updated < latency_stale)
+        {
+            averages[average.first] = average.second.ms;
+        }
+    }
+    return averages;
+}
+
+std::uint64_t StageLatencies::streams()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_streams;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace demo
+{
+    // recent latency of every stage ("e2e" and the stage latencies of the context) over the finished
+    // streams, as exponentially weighted moving averages. a stage no stream has finished for
+    // latency_stale is left out of averages(), so it stops counting once the server stops finishing
+    // streams, e.g. because it rejects them; the average itself is kept for when streams return
+    class StageLatencies
+    {
+    public:
+        StageLatencies();
+
+        void Record(const std::map<std::string, float>& stage_ms);
+
+        // the stages with a stream finished within latency_stale
+        std::map<std::string, float> averages();
+
+        // streams recorded since the start
+        std::uint64_t streams();
+
+    private:
+        using clock_type = std::chrono::steady_clock;
+
+        struct Average
+        {
+            float                  ms;
+            clock_type::time_point updated;
+        };
+
+        std::mutex                     m_mutex;
+        std::map<std::string, Average> m_averages;
+        std::uint64_t                  m_streams;
+    };
+
+} // namespace demo
@@ -0,0 +1,74 @@
+#include "stream_rejection.h"
+
+#include <cstring>
+#include <mutex>
+#include <string>
+
+#include "settings.h"
+
+using namespace demo;
+
+namespace
+{
+    const char squad_infer_method[] = "/SpeechSquadService/SpeechSquadInfer";
+
+    ::grpc::Status rejection_status(const std::string& reason)
+    {
+        if (reason == rejected_memory)
+        {
+            return ::grpc::Status(::grpc::StatusCode::RESOURCE_EXHAUSTED, "speech squad server memory exhausted; stream rejected");
+        }
+        return ::grpc::Status(::grpc::StatusCode::UNAVAILABLE, "speech squad server overloaded; stream rejected");
+    }
+
+    // one per SpeechSquadInfer call
+    class StreamRejectionInterceptor final : public ::grpc::experimental::Interceptor
+    {
+        using hook_t = ::grpc::experimental::InterceptionHookPoints;
+
+    public:
+        void Intercept(::grpc::experimental::InterceptorBatchMethods* methods) override
+        {
+            if (methods->QueryInterceptionHookPoint(hook_t::PRE_SEND_MESSAGE))
+            {
+                auto response = static_cast<const SpeechSquadInferResponse*>(methods->GetSendMessage());
+                if (response && response->has_metadata() && !response->metadata().rejected().empty())
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_rejected = response->metadata().rejected();
+                }
+            }
+            if (methods->QueryInterceptionHookPoint(hook_t::PRE_SEND_STATUS))
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if (!m_rejected.empty())
+                {
+                    methods->ModifySendStatus(rejection_status(m_rejected));
+                }
+            }
+            methods->Proceed();
+        }
+
+    private:
+        std::mutex  m_mutex;
+        std::string m_rejected;
+    };
+
+    class StreamRejectionInterceptorFactory final : public ::grpc::experimental::ServerInterceptorFactoryInterface
+    {
+    public:
+        ::grpc::experimental::Interceptor* CreateServerInterceptor(::grpc::experimental::ServerRpcInfo* info) override
+        {
+            if (std::strcmp(info->method(), squad_infer_method) != 0)
+            {
+                return nullptr;
+            }
+            return new StreamRejectionInterceptor();
+        }
+    };
+} // namespace
+
+std::unique_ptr<::grpc::experimental::ServerInterceptorFactoryInterface> demo::stream_rejection_interceptor()
+{
+    return std::make_unique<StreamRejectionInterceptorFactory>();
+}
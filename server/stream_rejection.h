@@ -0,0 +1,20 @@
+#pragma once
+#include <memory>
+
+#include <grpcpp/grpcpp.h>
+#include <grpcpp/support/server_interceptor.h>
+
+namespace demo
+{
+    // reasons the server refuses to serve a squad stream, as sent in SpeechSquadResponseMeta.rejected;
+    // the stream then finishes with UNAVAILABLE (overloaded) or RESOURCE_EXHAUSTED (server or stream
+    // memory limit), so clients and balancers can tell a rejection from a cancelled stream
+    constexpr char rejected_overloaded[] = "overloaded";
+    constexpr char rejected_memory[]     = "memory";
+
+    // nvrpc finishes a server stream with OK or CANCELLED only. this interceptor remembers the rejected
+    // reason of the responses a SpeechSquadInfer call sends and replaces the status the call finishes
+    // with by the status of the reason
+    std::unique_ptr<::grpc::experimental::ServerInterceptorFactoryInterface> stream_rejection_interceptor();
+
+} // namespace demo
@@ -0,0 +1,336 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <glog/logging.h>
+
+namespace demo
+{
+    inline int random_range(int upper_bound)
+    {
+        int divisor = RAND_MAX / upper_bound;
+        int value;
+
+        do
+        {
+            value = rand() / divisor;
+        } while (value == upper_bound);
+
+        return value;
+    }
+
+    // splitmix64 finalizer; spreads rendezvous scores for adjacent keys/stubs
+    inline std::uint64_t mix_hash(std::uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    struct ChannelLimits
+    {
+        // channels are never dropped below min or grown above max
+        int min_channels;
+        int max_channels;
+
+        // average in-flight streams per channel that trigger a grow / shrink
+        int high_watermark;
+        int low_watermark;
+    };
+
+    // one call counted as in flight on the channel it was issued on, from get() until done()
+    // is called from the completion callback of the call, or until destruction
+    class InFlightCall
+    {
+    public:
+        InFlightCall() = default;
+
+        explicit InFlightCall(std::shared_ptr<std::atomic<long>> count) : m_count(std::move(count))
+        {
+            ++*m_count;
+        }
+
+        InFlightCall(InFlightCall&&) = default;
+
+        InFlightCall& operator=(InFlightCall&& other)
+        {
+            done();
+            m_count = std::move(other.m_count);
+            return *this;
+        }
+
+        ~InFlightCall()
+        {
+            done();
+        }
+
+        void done()
+        {
+            if (m_count)
+            {
+                --*m_count;
+                m_count.reset();
+            }
+        }
+
+    private:
+        std::shared_ptr<std::atomic<long>> m_count;
+    };
+
+    // a stub handed out for one call, with the count of that call on the stub's channel
+    template <typename Stub>
+    struct IssuedStub
+    {
+        std::shared_ptr<Stub> stub;
+        InFlightCall          call;
+    };
+
+    // resizable set of stubs for one downstream endpoint; every stub owns its own channel.
+    // every channel counts the calls issued on it that have not completed yet; references to
+    // the stub itself (warmup, draining, captured prepare functions) do not count.
+    template <typename Stub>
+    class StubPool
+    {
+    public:
+        // returns nullptr if a new channel could not be established
+        using StubFactory = std::function<std::shared_ptr<Stub>()>;
+
+        StubPool(std::string name, StubFactory factory, ChannelLimits limits)
+        : m_name(std::move(name)), m_factory(std::move(factory)), m_limits(limits)
+        {
+            CHECK_GT(m_limits.min_channels, 0);
+            CHECK_GT(m_limits.high_watermark, m_limits.low_watermark);
+            m_limits.max_channels = std::max(m_limits.max_channels, m_limits.min_channels);
+            grow(m_limits.min_channels);
+        }
+
+        const std::string& name() const
+        {
+            return m_name;
+        }
+
+        std::size_t size() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_stubs.size();
+        }
+
+        // power of two choices on the in-flight call count
+        IssuedStub<Stub> get() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            DCHECK(!m_stubs.empty());
+
+            if (m_stubs.size() == 1)
+            {
+                return issue(m_stubs[0]);
+            }
+
+            auto n  = m_stubs.size();
+            auto r1 = random_range(n);
+            auto r2 = random_range(n);
+
+            if (*m_stubs[r1].in_flight < *m_stubs[r2].in_flight)
+            {
+                return issue(m_stubs[r1]);
+            }
+            return issue(m_stubs[r2]);
+        }
+
+        // rendezvous hashing with bounded load: a key keeps landing on the same channel while that
+        // channel carries at most load_factor times the average in-flight calls; when every
+        // preferred channel is over the bound the least loaded channel is used
+        IssuedStub<Stub> get(std::uint64_t key, double load_factor) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            DCHECK(!m_stubs.empty());
+
+            long total = 0;
+            for (const auto& channel : m_stubs)
+            {
+                total += *channel.in_flight;
+            }
+            auto bound = (long)std::ceil(load_factor * (total + 1) / m_stubs.size());
+
+            const Channel* preferred    = nullptr;
+            const Channel* least_loaded = &m_stubs[0];
+            std::uint64_t  best_score   = 0;
+
+            for (const auto& channel : m_stubs)
+            {
+                long in_flight = *channel.in_flight;
+                if (in_flight < *least_loaded->in_flight)
+                {
+                    least_loaded = &channel;
+                }
+                if (in_flight >= bound)
+                {
+                    continue;
+                }
+                // the stub address identifies the channel for as long as it is in the pool
+                auto score = mix_hash(key ^ mix_hash(reinterpret_cast<std::uintptr_t>(channel.stub.get())));
+                if (preferred == nullptr || score > best_score)
+                {
+                    preferred  = &channel;
+                    best_score = score;
+                }
+            }
+            return issue(preferred ? *preferred : *least_loaded);
+        }
+
+        // counts a call on the given channel; the stub is null if the channel is not in the pool
+        IssuedStub<Stub> get(const std::shared_ptr<Stub>& stub) const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (const auto& channel : m_stubs)
+            {
+                if (channel.stub == stub)
+                {
+                    return issue(channel);
+                }
+            }
+            return IssuedStub<Stub>();
+        }
+
+        // grow or shrink the channel count towards the watermarks; returns the new size
+        std::size_t resize()
+        {
+            std::size_t size, target;
+            long        in_flight = 0;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                size = m_stubs.size();
+                for (const auto& channel : m_stubs)
+                {
+                    in_flight += *channel.in_flight;
+                }
+
+                // channels dropped by an earlier shrink are no longer reported once their calls complete;
+                // the clients of those calls keep the stub itself alive
+                m_draining.erase(std::remove_if(m_draining.begin(), m_draining.end(),
+                                                [](const Channel& channel) { return *channel.in_flight == 0; }),
+                                 m_draining.end());
+            }
+
+            target = size;
+            if (in_flight > (long)size * m_limits.high_watermark)
+            {
+                target = (in_flight + m_limits.high_watermark - 1) / m_limits.high_watermark;
+            }
+            else if (in_flight < (long)size * m_limits.low_watermark)
+            {
+                // shrink one channel per interval to avoid oscillating under bursty load
+                target = size - 1;
+            }
+            target = std::max<std::size_t>(target, m_limits.min_channels);
+            target = std::min<std::size_t>(target, m_limits.max_channels);
+
+            if (target > size)
+            {
+                LOG(INFO) << m_name << ": " << in_flight << " streams in flight on " << size << " channels; growing to " << target;
+                grow(target - size);
+            }
+            else if (target < size)
+            {
+                LOG(INFO) << m_name << ": " << in_flight << " streams in flight on " << size << " channels; shrinking to " << target;
+                shrink(size - target);
+            }
+            return this->size();
+        }
+
+        // every channel currently handing out streams; calls made on these stubs are not counted
+        std::vector<std::shared_ptr<Stub>> stubs() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<std::shared_ptr<Stub>> stubs;
+            stubs.reserve(m_stubs.size());
+            for (const auto& channel : m_stubs)
+            {
+                stubs.push_back(channel.stub);
+            }
+            return stubs;
+        }
+
+        // in-flight calls per channel; channels being drained are listed last
+        std::vector<long> stream_counts() const
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            std::vector<long> counts;
+            counts.reserve(m_stubs.size() + m_draining.size());
+            for (const auto& channel : m_stubs)
+            {
+                counts.push_back(*channel.in_flight);
+            }
+            for (const auto& channel : m_draining)
+            {
+                counts.push_back(*channel.in_flight);
+            }
+            return counts;
+        }
+
+    private:
+        struct Channel
+        {
+            std::shared_ptr<Stub>              stub;
+            std::shared_ptr<std::atomic<long>> in_flight;
+        };
+
+        static IssuedStub<Stub> issue(const Channel& channel)
+        {
+            return IssuedStub<Stub>{channel.stub, InFlightCall(channel.in_flight)};
+        }
+
+        void grow(std::size_t count)
+        {
+            // channels are established outside the lock; get() keeps serving the existing ones
+            std::vector<Channel> channels;
+            for (std::size_t i = 0; i < count; i++)
+            {
+                DLOG(INFO) << "establishing connections to " << m_name << " - " << i << " of " << count;
+                auto stub = m_factory();
+                if (!stub)
+                {
+                    LOG(ERROR) << m_name << ": failed to establish a new channel";
+                    break;
+                }
+                channels.push_back(Channel{std::move(stub), std::make_shared<std::atomic<long>>(0)});
+            }
+
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stubs.insert(m_stubs.end(), channels.begin(), channels.end());
+        }
+
+        void shrink(std::size_t count)
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for (std::size_t i = 0; i < count && m_stubs.size() > 1; i++)
+            {
+                // drop the least loaded channel; in-flight calls keep it alive until they complete
+                auto it = std::min_element(m_stubs.begin(), m_stubs.end(),
+                                           [](const Channel& a, const Channel& b) { return *a.in_flight < *b.in_flight; });
+                if (*it->in_flight > 0)
+                {
+                    m_draining.push_back(*it);
+                }
+                m_stubs.erase(it);
+            }
+        }
+
+        std::string                        m_name;
+        StubFactory                        m_factory;
+        ChannelLimits                      m_limits;
+        mutable std::mutex   m_mutex;
+        std::vector<Channel> m_stubs;
+        std::vector<Channel> m_draining;
+    };
+
+} // namespace demo
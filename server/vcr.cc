@@ -0,0 +1,674 @@
+#include "vcr.h"
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <thread>
+
+#include <glog/logging.h>
+#include <google/protobuf/io/coded_stream.h>
+#include <grpcpp/alarm.h>
+#include <google/protobuf/io/zero_copy_stream_impl_lite.h>
+
+#include "settings.h"
+
+using namespace demo;
+
+using vcr_clock_t = std::chrono::steady_clock;
+
+// 003: response and status times are since the start of the call; asr recordings lost their prefix key
+static const char vcr_magic[8] = {'S', 'Q', 'V', 'C', 'R', '0', '0', '3'};
+
+static const std::string asr_method       = "/nvidia.riva.asr.RivaSpeechRecognition/StreamingRecognize";
+static const std::string nlp_method       = "/nvidia.riva.nlp.RivaLanguageUnderstanding/NaturalQuery";
+static const std::string punctuate_method = "/nvidia.riva.nlp.RivaLanguageUnderstanding/PunctuateText";
+static const std::string transform_method = "/nvidia.riva.nlp.RivaLanguageUnderstanding/TransformText";
+static const std::string tts_method       = "/nvidia.riva.tts.RivaSpeechSynthesis/SynthesizeOnline";
+
+void VcrKey::Add(const std::string& bytes)
+{
+    // length first, so message boundaries are part of the hash
+    std::uint64_t size = bytes.size();
+    for (int i = 0; i < 8; i++)
+    {
+        m_hash = (m_hash ^ ((size >> (8 * i)) & 0xff)) * 0x100000001b3ULL;
+    }
+    for (unsigned char c : bytes)
+    {
+        m_hash = (m_hash ^ c) * 0x100000001b3ULL;
+    }
+}
+
+void VcrKey::Add(const google::protobuf::Message& message)
+{
+    // map fields are otherwise serialized in unspecified order
+    std::string bytes;
+    {
+        google::protobuf::io::StringOutputStream stream(&bytes);
+        google::protobuf::io::CodedOutputStream  coded(&stream);
+        coded.SetSerializationDeterministic(true);
+        message.SerializeToCodedStream(&coded);
+    }
+    Add(bytes);
+}
+
+// little endian fixed width integers and length prefixed strings
+
+template <typename T>
+static void write_int(std::ostream& out, T value)
+{
+    for (std::size_t i = 0; i < sizeof(T); i++)
+    {
+        out.put((char)((std::uint64_t)value >> (8 * i)));
+    }
+}
+
+static void write_string(std::ostream& out, const std::string& value)
+{
+    write_int<std::uint32_t>(out, value.size());
+    out.write(value.data(), value.size());
+}
+
+template <typename T>
+static bool read_int(std::istream& in, T& value)
+{
+    std::uint64_t result = 0;
+    for (std::size_t i = 0; i < sizeof(T); i++)
+    {
+        auto c = in.get();
+        if (c == std::char_traits<char>::eof())
+        {
+            return false;
+        }
+        result |= (std::uint64_t)(unsigned char)c << (8 * i);
+    }
+    value = (T)result;
+    return true;
+}
+
+// the length is untrusted; a string may not claim more than is left of the file before end
+static bool read_string(std::istream& in, std::string& value, std::streamoff end)
+{
+    std::uint32_t size;
+    if (!read_int(in, size))
+    {
+        return false;
+    }
+    std::streamoff position = in.tellg();
+    if (position < 0 || size > end - position)
+    {
+        return false;
+    }
+    value.resize(size);
+    return (bool)in.read(&value[0], size);
+}
+
+static void write_recording(std::ostream& out, const VcrRecording& recording)
+{
+    write_int(out, recording.key);
+    write_string(out, recording.method);
+    write_int<std::uint32_t>(out, recording.responses.size());
+    for (const auto& response : recording.responses)
+    {
+        write_int(out, response.first);
+        write_string(out, response.second);
+    }
+    write_int(out, recording.status_us);
+    write_int(out, recording.status_code);
+    write_string(out, recording.status_message);
+    write_int<std::uint32_t>(out, recording.trailing_metadata.size());
+    for (const auto& entry : recording.trailing_metadata)
+    {
+        write_string(out, entry.first);
+        write_string(out, entry.second);
+    }
+}
+
+VcrLog::VcrLog(const std::string& path) : m_stop(false), m_file(path, std::ios::binary | std::ios::trunc)
+{
+    if (!m_file)
+    {
+        LOG(FATAL) << "unable to open vcr log " << path;
+    }
+    m_file.write(vcr_magic, sizeof(vcr_magic));
+    m_thread = std::thread([this] { Writer(); });
+    LOG(INFO) << "recording riva calls to " << path;
+}
+
+VcrLog::~VcrLog()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cv.notify_one();
+    m_thread.join();
+}
+
+void VcrLog::Append(VcrRecording&& recording)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(recording));
+    }
+    m_cv.notify_one();
+}
+
+void VcrLog::Writer()
+{
+    std::deque<VcrRecording> recordings;
+    for (;;)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_cv.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+            if (m_queue.empty())
+            {
+                break;
+            }
+            recordings.swap(m_queue);
+        }
+
+        for (const auto& recording : recordings)
+        {
+            write_recording(m_file, recording);
+        }
+        recordings.clear();
+        // a killed benchmark keeps every call the writer got to
+        m_file.flush();
+    }
+}
+
+std::vector<VcrRecording> VcrLog::Load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    std::streamoff end = file.tellg();
+    file.seekg(0);
+    char magic[sizeof(vcr_magic)];
+    if (!file.read(magic, sizeof(magic)) || !std::equal(magic, magic + sizeof(magic), vcr_magic))
+    {
+        LOG(FATAL) << path << " is not a vcr log of this version";
+    }
+
+    std::vector<VcrRecording> recordings;
+    while (file.peek() != std::char_traits<char>::eof())
+    {
+        VcrRecording  recording;
+        std::uint32_t count;
+
+        bool ok = read_int(file, recording.key) && read_string(file, recording.method, end) && read_int(file, count);
+        for (std::uint32_t i = 0; ok && i < count; i++)
+        {
+            std::pair<std::uint64_t, std::string> response;
+            ok = read_int(file, response.first) && read_string(file, response.second, end);
+            recording.responses.push_back(std::move(response));
+        }
+        ok = ok && read_int(file, recording.status_us) && read_int(file, recording.status_code) &&
+             recording.status_code >= ::grpc::StatusCode::OK && recording.status_code <= ::grpc::StatusCode::UNAUTHENTICATED &&
+             read_string(file, recording.status_message, end) && read_int(file, count);
+        for (std::uint32_t i = 0; ok && i < count; i++)
+        {
+            std::pair<std::string, std::string> entry;
+            ok = read_string(file, entry.first, end) && read_string(file, entry.second, end);
+            recording.trailing_metadata.push_back(std::move(entry));
+        }
+        if (!ok)
+        {
+            LOG(WARNING) << path << ": dropping truncated or corrupt record after " << recordings.size() << " recordings";
+            break;
+        }
+        recordings.push_back(std::move(recording));
+    }
+    return recordings;
+}
+
+namespace
+{
+    // one per call; hashes the requests and timestamps the responses as they cross the channel
+    class VcrRecordInterceptor final : public ::grpc::experimental::Interceptor
+    {
+        using hook_t = ::grpc::experimental::InterceptionHookPoints;
+
+    public:
+        VcrRecordInterceptor(::grpc::experimental::ClientRpcInfo* info, std::shared_ptr<VcrLog> log)
+        : m_log(std::move(log)), m_start(vcr_clock_t::now())
+        {
+            m_recording.method = info->method();
+            m_key.Add(m_recording.method);
+        }
+
+        void Intercept(::grpc::experimental::InterceptorBatchMethods* methods) override
+        {
+            auto now = vcr_clock_t::now();
+            {
+                // sends and receives of a bidi stream are intercepted from different threads
+                std::lock_guard<std::mutex> lock(m_mutex);
+
+                if (methods->QueryInterceptionHookPoint(hook_t::PRE_SEND_MESSAGE))
+                {
+                    auto message = static_cast<const google::protobuf::Message*>(methods->GetSendMessage());
+                    if (message)
+                    {
+                        m_key.Add(*message);
+                    }
+                }
+                if (methods->QueryInterceptionHookPoint(hook_t::POST_RECV_MESSAGE))
+                {
+                    auto message = static_cast<const google::protobuf::Message*>(methods->GetRecvMessage());
+                    if (message)
+                    {
+                        m_recording.responses.emplace_back(elapsed_us(now), message->SerializeAsString());
+                    }
+                }
+                if (methods->QueryInterceptionHookPoint(hook_t::POST_RECV_STATUS))
+                {
+                    auto status                  = methods->GetRecvStatus();
+                    m_recording.key              = m_key.value();
+                    m_recording.status_us        = elapsed_us(now);
+                    m_recording.status_code      = status->error_code();
+                    m_recording.status_message   = status->error_message();
+                    for (const auto& entry : *methods->GetRecvTrailingMetadata())
+                    {
+                        m_recording.trailing_metadata.emplace_back(std::string(entry.first.begin(), entry.first.end()),
+                                                                   std::string(entry.second.begin(), entry.second.end()));
+                    }
+                    m_log->Append(std::move(m_recording));
+                }
+            }
+            methods->Proceed();
+        }
+
+    private:
+        std::uint64_t elapsed_us(vcr_clock_t::time_point now) const
+        {
+            return std::max<std::int64_t>(0, std::chrono::duration_cast<std::chrono::microseconds>(now - m_start).count());
+        }
+
+        std::shared_ptr<VcrLog> m_log;
+        std::mutex              m_mutex;
+        VcrKey                  m_key;
+        VcrRecording            m_recording;
+        vcr_clock_t::time_point m_start;
+    };
+
+    class VcrRecordInterceptorFactory final : public ::grpc::experimental::ClientInterceptorFactoryInterface
+    {
+    public:
+        VcrRecordInterceptorFactory(std::shared_ptr<VcrLog> log) : m_log(std::move(log)) {}
+
+        ::grpc::experimental::Interceptor* CreateClientInterceptor(::grpc::experimental::ClientRpcInfo* info) override
+        {
+            return new VcrRecordInterceptor(info, m_log);
+        }
+
+    private:
+        std::shared_ptr<VcrLog> m_log;
+    };
+
+} // namespace
+
+// one replayed call with one operation in flight at a time: it is accepted, reads its requests into
+// the key, looks up its recording and then waits on an alarm before every response and before the
+// status. Proceed() runs under the server's m_mutex
+class VcrReplayServer::Call
+{
+public:
+    Call(VcrReplayServer* server, const std::string& method)
+    : m_server(server), m_method(method), m_state(State::Accepting), m_recording(nullptr), m_next(0)
+    {
+    }
+
+    virtual ~Call() = default;
+
+    // the completion of the operation in flight; false once the call is done and may be deleted
+    bool Proceed(bool ok)
+    {
+        switch (m_state)
+        {
+        case State::Accepting:
+            if (!ok)
+            {
+                // the server is shutting down
+                return false;
+            }
+            Next();
+            m_start = vcr_clock_t::now();
+            m_key.Add(m_method);
+            m_state = State::Reading;
+            return Read() || Lookup();
+
+        case State::Reading:
+            // a failed read is the end of the request stream
+            return (ok && Read()) || Lookup();
+
+        case State::Waiting:
+            m_server->m_waiting.erase(this);
+            if (!ok)
+            {
+                // the alarm was cancelled at shutdown
+                return false;
+            }
+            if (m_next < m_recording->responses.size())
+            {
+                m_state = State::Writing;
+                return Write(m_recording->responses[m_next].second) || Written();
+            }
+            for (const auto& entry : m_recording->trailing_metadata)
+            {
+                m_context.AddTrailingMetadata(entry.first, entry.second);
+            }
+            m_state = State::Finishing;
+            Finish(::grpc::Status((::grpc::StatusCode)m_recording->status_code, m_recording->status_message));
+            return true;
+
+        case State::Writing:
+            // a failed write is a cancelled call
+            return ok && Written();
+
+        case State::Finishing:
+            return false;
+        }
+        return false;
+    }
+
+    void Cancel()
+    {
+        m_alarm.Cancel();
+    }
+
+protected:
+    // a new call waiting for the next request of the method
+    virtual void Next() = 0;
+
+    // adds the request received last to m_key and reads the next one; false once all are in m_key
+    virtual bool Read() = 0;
+
+    // writes a response; false if the response is kept for Finish() instead
+    virtual bool Write(const std::string& response) = 0;
+
+    virtual void Finish(const ::grpc::Status&) = 0;
+
+    VcrReplayServer*      m_server;
+    const std::string&    m_method;
+    ::grpc::ServerContext m_context;
+    VcrKey                m_key;
+
+private:
+    enum class State
+    {
+        Accepting,
+        Reading,
+        Waiting,
+        Writing,
+        Finishing
+    };
+
+    bool Lookup()
+    {
+        auto tape = m_server->m_tapes.find(m_key.value());
+        if (tape == m_server->m_tapes.end())
+        {
+            LOG(WARNING) << "vcr replay: no recording of " << m_method << " request " << std::hex << m_key.value();
+            m_state = State::Finishing;
+            Finish(::grpc::Status(::grpc::StatusCode::NOT_FOUND, "no recording of this request"));
+            return true;
+        }
+        m_recording = &tape->second.recordings[tape->second.next++ % tape->second.recordings.size()];
+        return Schedule();
+    }
+
+    bool Written()
+    {
+        m_next++;
+        return Schedule();
+    }
+
+    // an alarm at the recorded time of the next response, or of the status
+    bool Schedule()
+    {
+        auto us = m_next < m_recording->responses.size() ? m_recording->responses[m_next].first : m_recording->status_us;
+        auto at = std::chrono::system_clock::now() + (m_start + std::chrono::microseconds(us) - vcr_clock_t::now());
+        m_state = State::Waiting;
+        m_server->m_waiting.insert(this);
+        m_alarm.Set(m_server->m_cq.get(), at, this);
+        return true;
+    }
+
+    State                   m_state;
+    vcr_clock_t::time_point m_start;
+    const VcrRecording*     m_recording;
+    std::size_t             m_next;
+    ::grpc::Alarm           m_alarm;
+};
+
+namespace
+{
+    using asr_service_t = nvidia::riva::asr::RivaSpeechRecognition::WithAsyncMethod_StreamingRecognize<
+        nvidia::riva::asr::RivaSpeechRecognition::Service>;
+    using nlp_service_t = nvidia::riva::nlp::RivaLanguageUnderstanding::WithAsyncMethod_NaturalQuery<
+        nvidia::riva::nlp::RivaLanguageUnderstanding::WithAsyncMethod_PunctuateText<
+            nvidia::riva::nlp::RivaLanguageUnderstanding::WithAsyncMethod_TransformText<nvidia::riva::nlp::RivaLanguageUnderstanding::Service>>>;
+    using tts_service_t = nvidia::riva::tts::RivaSpeechSynthesis::WithAsyncMethod_SynthesizeOnline<
+        nvidia::riva::tts::RivaSpeechSynthesis::Service>;
+
+    class ReplayASR final : public VcrReplayServer::Call
+    {
+    public:
+        ReplayASR(VcrReplayServer* server, asr_service_t* service, ::grpc::ServerCompletionQueue* cq)
+        : Call(server, asr_method), m_service(service), m_cq(cq), m_stream(&m_context), m_reading(false)
+        {
+            m_service->RequestStreamingRecognize(&m_context, &m_stream, m_cq, m_cq, this);
+        }
+
+    private:
+        void Next() override
+        {
+            new ReplayASR(m_server, m_service, m_cq);
+        }
+
+        bool Read() override
+        {
+            if (m_reading)
+            {
+                m_key.Add(m_request);
+            }
+            m_reading = true;
+            m_stream.Read(&m_request, this);
+            return true;
+        }
+
+        bool Write(const std::string& bytes) override
+        {
+            asr_response_t response;
+            response.ParseFromString(bytes);
+            m_stream.Write(response, this);
+            return true;
+        }
+
+        void Finish(const ::grpc::Status& status) override
+        {
+            m_stream.Finish(status, this);
+        }
+
+        asr_service_t*                                                     m_service;
+        ::grpc::ServerCompletionQueue*                                     m_cq;
+        ::grpc::ServerAsyncReaderWriter<asr_response_t, asr_request_t> m_stream;
+        asr_request_t                                                      m_request;
+        bool                                                               m_reading;
+    };
+
+    template <typename Request, typename Response>
+    class ReplayUnary final : public VcrReplayServer::Call
+    {
+    public:
+        using Accept = void (nlp_service_t::*)(::grpc::ServerContext*, Request*, ::grpc::ServerAsyncResponseWriter<Response>*,
+                                               ::grpc::CompletionQueue*, ::grpc::ServerCompletionQueue*, void*);
+
+        ReplayUnary(VcrReplayServer* server, const std::string& method, nlp_service_t* service, Accept accept,
+                    ::grpc::ServerCompletionQueue* cq)
+        : Call(server, method), m_service(service), m_accept(accept), m_cq(cq), m_responder(&m_context)
+        {
+            (m_service->*m_accept)(&m_context, &m_request, &m_responder, m_cq, m_cq, this);
+        }
+
+    private:
+        void Next() override
+        {
+            new ReplayUnary(m_server, m_method, m_service, m_accept, m_cq);
+        }
+
+        bool Read() override
+        {
+            m_key.Add(m_request);
+            return false;
+        }
+
+        bool Write(const std::string& bytes) override
+        {
+            m_response.ParseFromString(bytes);
+            return false;
+        }
+
+        void Finish(const ::grpc::Status& status) override
+        {
+            if (status.ok())
+            {
+                m_responder.Finish(m_response, status, this);
+                return;
+            }
+            m_responder.FinishWithError(status, this);
+        }
+
+        nlp_service_t*                              m_service;
+        Accept                                      m_accept;
+        ::grpc::ServerCompletionQueue*              m_cq;
+        ::grpc::ServerAsyncResponseWriter<Response> m_responder;
+        Request                                     m_request;
+        Response                                    m_response;
+    };
+
+    class ReplayTTS final : public VcrReplayServer::Call
+    {
+    public:
+        ReplayTTS(VcrReplayServer* server, tts_service_t* service, ::grpc::ServerCompletionQueue* cq)
+        : Call(server, tts_method), m_service(service), m_cq(cq), m_writer(&m_context)
+        {
+            m_service->RequestSynthesizeOnline(&m_context, &m_request, &m_writer, m_cq, m_cq, this);
+        }
+
+    private:
+        void Next() override
+        {
+            new ReplayTTS(m_server, m_service, m_cq);
+        }
+
+        bool Read() override
+        {
+            m_key.Add(m_request);
+            return false;
+        }
+
+        bool Write(const std::string& bytes) override
+        {
+            m_response.ParseFromString(bytes);
+            m_writer.Write(m_response, this);
+            return true;
+        }
+
+        void Finish(const ::grpc::Status& status) override
+        {
+            m_writer.Finish(status, this);
+        }
+
+        tts_service_t*                                 m_service;
+        ::grpc::ServerCompletionQueue*                 m_cq;
+        ::grpc::ServerAsyncWriter<tts_response_t> m_writer;
+        tts_request_t                                  m_request;
+        tts_response_t                                 m_response;
+    };
+
+} // namespace
+
+std::vector<std::unique_ptr<::grpc::experimental::ClientInterceptorFactoryInterface>> demo::vcr_record_interceptors(std::shared_ptr<VcrLog> log)
+{
+    std::vector<std::unique_ptr<::grpc::experimental::ClientInterceptorFactoryInterface>> factories;
+    factories.push_back(std::make_unique<VcrRecordInterceptorFactory>(std::move(log)));
+    return factories;
+}
+
+VcrReplayServer::VcrReplayServer(const std::string& path, const std::string& address) : m_address(address), m_stopping(false)
+{
+    auto recordings = VcrLog::Load(path);
+    for (auto& recording : recordings)
+    {
+        m_tapes[recording.key].recordings.push_back(std::move(recording));
+    }
+    LOG(INFO) << "replaying " << recordings.size() << " riva calls (" << m_tapes.size() << " distinct requests) from " << path;
+
+    auto asr = std::make_unique<asr_service_t>();
+    auto nlp = std::make_unique<nlp_service_t>();
+    auto tts = std::make_unique<tts_service_t>();
+
+    ::grpc::ServerBuilder builder;
+    builder.AddListeningPort(m_address, ::grpc::InsecureServerCredentials());
+    builder.RegisterService(asr.get());
+    builder.RegisterService(nlp.get());
+    builder.RegisterService(tts.get());
+    m_cq     = builder.AddCompletionQueue();
+    m_server = builder.BuildAndStart();
+    if (!m_server)
+    {
+        LOG(FATAL) << "unable to start the vcr replay server on " << m_address;
+    }
+
+    // one call of every method waits for a request; each accepted call starts the next
+    new ReplayASR(this, asr.get(), m_cq.get());
+    new ReplayUnary<nlp_request_t, nlp_response_t>(this, nlp_method, nlp.get(), &nlp_service_t::RequestNaturalQuery, m_cq.get());
+    new ReplayUnary<text_request_t, text_response_t>(this, punctuate_method, nlp.get(), &nlp_service_t::RequestPunctuateText, m_cq.get());
+    new ReplayUnary<text_request_t, text_response_t>(this, transform_method, nlp.get(), &nlp_service_t::RequestTransformText, m_cq.get());
+    new ReplayTTS(this, tts.get(), m_cq.get());
+    m_services.push_back(std::move(asr));
+    m_services.push_back(std::move(nlp));
+    m_services.push_back(std::move(tts));
+
+    m_thread = std::thread([this] { Serve(); });
+}
+
+VcrReplayServer::~VcrReplayServer()
+{
+    // cancels the calls in replay at once instead of waiting for them
+    m_server->Shutdown(std::chrono::system_clock::now());
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        for (auto call : m_waiting)
+        {
+            call->Cancel();
+        }
+    }
+    m_cq->Shutdown();
+    m_thread.join();
+}
+
+void VcrReplayServer::Serve()
+{
+    void* tag;
+    bool  ok;
+    while (m_cq->Next(&tag, &ok))
+    {
+        auto call = static_cast<Call*>(tag);
+        bool more;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            more = !m_stopping && call->Proceed(ok);
+            if (!more)
+            {
+                m_waiting.erase(call);
+            }
+        }
+        if (!more)
+        {
+            delete call;
+        }
+    }
+}
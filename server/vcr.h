@@ -0,0 +1,130 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <google/protobuf/message.h>
+#include <grpcpp/grpcpp.h>
+#include <grpcpp/impl/codegen/service_type.h>
+#include <grpcpp/support/client_interceptor.h>
+
+namespace demo
+{
+    // downstream record/replay. in record mode every riva call made by the server is captured
+    // at the channel: the request hash, each response with its time since the start of the call,
+    // the trailing metadata and the final status. in replay mode an in-process server answers
+    // the riva services from the log, so the orchestration layer runs unchanged without gpus.
+
+    // fnv-1a over the method and the deterministic serialization of every request message
+    class VcrKey
+    {
+    public:
+        VcrKey() : m_hash(0xcbf29ce484222325ULL) {}
+
+        void Add(const std::string& bytes);
+        void Add(const google::protobuf::Message& message);
+
+        std::uint64_t value() const
+        {
+            return m_hash;
+        }
+
+    private:
+        std::uint64_t m_hash;
+    };
+
+    struct VcrRecording
+    {
+        std::uint64_t                                    key;
+        std::string                                      method;
+        std::vector<std::pair<std::uint64_t, std::string>> responses; // (us since the call started, serialized response)
+        std::uint64_t                                    status_us;
+        std::int32_t                                     status_code;
+        std::string                                      status_message;
+        std::vector<std::pair<std::string, std::string>> trailing_metadata;
+    };
+
+    // append-only binary log of length prefixed recordings. a background thread does the file i/o,
+    // so the grpc threads that complete the calls only queue them
+    class VcrLog
+    {
+    public:
+        VcrLog(const std::string& path);
+        ~VcrLog();
+
+        void Append(VcrRecording&&);
+
+        // recordings in log order; a truncated final record is dropped
+        static std::vector<VcrRecording> Load(const std::string& path);
+
+    private:
+        void Writer();
+
+        std::mutex               m_mutex;
+        std::condition_variable  m_cv;
+        std::deque<VcrRecording> m_queue;
+        bool                     m_stop;
+
+        // owned by the writer thread
+        std::ofstream m_file;
+
+        std::thread m_thread;
+    };
+
+    // attach to downstream channels to record their calls
+    std::vector<std::unique_ptr<::grpc::experimental::ClientInterceptorFactoryInterface>> vcr_record_interceptors(std::shared_ptr<VcrLog>);
+
+    // serves the riva asr, nlp and tts services from a log. a call is matched by the hash of all of
+    // its requests, so a streaming asr call is answered once its request stream is closed; repeated
+    // recordings of a request are played round robin, and a request that was never recorded fails
+    // with NOT_FOUND. every response and the status are played at their recorded time since the
+    // start of the call. the calls are asynchronous and wait for their recorded times on completion
+    // queue alarms, so a call in replay holds no thread.
+    class VcrReplayServer
+    {
+    public:
+        VcrReplayServer(const std::string& path, const std::string& address);
+        ~VcrReplayServer();
+
+        const std::string& address() const
+        {
+            return m_address;
+        }
+
+        struct Tape
+        {
+            std::vector<VcrRecording> recordings;
+            std::atomic<std::size_t>  next{0};
+        };
+
+        // one replayed call, advanced by the completions on the queue
+        class Call;
+
+    private:
+        void Serve();
+
+        std::string                                    m_address;
+        std::map<std::uint64_t, Tape>                  m_tapes;
+        std::vector<std::unique_ptr<::grpc::Service>>  m_services;
+        std::unique_ptr<::grpc::ServerCompletionQueue> m_cq;
+        std::unique_ptr<::grpc::Server>                m_server;
+        std::thread                                    m_thread;
+
+        // calls advance under m_mutex; the calls waiting on an alarm are cancelled at shutdown, and
+        // once m_stopping is set no call starts another operation
+        std::mutex      m_mutex;
+        std::set<Call*> m_waiting;
+        bool            m_stopping;
+    };
+
+} // namespace demo